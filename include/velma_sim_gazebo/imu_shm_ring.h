@@ -0,0 +1,162 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef VELMA_SIM_GAZEBO_IMU_SHM_RING_H__
+#define VELMA_SIM_GAZEBO_IMU_SHM_RING_H__
+
+//
+// Layout of the shared memory ring written by the BaseImu plugin, and a
+// header-only reader for local consumers.
+//
+// The segment is a POSIX shared memory object: ImuShmHeader followed by
+// 'capacity' slots of ImuShmSample. There is a single writer. Sample n
+// (counted from 0) is stored in slot n % capacity. Each slot is guarded by
+// its own sequence number: it is odd while the slot is written, and equal
+// to 2*(n+1) when sample n is complete. The reader copies the slot and
+// checks that the sequence number did not change.
+//
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define IMU_SHM_MAGIC       0x494d5552
+#define IMU_SHM_VERSION     1
+
+namespace velma_sim_gazebo {
+
+struct ImuShmSample {
+    uint64_t lock;
+    uint32_t seq;
+    int32_t sec;
+    int32_t nsec;
+    int32_t reserved;
+    double orientation[4];          // x, y, z, w
+    double angular_velocity[3];
+    double linear_acceleration[3];
+};
+
+struct ImuShmHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t sample_size;
+    uint64_t write_count;           // number of completed samples
+};
+
+inline size_t imuShmSize(uint32_t capacity) {
+    return sizeof(ImuShmHeader) + capacity * sizeof(ImuShmSample);
+}
+
+inline ImuShmSample* imuShmSlots(ImuShmHeader *hdr) {
+    return reinterpret_cast<ImuShmSample* >(hdr + 1);
+}
+
+class ImuShmReader {
+public:
+    ImuShmReader()
+        : hdr_(NULL)
+        , size_(0)
+    {}
+
+    ~ImuShmReader() {
+        close();
+    }
+
+    bool open(const std::string &name) {
+        close();
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(ImuShmHeader)) {
+            ::close(fd);
+            return false;
+        }
+        void *ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (ptr == MAP_FAILED) {
+            return false;
+        }
+        hdr_ = static_cast<ImuShmHeader* >(ptr);
+        size_ = st.st_size;
+        if (hdr_->magic != IMU_SHM_MAGIC || hdr_->version != IMU_SHM_VERSION
+                || hdr_->sample_size != sizeof(ImuShmSample)
+                || size_ < imuShmSize(hdr_->capacity)) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (hdr_) {
+            munmap(hdr_, size_);
+            hdr_ = NULL;
+            size_ = 0;
+        }
+    }
+
+    bool isOpen() const {
+        return hdr_ != NULL;
+    }
+
+    // the number of samples written so far
+    uint64_t getWriteCount() const {
+        return __atomic_load_n(&hdr_->write_count, __ATOMIC_ACQUIRE);
+    }
+
+    // reads sample n; fails if it is not written yet or already overwritten
+    bool read(uint64_t n, ImuShmSample &sample) const {
+        const ImuShmSample *slot = imuShmSlots(hdr_) + (n % hdr_->capacity);
+        const uint64_t expected = 2 * (n + 1);
+        if (__atomic_load_n(&slot->lock, __ATOMIC_ACQUIRE) != expected) {
+            return false;
+        }
+        memcpy(&sample, slot, sizeof(ImuShmSample));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        return __atomic_load_n(&slot->lock, __ATOMIC_RELAXED) == expected;
+    }
+
+    bool readLatest(ImuShmSample &sample) const {
+        const uint64_t count = getWriteCount();
+        return count > 0 && read(count - 1, sample);
+    }
+
+private:
+    ImuShmHeader *hdr_;
+    size_t size_;
+};
+
+}   // namespace velma_sim_gazebo
+
+#endif  // VELMA_SIM_GAZEBO_IMU_SHM_RING_H__
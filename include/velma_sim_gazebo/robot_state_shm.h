@@ -0,0 +1,234 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef VELMA_SIM_GAZEBO_ROBOT_STATE_SHM_H__
+#define VELMA_SIM_GAZEBO_ROBOT_STATE_SHM_H__
+
+//
+// Layout of the shared memory segment with the state of the whole simulated
+// robot, and a header-only reader for local consumers.
+//
+// The segment is a POSIX shared memory object: RobotStateShmHeader followed
+// by RobotStateShmData. The simulator writes the state once per physics step,
+// guarded by the sequence number in the header: it is odd while the state is
+// written and it is incremented by 2 in every step. A reader checks that the
+// sequence number is even and the same before and after reading. The readers
+// do not write to the segment, so they cost nothing to the simulator.
+//
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define ROBOT_STATE_SHM_MAGIC       0x53425256
+#define ROBOT_STATE_SHM_VERSION     1
+
+namespace velma_sim_gazebo {
+
+enum RobotStateShmSide {
+    ROBOT_STATE_SHM_RIGHT = 0,
+    ROBOT_STATE_SHM_LEFT = 1
+};
+
+// the bits of RobotStateShmData::updated
+enum RobotStateShmPart {
+    ROBOT_STATE_SHM_RIGHT_ARM   = 1 << 0,
+    ROBOT_STATE_SHM_LEFT_ARM    = 1 << 1,
+    ROBOT_STATE_SHM_RIGHT_HAND  = 1 << 2,
+    ROBOT_STATE_SHM_LEFT_HAND   = 1 << 3,
+    ROBOT_STATE_SHM_TORSO       = 1 << 4,
+    ROBOT_STATE_SHM_RIGHT_FT    = 1 << 5,
+    ROBOT_STATE_SHM_LEFT_FT     = 1 << 6,
+    ROBOT_STATE_SHM_IMU         = 1 << 7
+};
+
+struct RobotStateShmArm {
+    double q[7];
+    double dq[7];
+    double t[7];                    // the applied torques
+    double t_ext[7];                // the external torques, estimated
+    double gravity[7];              // the gravity torques
+    uint32_t command_mode;
+    uint32_t reserved;
+};
+
+// written when the hand samples its joints: in every step, or with the reduced
+// rate in the idle state (the updated flag of the hand is set only then)
+struct RobotStateShmHand {
+    double q[8];                    // the joints of BarrettHandGazebo, in its order
+    double dq[8];
+    double t[8];
+};
+
+struct RobotStateShmTorso {
+    double q;
+    double dq;
+    double t;
+    double head_q[2];               // pan, tilt
+    double head_dq[2];
+    double reserved;
+};
+
+struct RobotStateShmFt {
+    double force[3];                // in the sensor frame
+    double torque[3];
+};
+
+struct RobotStateShmImu {
+    double orientation[4];          // x, y, z, w
+    double angular_velocity[3];
+    double linear_acceleration[3];
+};
+
+struct RobotStateShmData {
+    uint64_t iteration;             // the iteration of the world
+    double sim_time;                // [s]
+    uint32_t updated;               // the parts written in this step, RobotStateShmPart
+    uint32_t reserved;
+    RobotStateShmArm arm[2];        // RobotStateShmSide
+    RobotStateShmHand hand[2];
+    RobotStateShmTorso torso;
+    RobotStateShmFt ft[2];
+    RobotStateShmImu imu;
+};
+
+struct RobotStateShmHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t data_size;
+    uint32_t reserved;
+    uint64_t seq;                   // odd while the state is written
+    uint64_t reserved2;
+};
+
+inline size_t robotStateShmSize() {
+    return sizeof(RobotStateShmHeader) + sizeof(RobotStateShmData);
+}
+
+inline RobotStateShmData* robotStateShmData(RobotStateShmHeader *hdr) {
+    return reinterpret_cast<RobotStateShmData* >(hdr + 1);
+}
+
+class RobotStateShmReader {
+public:
+    RobotStateShmReader()
+        : hdr_(NULL)
+        , size_(0)
+    {}
+
+    ~RobotStateShmReader() {
+        close();
+    }
+
+    bool open(const std::string &name) {
+        close();
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(RobotStateShmHeader)) {
+            ::close(fd);
+            return false;
+        }
+        void *ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (ptr == MAP_FAILED) {
+            return false;
+        }
+        hdr_ = static_cast<RobotStateShmHeader* >(ptr);
+        size_ = st.st_size;
+        if (__atomic_load_n(&hdr_->magic, __ATOMIC_ACQUIRE) != ROBOT_STATE_SHM_MAGIC
+                || hdr_->version != ROBOT_STATE_SHM_VERSION
+                || hdr_->data_size != sizeof(RobotStateShmData)
+                || size_ < robotStateShmSize()) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (hdr_) {
+            munmap(hdr_, size_);
+            hdr_ = NULL;
+            size_ = 0;
+        }
+    }
+
+    bool isOpen() const {
+        return hdr_ != NULL;
+    }
+
+    // the sequence number, seq / 2 states are written so far;
+    // it is odd while the state is written
+    uint64_t getSequence() const {
+        return __atomic_load_n(&hdr_->seq, __ATOMIC_ACQUIRE);
+    }
+
+    // calls f(const RobotStateShmData&) on the shared memory, without a copy;
+    // returns false if the state was written meanwhile, then the results of f
+    // must be discarded (f must not follow pointers or indices read from the state)
+    template <typename F >
+    bool visit(F f, uint64_t *seq = NULL) const {
+        const uint64_t before = getSequence();
+        if ((before & 1) != 0 || before == 0) {
+            return false;
+        }
+        f(*robotStateShmData(hdr_));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&hdr_->seq, __ATOMIC_RELAXED) != before) {
+            return false;
+        }
+        if (seq) {
+            *seq = before;
+        }
+        return true;
+    }
+
+    // copies the latest state; it is retried while the state is written
+    bool read(RobotStateShmData &state, uint64_t *seq = NULL, int retries = 100) const {
+        for (int i = 0; i < retries; ++i) {
+            if (visit([&state](const RobotStateShmData &data) { memcpy(&state, &data, sizeof(RobotStateShmData)); }, seq)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    RobotStateShmHeader *hdr_;
+    size_t size_;
+};
+
+}   // namespace velma_sim_gazebo
+
+#endif  // VELMA_SIM_GAZEBO_ROBOT_STATE_SHM_H__
@@ -0,0 +1,68 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef ALLOCATION_AUDIT_H__
+#define ALLOCATION_AUDIT_H__
+
+//
+// Audit of the heap allocations in the real-time hooks. The hooks that must
+// not allocate are marked with VELMA_SIM_RT_SCOPE("Component::hook"). If the
+// simulator runs with libvelma_sim_allocation_audit.so preloaded (the
+// allocation_audit launch argument), every malloc and free in a marked scope
+// is counted, and the first offending call stack of every scope is printed
+// to stderr. Without the library the scope costs one test of a NULL pointer.
+//
+
+extern "C" {
+// defined in libvelma_sim_allocation_audit.so, NULL if it is not preloaded
+void velma_sim_allocation_audit_enter(const char *scope) __attribute__((weak));
+void velma_sim_allocation_audit_exit() __attribute__((weak));
+}
+
+class AllocationAuditScope {
+public:
+    explicit AllocationAuditScope(const char *scope) {
+        if (velma_sim_allocation_audit_enter) {
+            velma_sim_allocation_audit_enter(scope);
+        }
+    }
+
+    ~AllocationAuditScope() {
+        if (velma_sim_allocation_audit_exit) {
+            velma_sim_allocation_audit_exit();
+        }
+    }
+
+private:
+    AllocationAuditScope(const AllocationAuditScope&);
+    AllocationAuditScope& operator=(const AllocationAuditScope&);
+};
+
+#define VELMA_SIM_RT_SCOPE(scope) AllocationAuditScope velma_sim_rt_scope_(scope)
+
+#endif  // ALLOCATION_AUDIT_H__
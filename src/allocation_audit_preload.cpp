@@ -0,0 +1,231 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+// The heap allocation audit, preloaded into the simulator (see allocation_audit.h).
+// malloc and free are forwarded to glibc; in the scopes marked as real-time,
+// the calls are counted and the stack of the first call is sampled.
+
+#include <errno.h>
+#include <execinfo.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+}
+
+namespace {
+
+const int MAX_FRAMES = 32;
+const int MAX_SCOPES = 64;
+
+struct ThreadState {
+    const char *scope;
+    int depth;
+    unsigned allocs;
+    unsigned frees;
+    bool busy;          // set while the audit itself may allocate
+    int frames;
+    void *stack[MAX_FRAMES];
+};
+
+__thread ThreadState state __attribute__((tls_model("initial-exec")));
+
+struct ScopeRecord {
+    std::atomic<const char* > name;
+    std::atomic<uint64_t > invocations;     // with allocations
+    std::atomic<uint64_t > allocs;
+    std::atomic<uint64_t > frees;
+};
+
+ScopeRecord scopes[MAX_SCOPES];
+std::atomic<int > scopes_count(0);
+bool abort_on_allocation = false;
+
+// returns NULL if the table is full
+ScopeRecord* findScope(const char *name, bool &added) {
+    added = false;
+    int count = scopes_count.load(std::memory_order_acquire);
+    while (true) {
+        for (int i = 0; i < count; ++i) {
+            const char *n = scopes[i].name.load(std::memory_order_acquire);
+            while (!n) {
+                // the record is being added by another thread
+                n = scopes[i].name.load(std::memory_order_acquire);
+            }
+            if (n == name || strcmp(n, name) == 0) {
+                return &scopes[i];
+            }
+        }
+        if (count >= MAX_SCOPES) {
+            return NULL;
+        }
+        if (scopes_count.compare_exchange_weak(count, count + 1, std::memory_order_acq_rel)) {
+            scopes[count].name.store(name, std::memory_order_release);
+            added = true;
+            return &scopes[count];
+        }
+    }
+}
+
+inline void onCall(bool alloc) {
+    ThreadState &s = state;
+    if (s.depth == 0 || s.busy) {
+        return;
+    }
+    if (s.allocs == 0 && s.frees == 0) {
+        s.busy = true;
+        s.frames = backtrace(s.stack, MAX_FRAMES);
+        s.busy = false;
+    }
+    if (alloc) {
+        ++s.allocs;
+    }
+    else {
+        ++s.frees;
+    }
+}
+
+__attribute__((constructor))
+void initAudit() {
+    const char *abort_str = getenv("VELMA_SIM_ALLOCATION_AUDIT_ABORT");
+    abort_on_allocation = (abort_str && strcmp(abort_str, "1") == 0);
+
+    // the first call of backtrace loads libgcc, which allocates
+    void *stack[1];
+    state.busy = true;
+    backtrace(stack, 1);
+    state.busy = false;
+}
+
+__attribute__((destructor))
+void reportAudit() {
+    state.busy = true;
+    const int count = scopes_count.load(std::memory_order_acquire);
+    for (int i = 0; i < count; ++i) {
+        fprintf(stderr, "allocation audit: %s: %llu invocations allocated, %llu allocations, %llu frees\n",
+            scopes[i].name.load(), (unsigned long long)scopes[i].invocations.load(),
+            (unsigned long long)scopes[i].allocs.load(), (unsigned long long)scopes[i].frees.load());
+    }
+}
+
+}   // namespace
+
+extern "C" {
+
+void velma_sim_allocation_audit_enter(const char *scope) {
+    ThreadState &s = state;
+    if (s.depth++ == 0) {
+        s.scope = scope;
+        s.allocs = 0;
+        s.frees = 0;
+    }
+}
+
+void velma_sim_allocation_audit_exit() {
+    ThreadState &s = state;
+    if (--s.depth > 0 || (s.allocs == 0 && s.frees == 0)) {
+        return;
+    }
+
+    s.busy = true;
+    bool added;
+    ScopeRecord *r = findScope(s.scope, added);
+    if (r) {
+        r->invocations.fetch_add(1);
+        r->allocs.fetch_add(s.allocs);
+        r->frees.fetch_add(s.frees);
+    }
+    if (added || abort_on_allocation) {
+        fprintf(stderr, "allocation audit: %u allocations and %u frees in the real-time scope %s, the first one in:\n",
+            s.allocs, s.frees, s.scope);
+        backtrace_symbols_fd(s.stack, s.frames, STDERR_FILENO);
+    }
+    s.busy = false;
+
+    if (abort_on_allocation) {
+        abort();
+    }
+}
+
+void *malloc(size_t size) {
+    onCall(true);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    onCall(true);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    onCall(true);
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+    onCall(true);
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    onCall(true);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+    // the alignment must be a power of two multiple of sizeof(void*), as in glibc
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0 || alignment == 0) {
+        return EINVAL;
+    }
+    onCall(true);
+    void *p = __libc_memalign(alignment, size);
+    if (!p) {
+        return ENOMEM;
+    }
+    *ptr = p;
+    return 0;
+}
+
+void free(void *ptr) {
+    if (ptr) {
+        onCall(false);
+    }
+    __libc_free(ptr);
+}
+
+}   // extern "C"
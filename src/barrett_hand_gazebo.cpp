@@ -27,6 +27,10 @@
 
 #include "barrett_hand_gazebo.h"
 #include <rtt/Logger.hpp>
+#include "allocation_audit.h"
+#include "step_monitor.h"
+#include "benchmark_motion.h"
+#include "robot_state_export.h"
 
 using namespace RTT;
 
@@ -66,16 +70,256 @@ double BarrettHandGazebo::getFingerAngle(unsigned int fidx) const {
     return 0;
 }
 
+void BarrettHandGazebo::setJointsPID() {
+    //double torque = 40.0;
+
+/*
+    jc_->SetPositionPID(joints_[0]->GetScopedName(), gazebo::common::PID(torque*2.0, torque*0.5, 0.0, torque*0.2, torque*(-0.2), torque*2.0,torque*(-2.0)));
+    jc_->SetPositionPID(joints_[3]->GetScopedName(), gazebo::common::PID(torque*2.0, torque*0.5, 0.0, torque*0.2, torque*(-0.2), torque*2.0,torque*(-2.0)));
+    jc_->SetPositionPID(joints_[1]->GetScopedName(), gazebo::common::PID(torque*1.1, torque*0.2, 0.0, torque*0.1, torque*(-0.1), torque*1.0,torque*(-1.0)));
+    jc_->SetPositionPID(joints_[4]->GetScopedName(), gazebo::common::PID(torque*1.1, torque*0.2, 0.0, torque*0.1, torque*(-0.1), torque*1.0,torque*(-1.0)));
+    jc_->SetPositionPID(joints_[6]->GetScopedName(), gazebo::common::PID(torque*1.1, torque*0.2, 0.0, torque*0.1, torque*(-0.1), torque*1.0,torque*(-1.0)));
+    jc_->SetPositionPID(joints_[2]->GetScopedName(), gazebo::common::PID(torque*0.5, torque*0.1, 0.0, torque*0.04, torque*(-0.04), torque*0.7,torque*(-0.7)));
+    jc_->SetPositionPID(joints_[5]->GetScopedName(), gazebo::common::PID(torque*0.5, torque*0.1, 0.0, torque*0.04, torque*(-0.04), torque*0.7,torque*(-0.7)));
+    jc_->SetPositionPID(joints_[7]->GetScopedName(), gazebo::common::PID(torque*0.5, torque*0.1, 0.0, torque*0.04, torque*(-0.04), torque*0.7,torque*(-0.7)));
+*/
+
+    // KnuckleOne (spread)
+    jc_->SetPositionPID(joints_[0]->GetScopedName(), gazebo::common::PID(
+        sp_kp_, sp_ki_, sp_kd_, sp_max_i_, sp_min_i_, sp_max_cmd_, sp_min_cmd_));
+    jc_->SetPositionPID(joints_[3]->GetScopedName(), gazebo::common::PID(
+        sp_kp_, sp_ki_, sp_kd_, sp_max_i_, sp_min_i_, sp_max_cmd_, sp_min_cmd_));
+
+    // KnuckleTwo (proximal joint)
+    jc_->SetPositionPID(joints_[1]->GetScopedName(), gazebo::common::PID(
+        k2_kp_, k2_ki_, k2_kd_, k2_max_i_, k2_min_i_, k2_max_cmd_, k2_min_cmd_));
+    jc_->SetPositionPID(joints_[4]->GetScopedName(), gazebo::common::PID(
+        k2_kp_, k2_ki_, k2_kd_, k2_max_i_, k2_min_i_, k2_max_cmd_, k2_min_cmd_));
+    jc_->SetPositionPID(joints_[6]->GetScopedName(), gazebo::common::PID(
+        k2_kp_, k2_ki_, k2_kd_, k2_max_i_, k2_min_i_, k2_max_cmd_, k2_min_cmd_));
+
+    // KnuckleThree (distal joint)
+    jc_->SetPositionPID(joints_[2]->GetScopedName(), gazebo::common::PID(
+        k3_kp_, k3_ki_, k3_kd_, k3_max_i_, k3_min_i_, k3_max_cmd_, k3_min_cmd_));
+    jc_->SetPositionPID(joints_[5]->GetScopedName(), gazebo::common::PID(
+        k3_kp_, k3_ki_, k3_kd_, k3_max_i_, k3_min_i_, k3_max_cmd_, k3_min_cmd_));
+    jc_->SetPositionPID(joints_[7]->GetScopedName(), gazebo::common::PID(
+        k3_kp_, k3_ki_, k3_kd_, k3_max_i_, k3_min_i_, k3_max_cmd_, k3_min_cmd_));
+}
+
+void BarrettHandGazebo::setJointTarget(int jnt, double q) {
+    joint_ref_[jnt] = q;
+    if (!jc_->SetPositionTarget(joint_scoped_names_[jnt], q)) {
+        Logger::log() << Logger::Warning <<  "jc_->SetPositionTarget(" << joint_scoped_names_[jnt] << ")" << Logger::endl;
+    }
+}
+
+void BarrettHandGazebo::initFastMode() {
+    // the palm and all finger links
+    hand_links_.clear();
+    hand_links_.push_back(joints_[0]->GetParent().get());
+    for (int i = 0; i < 8; i++) {
+        hand_links_.push_back(joints_[i]->GetChild().get());
+    }
+
+    // contacts are generated only for the collisions that are filtered or subscribed
+    std::vector<std::string > collision_names;
+    for (int i = 0; i < hand_links_.size(); ++i) {
+        const gazebo::physics::Collision_V &collisions = hand_links_[i]->GetCollisions();
+        for (int j = 0; j < collisions.size(); ++j) {
+            collision_names.push_back(collisions[j]->GetScopedName());
+        }
+    }
+    model_->GetWorld()->Physics()->GetContactManager()->CreateFilter(getName() + "_fast_mode", collision_names);
+
+    kinematic_mode_ = false;
+    fast_mode_clear_steps_ = 0;
+    fast_mode_check_counter_ = 0;
+    hand_near_object_ = true;
+}
+
+bool BarrettHandGazebo::isHandLink(const gazebo::physics::Link *link) const {
+    for (int i = 0; i < hand_links_.size(); ++i) {
+        if (hand_links_[i] == link) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool BarrettHandGazebo::isHandInContact() const {
+    gazebo::physics::ContactManager *cm = model_->GetWorld()->Physics()->GetContactManager();
+    const std::vector<gazebo::physics::Contact* > &contacts = cm->GetContacts();
+    const unsigned int count = cm->GetContactCount();
+    for (unsigned int i = 0; i < count; ++i) {
+        if (isHandLink(contacts[i]->collision1->GetLink().get()) || isHandLink(contacts[i]->collision2->GetLink().get())) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool BarrettHandGazebo::isHandNearObject() {
+    gazebo::physics::WorldPtr world = model_->GetWorld();
+    if (world->ModelCount() != world_models_.size()) {
+        world_models_ = world->Models();
+    }
+
+    ignition::math::Box hand_box = hand_links_[0]->BoundingBox();
+    for (int i = 1; i < hand_links_.size(); ++i) {
+        hand_box += hand_links_[i]->BoundingBox();
+    }
+    const ignition::math::Vector3d margin(fast_mode_margin_, fast_mode_margin_, fast_mode_margin_);
+    hand_box = ignition::math::Box(hand_box.Min() - margin, hand_box.Max() + margin);
+
+    // other links of the robot are not checked
+    for (int i = 0; i < world_models_.size(); ++i) {
+        if (world_models_[i] != model_ && world_models_[i]->BoundingBox().Intersects(hand_box)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void BarrettHandGazebo::updateFastMode(double dt) {
+    // proximity is checked with lower rate, the margin should cover the motion between the checks
+    if (fast_mode_check_counter_ <= 0) {
+        hand_near_object_ = isHandNearObject();
+        fast_mode_check_counter_ = fast_mode_check_period_;
+    }
+    --fast_mode_check_counter_;
+
+    const bool dynamic_required = hand_near_object_ || isHandInContact();
+
+    if (kinematic_mode_ && dynamic_required) {
+        // the PID loops start from zero state, with the targets on the kinematic reference
+        kinematic_mode_ = false;
+        fast_mode_clear_steps_ = 0;
+        setJointsPID();
+        for (int i = 0; i < 8; i++) {
+            jc_->SetPositionTarget(joint_scoped_names_[i], joint_ref_[i]);
+        }
+        Logger::log() << Logger::Info << "dynamic mode" << Logger::endl;
+    }
+    else if (!kinematic_mode_ && !dynamic_required) {
+        ++fast_mode_clear_steps_;
+        if (fast_mode_clear_steps_ >= fast_mode_hysteresis_steps_) {
+            // the tracking error of the PID loops is blended out
+            kinematic_mode_ = true;
+            for (int i = 0; i < 8; i++) {
+                blend_offset_[i] = joints_[i]->Position() - joint_ref_[i];
+            }
+            blend_counter_ = fast_mode_blend_steps_;
+            Logger::log() << Logger::Info << "kinematic mode" << Logger::endl;
+        }
+    }
+    else if (!kinematic_mode_) {
+        fast_mode_clear_steps_ = 0;
+    }
+
+    if (kinematic_mode_) {
+        const double blend = (fast_mode_blend_steps_ > 0) ? (double(blend_counter_) / fast_mode_blend_steps_) : 0.0;
+        for (int i = 0; i < 8; i++) {
+            joints_[i]->SetPosition(0, joint_ref_[i] + blend * blend_offset_[i]);
+            joints_[i]->SetVelocity(0, (dt > 0.0) ? ((joint_ref_[i] - prev_joint_ref_[i]) / dt) : 0.0);
+        }
+        if (blend_counter_ > 0) {
+            --blend_counter_;
+        }
+    }
+}
+
+void BarrettHandGazebo::sampleJoints() {
+    const double force_factor = 1000.0;
+    // joint position
+    for (int i = 0; i < 8; i++) {
+        q_out_(i) = joints_[i]->Position();
+    }
+
+    t_out_[0] = t_out_[3] = joints_[0]->GetForce(0)*force_factor;
+    t_out_[1] = t_out_[2] = joints_[1]->GetForce(0)*force_factor;
+    t_out_[4] = t_out_[5] = joints_[4]->GetForce(0)*force_factor;
+    t_out_[6] = t_out_[7] = joints_[6]->GetForce(0)*force_factor;
+
+    q_out_updated_ = true;
+
+    // the state of the whole robot, written to the shared memory at the end of the step;
+    // in the idle state it is refreshed with the reduced rate, as the other outputs
+    if (state_side_ >= 0) {
+        velma_sim_gazebo::RobotStateShmData *state = RobotStateExport::getInstance().getState();
+        velma_sim_gazebo::RobotStateShmHand &hand = state->hand[state_side_];
+        for (int i = 0; i < 8; i++) {
+            hand.q[i] = q_out_(i);
+            hand.dq[i] = joints_[i]->GetVelocity(0);
+            hand.t[i] = joints_[i]->GetForce(0);
+        }
+        state->updated |= (state_side_ == velma_sim_gazebo::ROBOT_STATE_SHM_RIGHT)
+            ? velma_sim_gazebo::ROBOT_STATE_SHM_RIGHT_HAND : velma_sim_gazebo::ROBOT_STATE_SHM_LEFT_HAND;
+    }
+}
+
+void BarrettHandGazebo::receivePuckMoves(double sim_time) {
+    can_sim_time_.store(sim_time);
+    for (const PuckMove *move = move_ring_.front(); move != NULL && move->due_time <= sim_time; move = move_ring_.front()) {
+        puck_q_[move->puck] = move->q;
+        puck_v_[move->puck] = move->v;
+        puck_move_[move->puck] = true;
+        ++puck_moves_applied_[move->puck];
+        received_move_seq_ = move->seq;
+        LatencyTrace::getInstance().record(trace_channel_, move->seq, LatencyTrace::STAGE_EXCHANGE);
+        move_ring_.pop();
+    }
+}
+
+void BarrettHandGazebo::sendPuckState() {
+    // the state is sent when the joints were sampled; if the ring is full,
+    // it is sent in one of the next steps
+    if (!q_out_updated_ || state_ring_.full()) {
+        return;
+    }
+    PuckState state;
+    for (int i = 0; i < 8; i++) {
+        state.q[i] = q_out_(i);
+    }
+    for (int i = 0; i < 4; ++i) {
+        state.idle[i] = puck_idle_[i];
+        state.moves_applied[i] = puck_moves_applied_[i];
+    }
+    state_ring_.push(state);
+    q_out_updated_ = false;
+}
+
+void BarrettHandGazebo::applyJointControl(gazebo::physics::ModelPtr model) {
+    const double sim_time = model->GetWorld()->SimTime().Double();
+    const double dt = sim_time - last_sim_time_;
+    last_sim_time_ = sim_time;
+
+    if (fast_mode_) {
+        updateFastMode(dt);
+    }
+    if (!kinematic_mode_) {
+        jc_->Update();
+    }
+    for (int i = 0; i < 8; i++) {
+        prev_joint_ref_[i] = joint_ref_[i];
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Update the controller
 void BarrettHandGazebo::gazeboUpdateHook(gazebo::physics::ModelPtr model)
 {
+    VELMA_SIM_RT_SCOPE("BarrettHandGazebo::gazeboUpdateHook");
+    VELMA_SIM_HOOK_TIMER();
     if (disable_component_) {
-        data_valid_ = true;
+        RTT::os::MutexTryLock trylock(gazebo_mutex_);
+        if (trylock.isSuccessful()) {
+            data_valid_ = true;
+        }
         return;
     }
 
-    Logger::In in(std::string("BarrettHandGazebo::gazeboUpdateHook ") + getName());
+    Logger::In in(update_log_module_);
 
     if (joints_.size() == 0) {
         return;
@@ -92,44 +336,17 @@ void BarrettHandGazebo::gazeboUpdateHook(gazebo::physics::ModelPtr model)
             jc_->AddJoint(joints_[i]);
         }
 
-        //double torque = 40.0;
-
-/*
-        jc_->SetPositionPID(joints_[0]->GetScopedName(), gazebo::common::PID(torque*2.0, torque*0.5, 0.0, torque*0.2, torque*(-0.2), torque*2.0,torque*(-2.0)));
-        jc_->SetPositionPID(joints_[3]->GetScopedName(), gazebo::common::PID(torque*2.0, torque*0.5, 0.0, torque*0.2, torque*(-0.2), torque*2.0,torque*(-2.0)));
-        jc_->SetPositionPID(joints_[1]->GetScopedName(), gazebo::common::PID(torque*1.1, torque*0.2, 0.0, torque*0.1, torque*(-0.1), torque*1.0,torque*(-1.0)));
-        jc_->SetPositionPID(joints_[4]->GetScopedName(), gazebo::common::PID(torque*1.1, torque*0.2, 0.0, torque*0.1, torque*(-0.1), torque*1.0,torque*(-1.0)));
-        jc_->SetPositionPID(joints_[6]->GetScopedName(), gazebo::common::PID(torque*1.1, torque*0.2, 0.0, torque*0.1, torque*(-0.1), torque*1.0,torque*(-1.0)));
-        jc_->SetPositionPID(joints_[2]->GetScopedName(), gazebo::common::PID(torque*0.5, torque*0.1, 0.0, torque*0.04, torque*(-0.04), torque*0.7,torque*(-0.7)));
-        jc_->SetPositionPID(joints_[5]->GetScopedName(), gazebo::common::PID(torque*0.5, torque*0.1, 0.0, torque*0.04, torque*(-0.04), torque*0.7,torque*(-0.7)));
-        jc_->SetPositionPID(joints_[7]->GetScopedName(), gazebo::common::PID(torque*0.5, torque*0.1, 0.0, torque*0.04, torque*(-0.04), torque*0.7,torque*(-0.7)));
-*/
-
-        // KnuckleOne (spread)
-        jc_->SetPositionPID(joints_[0]->GetScopedName(), gazebo::common::PID(
-            sp_kp_, sp_ki_, sp_kd_, sp_max_i_, sp_min_i_, sp_max_cmd_, sp_min_cmd_));
-        jc_->SetPositionPID(joints_[3]->GetScopedName(), gazebo::common::PID(
-            sp_kp_, sp_ki_, sp_kd_, sp_max_i_, sp_min_i_, sp_max_cmd_, sp_min_cmd_));
-
-        // KnuckleTwo (proximal joint)
-        jc_->SetPositionPID(joints_[1]->GetScopedName(), gazebo::common::PID(
-            k2_kp_, k2_ki_, k2_kd_, k2_max_i_, k2_min_i_, k2_max_cmd_, k2_min_cmd_));
-        jc_->SetPositionPID(joints_[4]->GetScopedName(), gazebo::common::PID(
-            k2_kp_, k2_ki_, k2_kd_, k2_max_i_, k2_min_i_, k2_max_cmd_, k2_min_cmd_));
-        jc_->SetPositionPID(joints_[6]->GetScopedName(), gazebo::common::PID(
-            k2_kp_, k2_ki_, k2_kd_, k2_max_i_, k2_min_i_, k2_max_cmd_, k2_min_cmd_));
-
-        // KnuckleThree (distal joint)
-        jc_->SetPositionPID(joints_[2]->GetScopedName(), gazebo::common::PID(
-            k3_kp_, k3_ki_, k3_kd_, k3_max_i_, k3_min_i_, k3_max_cmd_, k3_min_cmd_));
-        jc_->SetPositionPID(joints_[5]->GetScopedName(), gazebo::common::PID(
-            k3_kp_, k3_ki_, k3_kd_, k3_max_i_, k3_min_i_, k3_max_cmd_, k3_min_cmd_));
-        jc_->SetPositionPID(joints_[7]->GetScopedName(), gazebo::common::PID(
-            k3_kp_, k3_ki_, k3_kd_, k3_max_i_, k3_min_i_, k3_max_cmd_, k3_min_cmd_));
+        setJointsPID();
 
         for (int i = 0; i < 8; i++) {
-            jc_->SetPositionTarget(joints_[i]->GetScopedName(), joints_[i]->Position());
+            setJointTarget(i, joints_[i]->Position());
+            prev_joint_ref_[i] = joint_ref_[i];
         }
+
+        if (fast_mode_) {
+            initFastMode();
+        }
+        last_sim_time_ = model->GetWorld()->SimTime().Double();
     }
 
     // calculate sim period
@@ -141,16 +358,67 @@ void BarrettHandGazebo::gazeboUpdateHook(gazebo::physics::ModelPtr model)
     // BarrettHand
     //
 
-    const double force_factor = 1000.0;
-    // joint position
-    for (int i = 0; i < 8; i++) {
-        q_out_(i) = joints_[i]->Position();
+    // the move commands that reached the pucks on the CAN bus until now
+    const double sim_time = model->GetWorld()->SimTime().Double();
+    receivePuckMoves(sim_time);
+
+    // the scripted moves of the benchmark, as if received from the CAN bus
+    if (benchmark_component_ >= 0) {
+        double q[4];
+        double v;
+        if (BenchmarkMotion::getInstance().getMove(benchmark_component_, sim_time, q, v)) {
+            for (int i = 0; i < 4; ++i) {
+                puck_q_[i] = q[i];
+                puck_v_[i] = v;
+                puck_move_[i] = true;
+            }
+        }
     }
 
-    t_out_[0] = t_out_[3] = joints_[0]->GetForce(0)*force_factor;
-    t_out_[1] = t_out_[2] = joints_[1]->GetForce(0)*force_factor;
-    t_out_[4] = t_out_[5] = joints_[4]->GetForce(0)*force_factor;
-    t_out_[6] = t_out_[7] = joints_[6]->GetForce(0)*force_factor;
+    // idle state: all DOFs are idle and no move is requested, so only the
+    // targets are held and the sensors are sampled with the reduced rate
+    bool move_requested = false;
+    bool all_idle = true;
+    for (int i = 0; i < 4; ++i) {
+        move_requested = move_requested || puck_move_[i];
+        all_idle = all_idle && puck_idle_[i];
+    }
+    if (idle_mode_ && all_idle && !move_requested) {
+        if (!hand_idle_ && ++idle_steps_ >= idle_enter_steps_) {
+            hand_idle_ = true;
+            idle_sample_counter_ = 0;
+            idle_t_ = t_out_;
+            Logger::log() << Logger::Debug << "entering idle state" << Logger::endl;
+        }
+    }
+    else {
+        if (hand_idle_) {
+            Logger::log() << Logger::Debug << "leaving idle state" << Logger::endl;
+        }
+        hand_idle_ = false;
+        idle_steps_ = 0;
+    }
+
+    if (hand_idle_) {
+        if (--idle_sample_counter_ <= 0) {
+            idle_sample_counter_ = idle_sample_period_;
+            sampleJoints();
+            // external force acting on the fingers changes the effort of the position loops
+            if ((t_out_ - idle_t_).cwiseAbs().maxCoeff() > idle_wake_force_) {
+                hand_idle_ = false;
+                idle_steps_ = 0;
+                Logger::log() << Logger::Debug << "leaving idle state: external force" << Logger::endl;
+            }
+        }
+        if (hand_idle_) {
+            applyJointControl(model);
+            sendPuckState();
+            data_valid_ = true;
+            return;
+        }
+    }
+
+    sampleJoints();
 
     int f1k1_dof_idx = 3;
     int f1k1_jnt_idx = 0;
@@ -159,28 +427,27 @@ void BarrettHandGazebo::gazeboUpdateHook(gazebo::physics::ModelPtr model)
     double mean_spread = getFingerAngle(3);
 
     for (int i = 0; i < 4; ++i) {
-        if (hw_can_.move_hand_[i]) {
-            hw_can_.move_hand_[i] = false;
+        if (puck_move_[i]) {
+            puck_move_[i] = false;
             finger_int_[i] = getFingerAngle(i);
-            hw_can_.status_idle_[i] = false;
+            puck_idle_[i] = false;
             status_overcurrent_[i] = false;
             Logger::log() << Logger::Info <<  "move hand " << i << Logger::endl;
         }
     }
-
-    if (!hw_can_.status_idle_[3]) {
+    if (!puck_idle_[3]) {
         // spread joints
-        if (finger_int_[3] > hw_can_.q_in_[f1k1_dof_idx]) {
-            finger_int_[3] -= hw_can_.v_in_[f1k1_dof_idx] * vel_mult;
-            if (finger_int_[3] <= hw_can_.q_in_[f1k1_dof_idx]) {
-                hw_can_.status_idle_[3] = true;
+        if (finger_int_[3] > puck_q_[f1k1_dof_idx]) {
+            finger_int_[3] -= puck_v_[f1k1_dof_idx] * vel_mult;
+            if (finger_int_[3] <= puck_q_[f1k1_dof_idx]) {
+                puck_idle_[3] = true;
                 Logger::log() << Logger::Info <<  "spread idle" << Logger::endl;
             }
         }
-        else if (finger_int_[3] < hw_can_.q_in_[f1k1_dof_idx]) {
-            finger_int_[3] += hw_can_.v_in_[f1k1_dof_idx] * vel_mult;
-            if (finger_int_[3] >= hw_can_.q_in_[f1k1_dof_idx]) {
-                hw_can_.status_idle_[3] = true;
+        else if (finger_int_[3] < puck_q_[f1k1_dof_idx]) {
+            finger_int_[3] += puck_v_[f1k1_dof_idx] * vel_mult;
+            if (finger_int_[3] >= puck_q_[f1k1_dof_idx]) {
+                puck_idle_[3] = true;
                 Logger::log() << Logger::Info <<  "spread idle" << Logger::endl;
             }
         }
@@ -189,12 +456,8 @@ void BarrettHandGazebo::gazeboUpdateHook(gazebo::physics::ModelPtr model)
         double f2k1_force = joints_[f2k1_jnt_idx]->GetForce(0);
         double spread_force = f1k1_force + f2k1_force;
 
-        if (!jc_->SetPositionTarget(joint_scoped_names_[f1k1_jnt_idx], finger_int_[3])) {
-            Logger::log() << Logger::Warning <<  "jc_->SetPositionTarget(" << joint_scoped_names_[f1k1_jnt_idx] << ")" << Logger::endl;
-        }
-        if (!jc_->SetPositionTarget(joint_scoped_names_[f2k1_jnt_idx], finger_int_[3])) {
-            Logger::log() << Logger::Warning <<  "jc_->SetPositionTarget(" << joint_scoped_names_[f2k1_jnt_idx] << ")" << Logger::endl;
-        }
+        setJointTarget(f1k1_jnt_idx, finger_int_[3]);
+        setJointTarget(f2k1_jnt_idx, finger_int_[3]);
     }
 
     // finger joints
@@ -206,31 +469,27 @@ void BarrettHandGazebo::gazeboUpdateHook(gazebo::physics::ModelPtr model)
         int k2_jnt = k2_jnt_tab[fidx];
         int k3_jnt = k3_jnt_tab[fidx];
         bool is_opening = false;
-//        double k2_force = joints_[k2_jnt]->GetForce(0);
-//        double k3_force = joints_[k3_jnt]->GetForce(0);
-        gazebo::physics::JointWrench k2_wrench = joints_[k2_jnt]->GetForceTorque(0);
-        gazebo::physics::JointWrench k3_wrench = joints_[k3_jnt]->GetForceTorque(0);
 
-        if (!hw_can_.status_idle_[fidx]) {
-            if (finger_int_[fidx] > hw_can_.q_in_[k2_dof]) {
-                finger_int_[fidx] -= hw_can_.v_in_[k2_dof] * vel_mult;
+        if (!puck_idle_[fidx]) {
+            if (finger_int_[fidx] > puck_q_[k2_dof]) {
+                finger_int_[fidx] -= puck_v_[k2_dof] * vel_mult;
                 is_opening = true;
                 //if (getName() == "RightHand") {
                 //    Logger::log() << Logger::Info << "op: " << finger_int_[fidx] << "  " << q_in_[k2_dof] << ", v: " << v_in_[k2_dof] << Logger::endl;
                 //}
-                if (finger_int_[fidx] <= hw_can_.q_in_[k2_dof]) {
-                    hw_can_.status_idle_[fidx] = true;
+                if (finger_int_[fidx] <= puck_q_[k2_dof]) {
+                    puck_idle_[fidx] = true;
                     Logger::log() << Logger::Info << "finger " << fidx << " idle -- opening" << Logger::endl;
                 }
             }
             else {
-                finger_int_[fidx] += hw_can_.v_in_[k2_dof] * vel_mult;
+                finger_int_[fidx] += puck_v_[k2_dof] * vel_mult;
                 is_opening = false;
                 //if (getName() == "RightHand") {
                 //    Logger::log() << Logger::Info << "cl: " << finger_int_[fidx] << "  " << q_in_[k2_dof] << ", v: " << v_in_[k2_dof] << Logger::endl;
                 //}
-                if (finger_int_[fidx] >= hw_can_.q_in_[k2_dof]) {
-                    hw_can_.status_idle_[fidx] = true;
+                if (finger_int_[fidx] >= puck_q_[k2_dof]) {
+                    puck_idle_[fidx] = true;
                     Logger::log() << Logger::Info << "finger " << fidx << " idle -- closing" << Logger::endl;
                 }
             }
@@ -243,35 +502,35 @@ void BarrettHandGazebo::gazeboUpdateHook(gazebo::physics::ModelPtr model)
             k2_angle_dest = finger_int_[fidx];
             k3_angle_dest = finger_int_[fidx]/3;
 
-            jc_->SetPositionTarget(joint_scoped_names_[k2_jnt], k2_angle_dest);
-            jc_->SetPositionTarget(joint_scoped_names_[k3_jnt], k3_angle_dest);
+            setJointTarget(k2_jnt, k2_angle_dest);
+            setJointTarget(k3_jnt, k3_angle_dest);
         }
     }
 
 /*
     for (int i = 0; i < 4; ++i) {
-        if (hw_can_.move_hand_[i]) {
-            hw_can_.move_hand_[i] = false;
+        if (puck_move_[i]) {
+            puck_move_[i] = false;
             finger_int_[i] = getFingerAngle(i);
-            hw_can_.status_idle_[i] = false;
+            puck_idle_[i] = false;
             status_overcurrent_[i] = false;
             Logger::log() << Logger::Info <<  "move hand " << i << Logger::endl;
         }
     }
 
-    if (!status_overcurrent_[3] && !hw_can_.status_idle_[3]) {
+    if (!status_overcurrent_[3] && !puck_idle_[3]) {
         // spread joints
-        if (finger_int_[3] > hw_can_.q_in_[f1k1_dof_idx]) {
-            finger_int_[3] -= hw_can_.v_in_[f1k1_dof_idx] * vel_mult;
-            if (finger_int_[3] <= hw_can_.q_in_[f1k1_dof_idx]) {
-                hw_can_.status_idle_[3] = true;
+        if (finger_int_[3] > puck_q_[f1k1_dof_idx]) {
+            finger_int_[3] -= puck_v_[f1k1_dof_idx] * vel_mult;
+            if (finger_int_[3] <= puck_q_[f1k1_dof_idx]) {
+                puck_idle_[3] = true;
                 Logger::log() << Logger::Info <<  "spread idle" << Logger::endl;
             }
         }
-        else if (finger_int_[3] < hw_can_.q_in_[f1k1_dof_idx]) {
-            finger_int_[3] += hw_can_.v_in_[f1k1_dof_idx] * vel_mult;
-            if (finger_int_[3] >= hw_can_.q_in_[f1k1_dof_idx]) {
-                hw_can_.status_idle_[3] = true;
+        else if (finger_int_[3] < puck_q_[f1k1_dof_idx]) {
+            finger_int_[3] += puck_v_[f1k1_dof_idx] * vel_mult;
+            if (finger_int_[3] >= puck_q_[f1k1_dof_idx]) {
+                puck_idle_[3] = true;
                 Logger::log() << Logger::Info <<  "spread idle" << Logger::endl;
             }
         }
@@ -282,7 +541,7 @@ void BarrettHandGazebo::gazeboUpdateHook(gazebo::physics::ModelPtr model)
 
         if (std::fabs(spread_force) > 0.5) {
             status_overcurrent_[3] = true;
-            hw_can_.status_idle_[3] = true;
+            puck_idle_[3] = true;
             Logger::log() << Logger::Info <<  "spread overcurrent" << Logger::endl;
             jc_->SetPositionTarget(joint_scoped_names_[f1k1_jnt_idx], mean_spread);
             jc_->SetPositionTarget(joint_scoped_names_[f2k1_jnt_idx], mean_spread);
@@ -311,26 +570,26 @@ void BarrettHandGazebo::gazeboUpdateHook(gazebo::physics::ModelPtr model)
         gazebo::physics::JointWrench k2_wrench = joints_[k2_jnt]->GetForceTorque(0);
         gazebo::physics::JointWrench k3_wrench = joints_[k3_jnt]->GetForceTorque(0);
 
-        if (!status_overcurrent_[fidx] && !hw_can_.status_idle_[fidx]) {
-            if (finger_int_[fidx] > hw_can_.q_in_[k2_dof]) {
-                finger_int_[fidx] -= hw_can_.v_in_[k2_dof] * vel_mult;
+        if (!status_overcurrent_[fidx] && !puck_idle_[fidx]) {
+            if (finger_int_[fidx] > puck_q_[k2_dof]) {
+                finger_int_[fidx] -= puck_v_[k2_dof] * vel_mult;
                 is_opening = true;
                 //if (getName() == "RightHand") {
                 //    Logger::log() << Logger::Info << "op: " << finger_int_[fidx] << "  " << q_in_[k2_dof] << ", v: " << v_in_[k2_dof] << Logger::endl;
                 //}
-                if (finger_int_[fidx] <= hw_can_.q_in_[k2_dof]) {
-                    hw_can_.status_idle_[fidx] = true;
+                if (finger_int_[fidx] <= puck_q_[k2_dof]) {
+                    puck_idle_[fidx] = true;
                     Logger::log() << Logger::Info << "finger " << fidx << " idle -- opening" << Logger::endl;
                 }
             }
             else {
-                finger_int_[fidx] += hw_can_.v_in_[k2_dof] * vel_mult;
+                finger_int_[fidx] += puck_v_[k2_dof] * vel_mult;
                 is_opening = false;
                 //if (getName() == "RightHand") {
                 //    Logger::log() << Logger::Info << "cl: " << finger_int_[fidx] << "  " << q_in_[k2_dof] << ", v: " << v_in_[k2_dof] << Logger::endl;
                 //}
-                if (finger_int_[fidx] >= hw_can_.q_in_[k2_dof]) {
-                    hw_can_.status_idle_[fidx] = true;
+                if (finger_int_[fidx] >= puck_q_[k2_dof]) {
+                    puck_idle_[fidx] = true;
                     Logger::log() << Logger::Info << "finger " << fidx << " idle -- closing" << Logger::endl;
                 }
             }
@@ -351,7 +610,7 @@ void BarrettHandGazebo::gazeboUpdateHook(gazebo::physics::ModelPtr model)
             if ((!is_opening && (k2_wrench.body1Force.Length() + k3_wrench.body1Force.Length() > 4.0 || k2_wrench.body1Torque.Length() + k2_wrench.body1Torque.Length() > 2.0)) ||
                 (is_opening  && (k2_wrench.body1Force.Length() + k3_wrench.body1Force.Length() > 8.0 || k2_wrench.body1Torque.Length() + k2_wrench.body1Torque.Length() > 4.0))) {
                 status_overcurrent_[fidx] = true;
-                hw_can_.status_idle_[fidx] = true;
+                puck_idle_[fidx] = true;
                 Logger::log() << Logger::Info << "finger " << fidx << " overcurrent" << Logger::endl;
                 k2_angle_dest = k2_angle;
                 k3_angle_dest = k3_angle;
@@ -396,8 +655,15 @@ void BarrettHandGazebo::gazeboUpdateHook(gazebo::physics::ModelPtr model)
         }
     }
 */
-    jc_->Update();
+    applyJointControl(model);
+
+    // the new targets are applied by the joint controller
+    if (received_move_seq_ != traced_move_seq_) {
+        traced_move_seq_ = received_move_seq_;
+        LatencyTrace::getInstance().record(trace_channel_, received_move_seq_, LatencyTrace::STAGE_APPLY);
+    }
 
+    sendPuckState();
     data_valid_ = true;
 }
 
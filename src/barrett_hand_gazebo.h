@@ -30,6 +30,8 @@
 
 #include <std_msgs/Empty.h>
 
+#include <atomic>
+
 #include <gazebo/gazebo.hh>
 #include <gazebo/physics/physics.hh>
 #include <gazebo/common/common.hh>
@@ -43,6 +45,10 @@
 
 #include <barrett_hand_hw_sim/barrett_hand_hw_can.h>
 
+#include "latency_trace.h"
+#include "spsc_ring.h"
+#include "can_bus_timing.h"
+
 class BarrettHandGazebo : public RTT::TaskContext
 {
 protected:
@@ -64,12 +70,33 @@ public:
     ~BarrettHandGazebo();
     void updateHook();
     bool startHook();
+    void stopHook();
     bool configureHook();
+    void cleanupHook();
     bool gazeboConfigureHook(gazebo::physics::ModelPtr model);
     void gazeboUpdateHook(gazebo::physics::ModelPtr model);
 
   protected:
 
+    // a move command of one puck, which reaches the puck at due_time
+    struct PuckMove {
+        double due_time;
+        int puck;
+        double q;
+        double v;
+        uint32_t seq;
+    };
+
+    // the state of the pucks, sampled in the physics step
+    struct PuckState {
+        double q[8];
+        bool idle[4];
+        uint32_t moves_applied[4];
+    };
+
+    // a move command of a puck sets the target, the velocity and the mode
+    enum {CAN_FRAMES_PER_MOVE = 3};
+
     enum {STATUS_OVERCURRENT1 = 0x0001, STATUS_OVERCURRENT2 = 0x0002, STATUS_OVERCURRENT3 = 0x0004, STATUS_OVERCURRENT4 = 0x0008,
         STATUS_OVERPRESSURE1 = 0x0010, STATUS_OVERPRESSURE2 = 0x0020, STATUS_OVERPRESSURE3 = 0x0040,
         STATUS_TORQUESWITCH1 = 0x0100, STATUS_TORQUESWITCH2 = 0x0200, STATUS_TORQUESWITCH3 = 0x0400,
@@ -78,6 +105,21 @@ public:
     double clip(double n, double lower, double upper) const;
     double getFingerAngle(unsigned int fidx) const;
 
+    void setJointsPID();
+    void setJointTarget(int jnt, double q);
+
+    void initFastMode();
+    bool isHandLink(const gazebo::physics::Link *link) const;
+    bool isHandInContact() const;
+    bool isHandNearObject();
+    void updateFastMode(double dt);
+
+    void sampleJoints();
+    void receivePuckMoves(double sim_time);
+    void sendPuckState();
+    void serveCan();
+    void applyJointControl(gazebo::physics::ModelPtr model);
+
     // parameters
     std::string prefix_;
     int can_id_base_;
@@ -102,6 +144,17 @@ public:
     double k3_max_i_;
     double k3_min_cmd_;
     double k3_max_cmd_;
+    bool fast_mode_;
+    double fast_mode_margin_;
+    int fast_mode_check_period_;
+    int fast_mode_hysteresis_steps_;
+    int fast_mode_blend_steps_;
+    bool idle_mode_;
+    int idle_enter_steps_;
+    int idle_sample_period_;
+    double idle_wake_force_;
+    double can_bit_rate_;
+    double puck_latency_;
 
     gazebo::physics::ModelPtr model_;
     bool data_valid_;
@@ -120,6 +173,61 @@ public:
 
     gazebo::physics::JointController *jc_;
 
+    // position targets of the joints in the current and in the previous step
+    double joint_ref_[8];
+    double prev_joint_ref_[8];
+
+    // kinematic fast mode: without contact and without objects near the hand,
+    // the fingers follow the targets kinematically instead of the PID loops
+    bool kinematic_mode_;
+    std::vector<gazebo::physics::Link* > hand_links_;
+    gazebo::physics::Model_V world_models_;
+    bool hand_near_object_;
+    int fast_mode_check_counter_;
+    int fast_mode_clear_steps_;
+    double blend_offset_[8];
+    int blend_counter_;
+
+    double last_sim_time_;
+
+    // idle state
+    bool hand_idle_;
+    int idle_steps_;
+    int idle_sample_counter_;
+    Joints idle_t_;
+    bool q_out_updated_;
+
+    // the CAN bus: the frames are read from and written to the ports in
+    // updateHook; the move commands are passed to the physics thread in
+    // move_ring_, and are processed when they reach the pucks on the bus
+    // (CanBusTiming); the state of the pucks is passed back in state_ring_
+    SpscRing<PuckMove, 64 > move_ring_;
+    SpscRing<PuckState, 16 > state_ring_;
+    CanBusTiming can_bus_;
+    std::atomic<double > can_sim_time_;         // the sim time of the last physics step
+
+    // the move commands, owned by the physics thread
+    double puck_q_[4];
+    double puck_v_[4];
+    bool puck_move_[4];
+    bool puck_idle_[4];
+    uint32_t puck_moves_applied_[4];
+
+    // the move commands sent to each puck, owned by the Orocos thread
+    uint32_t puck_moves_sent_[4];
+
+    // the number of the last move command, for the latency trace
+    uint32_t move_seq_;             // read from the bus, in the Orocos thread
+    uint32_t received_move_seq_;    // received by the pucks, in the physics thread
+    uint32_t traced_move_seq_;
+    int trace_channel_;
+
+    // the moves of the hand in the benchmark motion, -1 if not scripted
+    int benchmark_component_;
+
+    // the side of the hand in the exported state of the robot, -1 if not exported
+    int state_side_;
+
     //! Synchronization
     RTT::os::MutexRecursive gazebo_mutex_;
 
@@ -127,6 +235,9 @@ public:
 
     BarrettHandHwCAN hw_can_;
 
+    // the module name of the log in gazeboUpdateHook, built once
+    const std::string update_log_module_;
+
     ros::Time last_update_time_;
 
     bool first_step_;
@@ -59,6 +59,35 @@
         , k3_max_i_(2.5)
         , k3_min_cmd_(-20)
         , k3_max_cmd_(20)
+        , fast_mode_(false)
+        , fast_mode_margin_(0.05)
+        , fast_mode_check_period_(10)
+        , fast_mode_hysteresis_steps_(100)
+        , fast_mode_blend_steps_(50)
+        , kinematic_mode_(false)
+        , hand_near_object_(true)
+        , fast_mode_check_counter_(0)
+        , fast_mode_clear_steps_(0)
+        , blend_counter_(0)
+        , last_sim_time_(0.0)
+        , idle_mode_(true)
+        , idle_enter_steps_(10)
+        , idle_sample_period_(10)
+        , idle_wake_force_(100.0)
+        , hand_idle_(false)
+        , idle_steps_(0)
+        , idle_sample_counter_(0)
+        , q_out_updated_(false)
+        , can_bit_rate_(1000000.0)
+        , puck_latency_(0.0005)
+        , can_sim_time_(0.0)
+        , move_seq_(0)
+        , received_move_seq_(0)
+        , traced_move_seq_(0)
+        , trace_channel_(-1)
+        , benchmark_component_(-1)
+        , state_side_(-1)
+        , update_log_module_(std::string("BarrettHandGazebo::gazeboUpdateHook ") + name)
     {
         addProperty("prefix", prefix_);
         addProperty("disable_component", disable_component_);
@@ -85,11 +114,26 @@
         addProperty("k3_max_i", k3_max_i_);
         addProperty("k3_min_cmd", k3_min_cmd_);
         addProperty("k3_max_cmd", k3_max_cmd_);
+        addProperty("fast_mode", fast_mode_);
+        addProperty("fast_mode_margin", fast_mode_margin_);
+        addProperty("fast_mode_check_period", fast_mode_check_period_);
+        addProperty("fast_mode_hysteresis_steps", fast_mode_hysteresis_steps_);
+        addProperty("fast_mode_blend_steps", fast_mode_blend_steps_);
+        addProperty("idle_mode", idle_mode_);
+        addProperty("idle_enter_steps", idle_enter_steps_);
+        addProperty("idle_sample_period", idle_sample_period_);
+        addProperty("idle_wake_force", idle_wake_force_);
+        addProperty("can_bit_rate", can_bit_rate_);
+        addProperty("puck_latency", puck_latency_);
 
         // Add required gazebo interfaces
         this->provides("gazebo")->addOperation("configure",&BarrettHandGazebo::gazeboConfigureHook,this,RTT::ClientThread);
         this->provides("gazebo")->addOperation("update",&BarrettHandGazebo::gazeboUpdateHook,this,RTT::ClientThread);
 
+        this->addOperation("dumpLatencyTrace", &LatencyTrace::writeChromeTrace, &LatencyTrace::getInstance(), RTT::ClientThread)
+            .doc("writes the latency trace of the commands as a Chrome trace, if tracing is enabled")
+            .arg("path", "the output file");
+
         // right hand ports
 //        this->ports()->addPort("q_INPORT",      port_q_in_);
 //        this->ports()->addPort("v_INPORT",      port_v_in_);
@@ -108,6 +152,9 @@
         mp_in_ = 0.0;
         hold_in_ = 0;    // false
         max_measured_pressure_in_.setZero();
+        q_out_.setZero();
+        t_out_.setZero();
+        idle_t_.setZero();
         //temp_out_.temp.resize(8);
         //port_temp_out_.setDataSample(temp_out_);
 //        status_out_ = STATUS_IDLE1 | STATUS_IDLE2 | STATUS_IDLE3 | STATUS_IDLE4;
@@ -115,6 +162,12 @@
 //            status_idle_[i] = true;
             status_overcurrent_[i] = false;
 //            move_hand_[i] = false;
+            puck_q_[i] = 0.0;
+            puck_v_[i] = 0.0;
+            puck_move_[i] = false;
+            puck_idle_[i] = true;
+            puck_moves_applied_[i] = 0;
+            puck_moves_sent_[i] = 0;
         }
         clutch_break_[0] = clutch_break_[1] = clutch_break_[2] = false;
     }
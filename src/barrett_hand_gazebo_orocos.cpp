@@ -25,25 +25,30 @@
 */
 
 #include "barrett_hand_gazebo.h"
+#include "topology_cache.h"
+#include "startup_coordinator.h"
+#include "benchmark_motion.h"
+#include "robot_state_export.h"
 #include <rtt/Logger.hpp>
+#include "allocation_audit.h"
 #include "barrett_hand_controller/BarrettHandCan.h"
 
 using namespace RTT;
 
 void BarrettHandGazebo::updateHook() {
+    VELMA_SIM_RT_SCOPE("BarrettHandGazebo::updateHook");
 //    Logger::In in(std::string("BarrettHandGazebo::updateHook ") + getName());
     Logger::In in(getName());
 
-    // Synchronize with gazeboUpdate()
-    RTT::os::MutexLock lock(gazebo_mutex_);
+    {
+        // Synchronize with gazeboUpdate()
+        RTT::os::MutexLock lock(gazebo_mutex_);
 
-    if (!data_valid_) {
-        //Logger::In in("BarrettHandGazebo::updateHook");
-        //Logger::log() << Logger::Debug << "gazebo is not initialized" << Logger::endl;
-        return;
-    }
-    else {
-        //Logger::log() << Logger::Debug << Logger::endl;
+        if (!data_valid_) {
+            //Logger::In in("BarrettHandGazebo::updateHook");
+            //Logger::log() << Logger::Debug << "gazebo is not initialized" << Logger::endl;
+            return;
+        }
     }
 
 //    if (getName() == "RightHand") {
@@ -59,23 +64,76 @@ void BarrettHandGazebo::updateHook() {
     //
     // BarrettHand
     //
-    hw_can_.jp_[0] = q_out_(1)*50.0*4096.0/2.0/M_PI;
-    hw_can_.p_[0] = (q_out_(2) + q_out_(1)) * 4096.0/(1.0/125.0 + 1.0/375.0)/2.0/M_PI;
-    hw_can_.jp_[1] = q_out_(4)*4096.0*50.0/2.0/M_PI;
-    hw_can_.p_[1] = (q_out_(5) + q_out_(4))*4096.0/(1.0/125.0 + 1.0/375.0)/2.0/M_PI;
-    hw_can_.jp_[2] = q_out_(6)*4096.0*50.0/2.0/M_PI;
-    hw_can_.p_[2] = (q_out_(7) + q_out_(6))*4096.0/(1.0/125.0 + 1.0/375.0)/2.0/M_PI;
-    hw_can_.p_[3] = q_out_(0)*35840.0/M_PI;
+    serveCan();
+}
 
+void BarrettHandGazebo::serveCan() {
+    // the latest state of the pucks; the idle status of a puck is taken only
+    // if the puck has received all move commands sent to it
+    for (const PuckState *state = state_ring_.front(); state != NULL; state = state_ring_.front()) {
+        hw_can_.jp_[0] = state->q[1]*50.0*4096.0/2.0/M_PI;
+        hw_can_.p_[0] = (state->q[2] + state->q[1]) * 4096.0/(1.0/125.0 + 1.0/375.0)/2.0/M_PI;
+        hw_can_.jp_[1] = state->q[4]*4096.0*50.0/2.0/M_PI;
+        hw_can_.p_[1] = (state->q[5] + state->q[4])*4096.0/(1.0/125.0 + 1.0/375.0)/2.0/M_PI;
+        hw_can_.jp_[2] = state->q[6]*4096.0*50.0/2.0/M_PI;
+        hw_can_.p_[2] = (state->q[7] + state->q[6])*4096.0/(1.0/125.0 + 1.0/375.0)/2.0/M_PI;
+        hw_can_.p_[3] = state->q[0]*35840.0/M_PI;
+        for (int i = 0; i < 4; ++i) {
+            if (state->moves_applied[i] == puck_moves_sent_[i]) {
+                hw_can_.status_idle_[i] = state->idle[i];
+            }
+        }
+        state_ring_.pop();
+    }
+
+    // reads all frames from rx_queue_INPORT and replies to them in tx_OUTPORT
     hw_can_.processPuckMsgs();
+
+    // the move commands go to the physics thread with the time they reach
+    // the pucks; a command that does not fit into the ring stays in
+    // move_hand_ and is sent in the next cycle
+    const double sim_time = can_sim_time_.load();
+    for (int i = 0; i < 4; ++i) {
+        if (!hw_can_.move_hand_[i] || move_ring_.full()) {
+            continue;
+        }
+        PuckMove move;
+        move.due_time = can_bus_.send(sim_time, CAN_FRAMES_PER_MOVE);
+        move.puck = i;
+        move.q = hw_can_.q_in_[i];
+        move.v = hw_can_.v_in_[i];
+        move.seq = ++move_seq_;
+        move_ring_.push(move);
+        LatencyTrace::getInstance().record(trace_channel_, move.seq, LatencyTrace::STAGE_READ);
+
+        hw_can_.move_hand_[i] = false;
+        hw_can_.status_idle_[i] = false;
+        ++puck_moves_sent_[i];
+    }
 }
 
 bool BarrettHandGazebo::startHook() {
-  return true;
+    if (trace_channel_ >= 0) {
+        LatencyTrace::getInstance().startUser();
+    }
+    return true;
+}
+
+void BarrettHandGazebo::stopHook() {
+    // the latency trace is complete when all traced components are stopped
+    if (trace_channel_ >= 0) {
+        LatencyTrace::getInstance().stopUser();
+    }
+}
+
+void BarrettHandGazebo::cleanupHook() {
+    state_side_ = -1;
+    RobotStateExport::getInstance().release(getName());
 }
 
 bool BarrettHandGazebo::configureHook() {
     Logger::In in("BarrettHandGazebo::configureHook");
+    StartupCoordinator::ScopedPhase phase(getName(), "configure");
     if (prefix_.empty()) {
         Logger::log() << Logger::Error << "param 'prefix' is empty" << Logger::endl;
         return false;
@@ -86,17 +144,30 @@ bool BarrettHandGazebo::configureHook() {
         return false;
     }
 
+    if (!can_bus_.configure(can_bit_rate_, puck_latency_)) {
+        Logger::log() << Logger::Error << "wrong CAN bus parameters: can_bit_rate must be positive, puck_latency must not be negative" << Logger::endl;
+        return false;
+    }
+
     hw_can_.configure(this, can_id_base_);
 
+    if (trace_channel_ < 0) {
+        trace_channel_ = LatencyTrace::getInstance().addChannel(getName() + " move command");
+    }
+
+    benchmark_component_ = BenchmarkMotion::getInstance().addComponent(getName());
+    state_side_ = RobotStateExport::getInstance().acquire(getName()) ? RobotStateExport::getSide(prefix_) : -1;
+
     std::string hand_joint_names[] = {"_HandFingerOneKnuckleOneJoint",
         "_HandFingerOneKnuckleTwoJoint", "_HandFingerOneKnuckleThreeJoint",
         "_HandFingerTwoKnuckleOneJoint", "_HandFingerTwoKnuckleTwoJoint",
         "_HandFingerTwoKnuckleThreeJoint", "_HandFingerThreeKnuckleTwoJoint",
         "_HandFingerThreeKnuckleThreeJoint" };
 
+    const TopologyCache &topology = TopologyCache::getInstance(model_);
     for (int i = 0; i < 8; i++) {
         std::string name( prefix_ + hand_joint_names[i] );
-        gazebo::physics::JointPtr joint = model_->GetJoint(name);
+        gazebo::physics::JointPtr joint = topology.getJoint(name);
         joints_.push_back(joint);
         joint_scoped_names_.push_back(joint->GetScopedName());
         joint->SetEffortLimit(0, 1);
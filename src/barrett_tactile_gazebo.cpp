@@ -26,9 +26,13 @@
 */
 
 #include "barrett_tactile_gazebo.h"
+#include "topology_cache.h"
+#include "startup_coordinator.h"
 #include "barrett_hand_tactile/tactile_geometry.h"
 #include "rtt_rosclock/rtt_rosclock.h"
 #include <rtt/Logger.hpp>
+#include "allocation_audit.h"
+#include "step_monitor.h"
 #include <rtt/Component.hpp>
 
 using namespace RTT;
@@ -94,6 +98,7 @@ using namespace RTT;
 
     bool BarrettTactileGazebo::configureHook() {
         Logger::In in("BarrettTactileGazebo::configureHook");
+        StartupCoordinator::ScopedPhase phase(getName(), "configure");
 
         if(model_.get() == NULL) {
             Logger::log() << Logger::Error << "gazebo model is NULL" << Logger::endl;
@@ -113,29 +118,14 @@ using namespace RTT;
 
         const std::string optoforce_link_name_example = prefix_ +
                                         std::string("_HandFingerOneKnuckleThreeOptoforceSensor");
+        const TopologyCache &topology = TopologyCache::getInstance(model_);
+        if (topology.getLink(optoforce_link_name_example)) {
+            has_optoforce_ = true;
+        }
         for (int i = 0; i < 4; i++) {
-            for (gazebo::physics::Link_V::const_iterator it = model_->GetLinks().begin();
-                                                            it != model_->GetLinks().end(); it++) {
-
-                const std::string &link_name = (*it)->GetName();
-
-                if ( link_name == optoforce_link_name_example ) {
-                    has_optoforce_ = true;
-                }
-
-                int col_count = (*it)->GetCollisions().size();
-                bool found = false;
-                for (int cidx = 0; cidx < col_count; cidx++) {
-                    const std::string &col_name = (*it)->GetCollisions()[cidx]->GetName();
-                    if (col_name == collision_names[i]) {
-                        link_names_.push_back( link_name );
-                        found = true;
-                        break;
-                    }
-                }
-                if (found) {
-                    break;
-                }
+            gazebo::physics::LinkPtr link = topology.getLinkByCollision(collision_names[i]);
+            if (link) {
+                link_names_.push_back( link->GetName() );
             }
         }
 
@@ -143,6 +133,7 @@ using namespace RTT;
     }
 
     void BarrettTactileGazebo::updateHook() {
+        VELMA_SIM_RT_SCOPE("BarrettTactileGazebo::updateHook");
         // Synchronize with gazeboUpdate()
         RTT::os::MutexLock lock(gazebo_mutex_);
         
@@ -177,6 +168,8 @@ using namespace RTT;
 // Update the controller
 void BarrettTactileGazebo::gazeboUpdateHook(gazebo::physics::ModelPtr model)
 {
+    VELMA_SIM_RT_SCOPE("BarrettTactileGazebo::gazeboUpdateHook");
+    VELMA_SIM_HOOK_TIMER();
     if (has_optoforce_) {
         // nothing to do - there are no tactile sensors (except palm)
         return;
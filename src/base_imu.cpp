@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cmath>
 #include <functional>
 #include <string>
 #include <iostream>
@@ -6,6 +8,10 @@
 #include <ros/ros.h>
 #include <ros/console.h>
 #include <sensor_msgs/Imu.h>
+#include <velma_sim_gazebo/ImuBatch.h>
+#include <velma_sim_gazebo/ImuPreintegration.h>
+#include "imu_preintegrator.h"
+#include "velma_sim_gazebo/imu_shm_ring.h"
 
 #define CLIENT_NAME "gazebo_ros"
 
@@ -15,9 +21,31 @@ namespace gazebo
 class BaseImu : public SensorPlugin
 {
 public:
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
 	BaseImu()
 	{
 		counter = 0;
+		outCounter = 0;
+		decimation = 1;
+		batchSize = 0;
+		batchFill = 0;
+		shmCapacity = 1024;
+		shmHdr = nullptr;
+		publishRaw = true;
+		preintWindow = 0;
+		preintStarted = false;
+		preintCounter = 0;
+		resetAccumulator();
+	}
+
+	~BaseImu()
+	{
+		if(shmHdr)
+		{
+			munmap(shmHdr, velma_sim_gazebo::imuShmSize(shmCapacity));
+			shm_unlink(shmName.c_str());
+		}
 	}
 	
 	///Uruchamiane na inicjalizację
@@ -29,6 +57,29 @@ public:
 		{
 			ROS_FATAL_STREAM("Could not find IMU sensor");
 		}
+
+		//parametry wyjścia
+		std::string frameId = "omnivelma";
+		if(sdf -> HasElement("frameId"))
+			frameId = sdf -> Get<std::string>("frameId");
+		if(sdf -> HasElement("decimation"))
+			decimation = std::max(1, sdf -> Get<int>("decimation"));
+		if(sdf -> HasElement("batchSize"))
+			batchSize = std::max(0, sdf -> Get<int>("batchSize"));
+		if(sdf -> HasElement("shmName"))
+			shmName = sdf -> Get<std::string>("shmName");
+		if(sdf -> HasElement("shmCapacity"))
+			shmCapacity = std::max(2, sdf -> Get<int>("shmCapacity"));
+		if(sdf -> HasElement("publishRaw"))
+			publishRaw = sdf -> Get<bool>("publishRaw");
+		if(sdf -> HasElement("preintegrationWindow"))
+			preintWindow = std::max(0.0, sdf -> Get<double>("preintegrationWindow"));
+		double gyroNoise = 1.7e-4, accelNoise = 2.0e-3;
+		if(sdf -> HasElement("gyroNoiseDensity"))
+			gyroNoise = sdf -> Get<double>("gyroNoiseDensity");
+		if(sdf -> HasElement("accelNoiseDensity"))
+			accelNoise = sdf -> Get<double>("accelNoiseDensity");
+		preint.setNoise(gyroNoise, accelNoise);
 		
 		//inicjalizacja ROSa
 		if (!ros::isInitialized())
@@ -41,51 +92,268 @@ public:
 		//stwórz Node dla ROSa
 		rosNode.reset(new ros::NodeHandle());
 
+		//przygotuj wiadomości raz, żeby nie alokować pamięci przy każdym pomiarze
+		imu.header.frame_id = frameId;
+		batch.header.frame_id = frameId;
+		batch.stamp.resize(batchSize);
+		batch.orientation.resize(batchSize);
+		batch.angular_velocity.resize(batchSize);
+		batch.linear_acceleration.resize(batchSize);
+		preintMsg.header.frame_id = frameId;
+
+		//wystaw interfejs ROSa
+		if(publishRaw)
+		{
+			if(batchSize > 0)
+			{
+				publisher = rosNode -> advertise<velma_sim_gazebo::ImuBatch>("/BaseImu/imu_batch", 10);
+			}
+			else
+			{
+				publisher = rosNode -> advertise<sensor_msgs::Imu>("/BaseImu/imu", 1000);
+			}
+			if(!publisher)
+			{
+				ROS_FATAL_STREAM("Could not create publisher for BaseImu");
+			}
+		}
+		if(preintWindow > 0)
+		{
+			preintPublisher = rosNode -> advertise<velma_sim_gazebo::ImuPreintegration>("/BaseImu/imu_preintegration", 100);
+			if(!preintPublisher)
+			{
+				ROS_FATAL_STREAM("Could not create publisher /BaseImu/imu_preintegration");
+			}
+		}
+
+		//pamięć współdzielona dla lokalnych odbiorców
+		if(!shmName.empty() && !openShm())
+		{
+			ROS_ERROR_STREAM("BaseImu: could not create shared memory " << shmName);
+		}
+
 		//podłącz zdarzenie aktualizacji
 		updateConnection = sensor -> ConnectUpdated(std::bind(&BaseImu::OnUpdate, this));
 
 		//aktywuj sensor
 		sensor -> SetActive(true);
-		
-		//wystaw interfejs ROSa
-		publisher = rosNode -> advertise<sensor_msgs::Imu>("/BaseImu/imu", 1000);
-		if(!publisher)
-		{
-			ROS_FATAL_STREAM("Could not create publisher /BaseImu/imu");
-		}
 
 		//powiadom o gotowości
-		ROS_INFO("BaseImu initialized");
+		ROS_INFO("BaseImu initialized: decimation %d, batch size %d, shm '%s', raw %d, preintegration window %f",
+				decimation, batchSize, shmName.c_str(), (int)publishRaw, preintWindow);
 		ROS_DEBUG_STREAM("BaseImu initialized");
 	}
 
 
 private:
+	///Tworzy segment pamięci współdzielonej i inicjalizuje nagłówek
+	bool openShm()
+	{
+		const size_t size = velma_sim_gazebo::imuShmSize(shmCapacity);
+		int fd = shm_open(shmName.c_str(), O_CREAT | O_RDWR, 0644);
+		if(fd < 0)
+			return false;
+		if(ftruncate(fd, size) != 0)
+		{
+			close(fd);
+			return false;
+		}
+		void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if(ptr == MAP_FAILED)
+			return false;
+
+		memset(ptr, 0, size);
+		shmHdr = static_cast<velma_sim_gazebo::ImuShmHeader*>(ptr);
+		shmHdr -> capacity = shmCapacity;
+		shmHdr -> sample_size = sizeof(velma_sim_gazebo::ImuShmSample);
+		shmHdr -> version = IMU_SHM_VERSION;
+		__atomic_store_n(&shmHdr -> magic, IMU_SHM_MAGIC, __ATOMIC_RELEASE);
+		return true;
+	}
+
+	///Zeruje akumulator decymacji
+	void resetAccumulator()
+	{
+		accCount = 0;
+		for(int i = 0; i < 4; i++)
+			accQ[i] = 0;
+		for(int i = 0; i < 3; i++)
+		{
+			accW[i] = 0;
+			accA[i] = 0;
+		}
+	}
+
 	///Funkcja podłączana do zdarzenia aktualizacji
 	void OnUpdate()
 	{
-		sensor_msgs::Imu imu;
-		
-		//uzupełnij nagłówek
-		imu.header.seq = counter;
-		imu.header.stamp.sec = sensor -> LastMeasurementTime().sec;
-		imu.header.stamp.nsec = sensor -> LastMeasurementTime().nsec;
-		imu.header.frame_id = "omnivelma";
-		
-		//uzupełnij parametry czujnika
-		imu.orientation.x = sensor -> Orientation().X();
-		imu.orientation.y = sensor -> Orientation().Y();
-		imu.orientation.z = sensor -> Orientation().Z();
-		imu.orientation.w = sensor -> Orientation().W();
-		imu.angular_velocity.x = sensor -> AngularVelocity().X();
-		imu.angular_velocity.y = sensor -> AngularVelocity().Y();
-		imu.angular_velocity.z = sensor -> AngularVelocity().Z();
-		imu.linear_acceleration.x = sensor -> LinearAcceleration().X();
-		imu.linear_acceleration.y = sensor -> LinearAcceleration().Y();
-		imu.linear_acceleration.z = sensor -> LinearAcceleration().Z();
-		
-		publisher.publish(imu);
+		const common::Time t = sensor -> LastMeasurementTime();
+		const ignition::math::Quaterniond q = sensor -> Orientation();
+		const ignition::math::Vector3d w = sensor -> AngularVelocity();
+		const ignition::math::Vector3d a = sensor -> LinearAcceleration();
 		counter++;
+
+		//preintegracja na pełnej częstotliwości czujnika
+		if(preintWindow > 0)
+			updatePreintegration(t, w, a);
+
+		if(!publishRaw && !shmHdr)
+			return;
+
+		//uśrednianie: prędkości i przyspieszenia średnio, orientacja jako
+		//znormalizowana suma kwaternionów z tej samej półsfery
+		if(accCount == 0)
+			accT0 = t;
+		double sign = 1.0;
+		if(accCount > 0 && accQ[0] * q.X() + accQ[1] * q.Y() + accQ[2] * q.Z() + accQ[3] * q.W() < 0)
+			sign = -1.0;
+		accQ[0] += sign * q.X();
+		accQ[1] += sign * q.Y();
+		accQ[2] += sign * q.Z();
+		accQ[3] += sign * q.W();
+		accW[0] += w.X();
+		accW[1] += w.Y();
+		accW[2] += w.Z();
+		accA[0] += a.X();
+		accA[1] += a.Y();
+		accA[2] += a.Z();
+		accCount++;
+		if(accCount < decimation)
+			return;
+
+		//średnia odpowiada środkowi okna
+		const common::Time stamp = accT0 + common::Time((t - accT0).Double() * 0.5);
+		const double inv = 1.0 / accCount;
+		double qn = std::sqrt(accQ[0] * accQ[0] + accQ[1] * accQ[1] + accQ[2] * accQ[2] + accQ[3] * accQ[3]);
+		if(qn <= 0)
+			qn = 1.0;
+		double qOut[4] = {accQ[0] / qn, accQ[1] / qn, accQ[2] / qn, accQ[3] / qn};
+		double wOut[3] = {accW[0] * inv, accW[1] * inv, accW[2] * inv};
+		double aOut[3] = {accA[0] * inv, accA[1] * inv, accA[2] * inv};
+		resetAccumulator();
+
+		if(shmHdr)
+			writeShm(stamp, qOut, wOut, aOut);
+
+		if(publishRaw && batchSize > 0)
+		{
+			if(batchFill == 0)
+			{
+				batch.header.seq = outCounter;
+				batch.header.stamp.sec = stamp.sec;
+				batch.header.stamp.nsec = stamp.nsec;
+				batch.first_seq = outCounter;
+			}
+			batch.stamp[batchFill].sec = stamp.sec;
+			batch.stamp[batchFill].nsec = stamp.nsec;
+			fillQuaternion(batch.orientation[batchFill], qOut);
+			fillVector(batch.angular_velocity[batchFill], wOut);
+			fillVector(batch.linear_acceleration[batchFill], aOut);
+			batchFill++;
+			if(batchFill == batchSize)
+			{
+				publisher.publish(batch);
+				batchFill = 0;
+			}
+		}
+		else if(publishRaw)
+		{
+			//uzupełnij nagłówek
+			imu.header.seq = outCounter;
+			imu.header.stamp.sec = stamp.sec;
+			imu.header.stamp.nsec = stamp.nsec;
+			
+			//uzupełnij parametry czujnika
+			fillQuaternion(imu.orientation, qOut);
+			fillVector(imu.angular_velocity, wOut);
+			fillVector(imu.linear_acceleration, aOut);
+			
+			publisher.publish(imu);
+		}
+		outCounter++;
+	}
+
+	///Całkuje pomiar od poprzedniego pomiaru i wysyła wynik po zakończeniu okna
+	void updatePreintegration(const common::Time &t, const ignition::math::Vector3d &w, const ignition::math::Vector3d &a)
+	{
+		if(!preintStarted)
+		{
+			preintStarted = true;
+			preintStart = t;
+			preintPrev = t;
+			return;
+		}
+		preint.integrate(Eigen::Vector3d(w.X(), w.Y(), w.Z()), Eigen::Vector3d(a.X(), a.Y(), a.Z()),
+				(t - preintPrev).Double());
+		preintPrev = t;
+
+		if((t - preintStart).Double() < preintWindow - 1e-9)
+			return;
+
+		preintMsg.header.seq = preintCounter++;
+		preintMsg.header.stamp.sec = t.sec;
+		preintMsg.header.stamp.nsec = t.nsec;
+		preintMsg.start_stamp.sec = preintStart.sec;
+		preintMsg.start_stamp.nsec = preintStart.nsec;
+		preintMsg.dt = preint.getDeltaTime();
+		preintMsg.n_samples = preint.getSamplesCount();
+		const Eigen::Quaterniond &dR = preint.getDeltaRotation();
+		const double q[4] = {dR.x(), dR.y(), dR.z(), dR.w()};
+		fillQuaternion(preintMsg.delta_rotation, q);
+		fillVector(preintMsg.delta_velocity, preint.getDeltaVelocity().data());
+		fillVector(preintMsg.delta_position, preint.getDeltaPosition().data());
+		for(int i = 0; i < 9; i++)
+			for(int j = 0; j < 9; j++)
+				preintMsg.covariance[i * 9 + j] = preint.getCovariance()(i, j);
+		fillMatrix(preintMsg.d_rotation_d_bg, preint.getDRdbg());
+		fillMatrix(preintMsg.d_velocity_d_bg, preint.getDvdbg());
+		fillMatrix(preintMsg.d_velocity_d_ba, preint.getDvdba());
+		fillMatrix(preintMsg.d_position_d_bg, preint.getDpdbg());
+		fillMatrix(preintMsg.d_position_d_ba, preint.getDpdba());
+		preintPublisher.publish(preintMsg);
+
+		preint.reset();
+		preintStart = t;
+	}
+
+	static void fillMatrix(boost::array<double, 9> &out, const Eigen::Matrix3d &m)
+	{
+		for(int i = 0; i < 3; i++)
+			for(int j = 0; j < 3; j++)
+				out[i * 3 + j] = m(i, j);
+	}
+
+	///Zapisuje próbkę do pierścienia w pamięci współdzielonej
+	void writeShm(const common::Time &stamp, const double *q, const double *w, const double *a)
+	{
+		const uint64_t n = shmHdr -> write_count;
+		velma_sim_gazebo::ImuShmSample *slot = velma_sim_gazebo::imuShmSlots(shmHdr) + (n % shmCapacity);
+		__atomic_store_n(&slot -> lock, 2 * n + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		slot -> seq = outCounter;
+		slot -> sec = stamp.sec;
+		slot -> nsec = stamp.nsec;
+		memcpy(slot -> orientation, q, sizeof(slot -> orientation));
+		memcpy(slot -> angular_velocity, w, sizeof(slot -> angular_velocity));
+		memcpy(slot -> linear_acceleration, a, sizeof(slot -> linear_acceleration));
+		__atomic_store_n(&slot -> lock, 2 * (n + 1), __ATOMIC_RELEASE);
+		__atomic_store_n(&shmHdr -> write_count, n + 1, __ATOMIC_RELEASE);
+	}
+
+	static void fillQuaternion(geometry_msgs::Quaternion &out, const double *q)
+	{
+		out.x = q[0];
+		out.y = q[1];
+		out.z = q[2];
+		out.w = q[3];
+	}
+
+	static void fillVector(geometry_msgs::Vector3 &out, const double *v)
+	{
+		out.x = v[0];
+		out.y = v[1];
+		out.z = v[2];
 	}
 	
 	///Topic do nadawania pomiarów
@@ -94,8 +362,47 @@ private:
 	///Wskaźnik na czujnik
 	sensors::ImuSensorPtr sensor;
 	
-	///Licznik kroków
+	///Licznik pomiarów czujnika
 	unsigned int counter;
+
+	///Licznik wysłanych (zdecymowanych) pomiarów
+	unsigned int outCounter;
+
+	///Co ile pomiarów wysyłana jest średnia
+	int decimation;
+
+	///Liczba pomiarów w jednej wiadomości; 0 - pojedyncze wiadomości sensor_msgs/Imu
+	int batchSize;
+	int batchFill;
+
+	///Akumulator decymacji
+	int accCount;
+	common::Time accT0;
+	double accQ[4];
+	double accW[3];
+	double accA[3];
+
+	///Wiadomości wypełniane w miejscu
+	sensor_msgs::Imu imu;
+	velma_sim_gazebo::ImuBatch batch;
+
+	///Czy wysyłać pomiary (pojedynczo lub w paczkach)
+	bool publishRaw;
+
+	///Preintegracja; długość okna w sekundach, 0 - wyłączona
+	double preintWindow;
+	ImuPreintegrator preint;
+	bool preintStarted;
+	common::Time preintStart;
+	common::Time preintPrev;
+	unsigned int preintCounter;
+	velma_sim_gazebo::ImuPreintegration preintMsg;
+	ros::Publisher preintPublisher;
+
+	///Pierścień w pamięci współdzielonej; pusta nazwa - wyłączony
+	std::string shmName;
+	int shmCapacity;
+	velma_sim_gazebo::ImuShmHeader *shmHdr;
 	
 	///Wskaźnik na zdarzenie aktualizacji
 	event::ConnectionPtr updateConnection;
@@ -106,5 +413,3 @@ private:
 
 GZ_REGISTER_SENSOR_PLUGIN(BaseImu)
 }
-
-
@@ -0,0 +1,322 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "batched_mass_matrix.h"
+
+#include <cstddef>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+//
+// One scalar of the spatial algebra for all lanes.
+//
+#if defined(__AVX__)
+
+const int LANES = 4;
+
+struct Pack {
+    __m256d v;
+};
+
+inline Pack load(const double *p) { Pack r; r.v = _mm256_loadu_pd(p); return r; }
+inline void store(double *p, const Pack &a) { _mm256_storeu_pd(p, a.v); }
+inline Pack zero() { Pack r; r.v = _mm256_setzero_pd(); return r; }
+inline Pack add(const Pack &a, const Pack &b) { Pack r; r.v = _mm256_add_pd(a.v, b.v); return r; }
+inline Pack sub(const Pack &a, const Pack &b) { Pack r; r.v = _mm256_sub_pd(a.v, b.v); return r; }
+inline Pack mul(const Pack &a, const Pack &b) { Pack r; r.v = _mm256_mul_pd(a.v, b.v); return r; }
+#if defined(__FMA__)
+inline Pack madd(const Pack &a, const Pack &b, const Pack &c) { Pack r; r.v = _mm256_fmadd_pd(a.v, b.v, c.v); return r; }
+#else
+inline Pack madd(const Pack &a, const Pack &b, const Pack &c) { return add(mul(a, b), c); }
+#endif
+
+#elif defined(__SSE2__)
+
+const int LANES = 2;
+
+struct Pack {
+    __m128d v;
+};
+
+inline Pack load(const double *p) { Pack r; r.v = _mm_loadu_pd(p); return r; }
+inline void store(double *p, const Pack &a) { _mm_storeu_pd(p, a.v); }
+inline Pack zero() { Pack r; r.v = _mm_setzero_pd(); return r; }
+inline Pack add(const Pack &a, const Pack &b) { Pack r; r.v = _mm_add_pd(a.v, b.v); return r; }
+inline Pack sub(const Pack &a, const Pack &b) { Pack r; r.v = _mm_sub_pd(a.v, b.v); return r; }
+inline Pack mul(const Pack &a, const Pack &b) { Pack r; r.v = _mm_mul_pd(a.v, b.v); return r; }
+inline Pack madd(const Pack &a, const Pack &b, const Pack &c) { return add(mul(a, b), c); }
+
+#else
+
+const int LANES = 1;
+
+struct Pack {
+    double v;
+};
+
+inline Pack load(const double *p) { Pack r; r.v = *p; return r; }
+inline void store(double *p, const Pack &a) { *p = a.v; }
+inline Pack zero() { Pack r; r.v = 0.0; return r; }
+inline Pack add(const Pack &a, const Pack &b) { Pack r; r.v = a.v + b.v; return r; }
+inline Pack sub(const Pack &a, const Pack &b) { Pack r; r.v = a.v - b.v; return r; }
+inline Pack mul(const Pack &a, const Pack &b) { Pack r; r.v = a.v * b.v; return r; }
+inline Pack madd(const Pack &a, const Pack &b, const Pack &c) { Pack r; r.v = a.v * b.v + c.v; return r; }
+
+#endif
+
+// fields of one link, each field is one double per lane
+enum {
+    F_S = 0,            // joint axis, 6
+    F_I = 6,            // spatial inertia, 6x6 row-major
+    F_R = 42,           // rotation of the relative pose, 3x3 row-major
+    F_P = 51,           // translation of the relative pose, 3
+    F_IC = 54,          // composite inertia, 6x6 row-major
+    F_X = 90,           // motion transform from link i-1 to link i, 6x6 row-major
+    F_COUNT = 126
+};
+
+// X = [R^T, 0; -R^T [p]x, R^T] maps the motion of link i-1 to the frame of link i
+inline void motionTransform(const Pack *R, const Pack *p, Pack *X) {
+    for (int i = 0; i < 36; ++i) {
+        X[i] = zero();
+    }
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 3; ++c) {
+            X[r * 6 + c] = R[c * 3 + r];
+            X[(r + 3) * 6 + c + 3] = R[c * 3 + r];
+        }
+    }
+    // -R^T [p]x, column c of [p]x is p x e_c
+    for (int r = 0; r < 3; ++r) {
+        // row r of R^T is column r of R
+        const Pack &a0 = R[0 * 3 + r];
+        const Pack &a1 = R[1 * 3 + r];
+        const Pack &a2 = R[2 * 3 + r];
+        // (R^T [p]x)(r, c) = a . (p x e_c) = e_c . (a x p)
+        X[(r + 3) * 6 + 0] = sub(mul(a2, p[1]), mul(a1, p[2]));
+        X[(r + 3) * 6 + 1] = sub(mul(a0, p[2]), mul(a2, p[0]));
+        X[(r + 3) * 6 + 2] = sub(mul(a1, p[0]), mul(a0, p[1]));
+    }
+}
+
+// F' = X^T F
+inline void forceTransform(const Pack *X, const Pack *F, Pack *out) {
+    for (int c = 0; c < 6; ++c) {
+        Pack sum = zero();
+        for (int r = 0; r < 6; ++r) {
+            sum = madd(X[r * 6 + c], F[r], sum);
+        }
+        out[c] = sum;
+    }
+}
+
+}   // namespace
+
+BatchedMassMatrix::BatchedMassMatrix()
+    : dofs_(0)
+    , batch_size_(0)
+    , packs_(0)
+    , data_(NULL)
+    , mm_(NULL)
+{
+}
+
+BatchedMassMatrix::~BatchedMassMatrix() {
+    delete[] data_;
+    delete[] mm_;
+}
+
+int BatchedMassMatrix::getLanes() {
+    return LANES;
+}
+
+void BatchedMassMatrix::configure(int dofs, int batch_size) {
+    dofs_ = dofs;
+    batch_size_ = batch_size;
+    packs_ = (batch_size + LANES - 1) / LANES;
+    delete[] data_;
+    delete[] mm_;
+    const int data_size = packs_ * dofs_ * F_COUNT * LANES;
+    const int mm_size = packs_ * dofs_ * dofs_ * LANES;
+    data_ = new double[data_size];
+    mm_ = new double[mm_size];
+    for (int i = 0; i < data_size; ++i) {
+        data_[i] = 0.0;
+    }
+    for (int i = 0; i < mm_size; ++i) {
+        mm_[i] = 0.0;
+    }
+}
+
+int BatchedMassMatrix::getDofs() const {
+    return dofs_;
+}
+
+int BatchedMassMatrix::getBatchSize() const {
+    return batch_size_;
+}
+
+int BatchedMassMatrix::index(int chain, int link, int field) const {
+    const int pack = chain / LANES;
+    const int lane = chain % LANES;
+    return ((pack * dofs_ + link) * F_COUNT + field) * LANES + lane;
+}
+
+void BatchedMassMatrix::setJointAxis(int chain, int link, const double *S) {
+    for (int i = 0; i < 6; ++i) {
+        data_[index(chain, link, F_S + i)] = S[i];
+    }
+}
+
+void BatchedMassMatrix::setInertia(int chain, int link, const double *I) {
+    for (int i = 0; i < 36; ++i) {
+        data_[index(chain, link, F_I + i)] = I[i];
+    }
+}
+
+void BatchedMassMatrix::setRelativePose(int chain, int link, const double *R, const double *p) {
+    for (int i = 0; i < 9; ++i) {
+        data_[index(chain, link, F_R + i)] = R[i];
+    }
+    for (int i = 0; i < 3; ++i) {
+        data_[index(chain, link, F_P + i)] = p[i];
+    }
+}
+
+void BatchedMassMatrix::compute() {
+    for (int pack = 0; pack < packs_; ++pack) {
+        computePack(pack);
+    }
+}
+
+void BatchedMassMatrix::computePack(int pack) {
+    double *base = data_ + pack * dofs_ * F_COUNT * LANES;
+    double *mm = mm_ + pack * dofs_ * dofs_ * LANES;
+    Pack X[36];
+    Pack tmp[36];
+    Pack F[6];
+    Pack F2[6];
+
+#define FIELD(link, field) (base + ((link) * F_COUNT + (field)) * LANES)
+
+    // motion transforms between the links
+    for (int k = 1; k < dofs_; ++k) {
+        Pack R[9], p[3];
+        for (int i = 0; i < 9; ++i) {
+            R[i] = load(FIELD(k, F_R + i));
+        }
+        for (int i = 0; i < 3; ++i) {
+            p[i] = load(FIELD(k, F_P + i));
+        }
+        motionTransform(R, p, X);
+        for (int i = 0; i < 36; ++i) {
+            store(FIELD(k, F_X + i), X[i]);
+        }
+    }
+
+    // composite inertias, from the tip to the base
+    for (int i = 0; i < 36; ++i) {
+        store(FIELD(dofs_ - 1, F_IC + i), load(FIELD(dofs_ - 1, F_I + i)));
+    }
+    for (int k = dofs_ - 1; k > 0; --k) {
+        Pack Ic[36];
+        for (int i = 0; i < 36; ++i) {
+            Ic[i] = load(FIELD(k, F_IC + i));
+            X[i] = load(FIELD(k, F_X + i));
+        }
+
+        // tmp = Ic * X
+        for (int r = 0; r < 6; ++r) {
+            for (int c = 0; c < 6; ++c) {
+                Pack sum = zero();
+                for (int j = 0; j < 6; ++j) {
+                    sum = madd(Ic[r * 6 + j], X[j * 6 + c], sum);
+                }
+                tmp[r * 6 + c] = sum;
+            }
+        }
+        // Ic(k-1) = I(k-1) + X^T * tmp
+        for (int r = 0; r < 6; ++r) {
+            for (int c = 0; c < 6; ++c) {
+                Pack sum = load(FIELD(k - 1, F_I + r * 6 + c));
+                for (int j = 0; j < 6; ++j) {
+                    sum = madd(X[j * 6 + r], tmp[j * 6 + c], sum);
+                }
+                store(FIELD(k - 1, F_IC + r * 6 + c), sum);
+            }
+        }
+    }
+
+    // M(i,i) = S_i^T Ic_i S_i, M(j,i) = S_j^T X^T ... Ic_i S_i
+    for (int i = 0; i < dofs_; ++i) {
+        Pack S[6];
+        for (int r = 0; r < 6; ++r) {
+            S[r] = load(FIELD(i, F_S + r));
+        }
+        for (int r = 0; r < 6; ++r) {
+            Pack sum = zero();
+            for (int c = 0; c < 6; ++c) {
+                sum = madd(load(FIELD(i, F_IC + r * 6 + c)), S[c], sum);
+            }
+            F[r] = sum;
+        }
+        for (int j = i; j >= 0; --j) {
+            if (j < i) {
+                for (int k = 0; k < 36; ++k) {
+                    X[k] = load(FIELD(j + 1, F_X + k));
+                }
+                forceTransform(X, F, F2);
+                for (int k = 0; k < 6; ++k) {
+                    F[k] = F2[k];
+                }
+            }
+            Pack m = zero();
+            for (int k = 0; k < 6; ++k) {
+                m = madd(load(FIELD(j, F_S + k)), F[k], m);
+            }
+            store(mm + (j * dofs_ + i) * LANES, m);
+            store(mm + (i * dofs_ + j) * LANES, m);
+        }
+    }
+
+#undef FIELD
+}
+
+void BatchedMassMatrix::getMassMatrix(int chain, double *M) const {
+    const int pack = chain / LANES;
+    const int lane = chain % LANES;
+    const double *mm = mm_ + pack * dofs_ * dofs_ * LANES;
+    for (int i = 0; i < dofs_ * dofs_; ++i) {
+        M[i] = mm[i * LANES + lane];
+    }
+}
@@ -0,0 +1,85 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef BATCHED_MASS_MATRIX_H__
+#define BATCHED_MASS_MATRIX_H__
+
+//
+// Mass matrix of a batch of serial chains with the same number of joints,
+// computed with the composite rigid body algorithm in lock-step. Every scalar
+// of the spatial algebra is a SIMD pack that holds the same quantity of
+// several chains (4 lanes with AVX, 2 with SSE2, 1 otherwise).
+//
+// The conventions are the same as in manipulator_mass_matrix::Link:
+// spatial vectors are [angular; linear], the joint axis and the spatial
+// inertia of link i are expressed in the frame of link i, and the relative
+// pose of link i is its pose in the frame of link i-1. Matrices are row-major.
+//
+// The kernel may be built with other instruction set flags than the rest of
+// the package, so the interface uses plain arrays only.
+//
+class BatchedMassMatrix {
+public:
+    BatchedMassMatrix();
+    ~BatchedMassMatrix();
+
+    // the number of chains computed in one SIMD pack
+    static int getLanes();
+
+    // non-RT, allocates the buffers
+    void configure(int dofs, int batch_size);
+
+    int getDofs() const;
+    int getBatchSize() const;
+
+    // RT
+    void setJointAxis(int chain, int link, const double *S);
+    void setInertia(int chain, int link, const double *I);
+    void setRelativePose(int chain, int link, const double *R, const double *p);
+
+    // RT, computes the mass matrices of all chains
+    void compute();
+
+    // RT, M is dofs x dofs
+    void getMassMatrix(int chain, double *M) const;
+
+protected:
+    int index(int chain, int link, int field) const;
+    void computePack(int pack);
+
+    int dofs_;
+    int batch_size_;
+    int packs_;
+    double *data_;
+    double *mm_;
+
+private:
+    BatchedMassMatrix(const BatchedMassMatrix&);
+    BatchedMassMatrix& operator=(const BatchedMassMatrix&);
+};
+
+#endif  // BATCHED_MASS_MATRIX_H__
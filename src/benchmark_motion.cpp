@@ -0,0 +1,457 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "benchmark_motion.h"
+#include "step_monitor.h"
+#include "topology_cache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#include <rtt/Logger.hpp>
+
+using namespace RTT;
+
+namespace {
+
+// the defaults of the KRC joint impedance controller
+const double DEFAULT_STIFFNESS = 1000.0;
+const double DEFAULT_DAMPING = 0.7;
+
+}   // namespace
+
+BenchmarkMotion& BenchmarkMotion::getInstance() {
+    static BenchmarkMotion motion;
+    return motion;
+}
+
+BenchmarkMotion::BenchmarkMotion()
+    : enabled_(false)
+    , end_time_(0.0)
+    , resolved_(false)
+    , finished_(false)
+    , step_begin_ns_(0)
+    , row_size_(0)
+    , rows_count_(0)
+{
+    Logger::In in("BenchmarkMotion");
+
+    const char *path = getenv("VELMA_SIM_BENCHMARK_MOTION");
+    if (!path || path[0] == 0) {
+        return;
+    }
+
+    const char *output_path = getenv("VELMA_SIM_BENCHMARK_OUTPUT");
+    if (!output_path || output_path[0] == 0) {
+        Logger::log() << Logger::Error << "VELMA_SIM_BENCHMARK_OUTPUT is not set, the benchmark is disabled" << Logger::endl;
+        return;
+    }
+    output_path_ = output_path;
+
+    if (!readScript(path)) {
+        return;
+    }
+
+    world_ = gazebo::physics::get_world();
+    if (!world_) {
+        Logger::log() << Logger::Error << "there is no world, the benchmark is disabled" << Logger::endl;
+        return;
+    }
+
+    // sim_time, wall_time, step_time, hooks_time, the positions of the joints,
+    // the setpoints of the driven joints and the poses of the objects
+    row_size_ = 4 + channels_.size() + 7 * objects_.size();
+    for (int i = 0; i < channels_.size(); ++i) {
+        if (channels_[i].driven) {
+            ++row_size_;
+        }
+    }
+    const double step = world_->Physics()->GetMaxStepSize();
+    const size_t capacity = static_cast<size_t >(std::ceil(end_time_ / std::max(step, 1.0e-6))) + 16;
+    rows_.resize(capacity * row_size_);
+
+    begin_connection_ = gazebo::event::Events::ConnectWorldUpdateBegin(std::bind(&BenchmarkMotion::onWorldUpdateBegin, this));
+    end_connection_ = gazebo::event::Events::ConnectWorldUpdateEnd(std::bind(&BenchmarkMotion::onWorldUpdateEnd, this));
+    StepMonitor::getInstance().setEnabled(true);
+
+    Logger::log() << Logger::Info << "benchmark motion " << path << ": " << channels_.size() << " joints, "
+        << objects_.size() << " objects, " << end_time_ << " s" << Logger::endl;
+    enabled_ = true;
+}
+
+BenchmarkMotion::~BenchmarkMotion() {
+    // the benchmark was interrupted
+    if (enabled_ && !finished_) {
+        writeOutput();
+    }
+}
+
+bool BenchmarkMotion::readScript(const std::string &path) {
+    std::ifstream f(path.c_str());
+    if (!f.is_open()) {
+        Logger::log() << Logger::Error << "could not open " << path << Logger::endl;
+        return false;
+    }
+
+    // the gains are set after all channels are read
+    struct Gains {
+        std::string joint_name;
+        double stiffness;
+        double damping;
+    };
+    std::vector<Gains > gains;
+
+    std::string line;
+    int line_no = 0;
+    while (std::getline(f, line)) {
+        ++line_no;
+        std::istringstream ss(line);
+        std::string key;
+        if (!(ss >> key) || key[0] == '#') {
+            continue;
+        }
+
+        bool ok = true;
+        if (key == "@gains") {
+            Gains g;
+            ok = !!(ss >> g.joint_name >> g.stiffness >> g.damping);
+            if (ok) {
+                gains.push_back(g);
+            }
+        }
+        else if (key == "@move") {
+            Move m;
+            std::string component_name;
+            ok = !!(ss >> m.time >> component_name >> m.q[0] >> m.q[1] >> m.q[2] >> m.q[3] >> m.velocity);
+            if (ok) {
+                int idx = 0;
+                while (idx < move_lists_.size() && move_lists_[idx].component_name != component_name) {
+                    ++idx;
+                }
+                if (idx == move_lists_.size()) {
+                    move_lists_.push_back(MoveList());
+                    move_lists_.back().component_name = component_name;
+                    move_lists_.back().next = 0;
+                }
+                move_lists_[idx].moves.push_back(m);
+            }
+        }
+        else if (key == "@record") {
+            Channel ch;
+            ok = !!(ss >> ch.model_name >> ch.joint_name);
+            ch.driven = false;
+            ch.stiffness = DEFAULT_STIFFNESS;
+            ch.damping = DEFAULT_DAMPING;
+            if (ok) {
+                channels_.push_back(ch);
+            }
+        }
+        else if (key == "@object") {
+            Object o;
+            ok = !!(ss >> o.model_name);
+            if (ok) {
+                objects_.push_back(o);
+            }
+        }
+        else if (key == "@end") {
+            ok = !!(ss >> end_time_);
+        }
+        else {
+            Setpoint sp;
+            std::string model_name, joint_name;
+            ss.clear();
+            ss.str(line);
+            ok = !!(ss >> sp.time >> model_name >> joint_name >> sp.position);
+            int idx = 0;
+            while (ok && idx < channels_.size() && channels_[idx].joint_name != joint_name) {
+                ++idx;
+            }
+            if (ok && idx == channels_.size()) {
+                Channel ch;
+                ch.model_name = model_name;
+                ch.joint_name = joint_name;
+                ch.stiffness = DEFAULT_STIFFNESS;
+                ch.damping = DEFAULT_DAMPING;
+                channels_.push_back(ch);
+            }
+            if (ok) {
+                channels_[idx].driven = true;
+                channels_[idx].setpoints.push_back(sp);
+            }
+        }
+
+        if (!ok) {
+            Logger::log() << Logger::Error << path << ":" << line_no << ": wrong line: " << line << Logger::endl;
+            return false;
+        }
+    }
+
+    for (int i = 0; i < gains.size(); ++i) {
+        bool found = false;
+        for (int j = 0; j < channels_.size(); ++j) {
+            if (channels_[j].joint_name == gains[i].joint_name) {
+                channels_[j].stiffness = gains[i].stiffness;
+                channels_[j].damping = gains[i].damping;
+                found = true;
+            }
+        }
+        if (!found) {
+            Logger::log() << Logger::Warning << path << ": there are no setpoints of " << gains[i].joint_name << Logger::endl;
+        }
+    }
+
+    for (int i = 0; i < channels_.size(); ++i) {
+        std::vector<Setpoint > &sp = channels_[i].setpoints;
+        std::stable_sort(sp.begin(), sp.end(), [](const Setpoint &a, const Setpoint &b) { return a.time < b.time; });
+        if (!sp.empty()) {
+            end_time_ = std::max(end_time_, sp.back().time);
+        }
+    }
+    for (int i = 0; i < move_lists_.size(); ++i) {
+        std::vector<Move > &m = move_lists_[i].moves;
+        std::stable_sort(m.begin(), m.end(), [](const Move &a, const Move &b) { return a.time < b.time; });
+        end_time_ = std::max(end_time_, m.back().time);
+    }
+    return true;
+}
+
+int BenchmarkMotion::addJoint(const std::string &joint_name) {
+    if (!enabled_) {
+        return -1;
+    }
+    for (int i = 0; i < channels_.size(); ++i) {
+        if (channels_[i].driven && channels_[i].joint_name == joint_name) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+double BenchmarkMotion::getSetpoint(int channel, double sim_time) const {
+    const std::vector<Setpoint > &sp = channels_[channel].setpoints;
+    if (sim_time <= sp.front().time) {
+        return sp.front().position;
+    }
+    if (sim_time >= sp.back().time) {
+        return sp.back().position;
+    }
+
+    // the first setpoint after sim_time
+    int lo = 0;
+    int hi = sp.size() - 1;
+    while (hi - lo > 1) {
+        const int mid = (lo + hi) / 2;
+        if (sp[mid].time <= sim_time) {
+            lo = mid;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    const double dt = sp[hi].time - sp[lo].time;
+    if (dt <= 0.0) {
+        return sp[hi].position;
+    }
+    return sp[lo].position + (sp[hi].position - sp[lo].position) * (sim_time - sp[lo].time) / dt;
+}
+
+double BenchmarkMotion::getStiffness(int channel) const {
+    return channels_[channel].stiffness;
+}
+
+double BenchmarkMotion::getDamping(int channel) const {
+    return channels_[channel].damping;
+}
+
+int BenchmarkMotion::addComponent(const std::string &component_name) {
+    if (!enabled_) {
+        return -1;
+    }
+    for (int i = 0; i < move_lists_.size(); ++i) {
+        if (move_lists_[i].component_name == component_name) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool BenchmarkMotion::getMove(int component, double sim_time, double q[4], double &velocity) {
+    MoveList &ml = move_lists_[component];
+    if (ml.next >= ml.moves.size() || ml.moves[ml.next].time > sim_time) {
+        return false;
+    }
+    const Move &m = ml.moves[ml.next];
+    for (int i = 0; i < 4; ++i) {
+        q[i] = m.q[i];
+    }
+    velocity = m.velocity;
+    ++ml.next;
+    return true;
+}
+
+bool BenchmarkMotion::resolve() {
+    // non-RT, at the first step: the objects may be inserted after the components are configured
+    Logger::In in("BenchmarkMotion::resolve");
+    bool result = true;
+    for (int i = 0; i < channels_.size(); ++i) {
+        Channel &ch = channels_[i];
+        gazebo::physics::ModelPtr model = world_->ModelByName(ch.model_name);
+        if (model) {
+            ch.joint = TopologyCache::getInstance(model).getJoint(ch.joint_name);
+        }
+        if (!ch.joint) {
+            Logger::log() << Logger::Error << "could not find joint " << ch.model_name << "::" << ch.joint_name << Logger::endl;
+            result = false;
+        }
+    }
+    for (int i = 0; i < objects_.size(); ++i) {
+        objects_[i].model = world_->ModelByName(objects_[i].model_name);
+        if (!objects_[i].model) {
+            Logger::log() << Logger::Error << "could not find object " << objects_[i].model_name << Logger::endl;
+            result = false;
+        }
+    }
+    return result;
+}
+
+void BenchmarkMotion::onWorldUpdateBegin() {
+    step_begin_ns_ = StepMonitor::now();
+}
+
+void BenchmarkMotion::onWorldUpdateEnd() {
+    if (finished_) {
+        return;
+    }
+    const int64_t end_ns = StepMonitor::now();
+
+    if (!resolved_) {
+        resolve();
+        resolved_ = true;
+    }
+
+    int64_t first_hook_ns, hooks_ns;
+    StepMonitor::getInstance().takeStep(world_->Iterations(), first_hook_ns, hooks_ns);
+    int64_t begin_ns = step_begin_ns_;
+    if (first_hook_ns != 0 && (begin_ns == 0 || first_hook_ns < begin_ns)) {
+        begin_ns = first_hook_ns;
+    }
+
+    const double sim_time = world_->SimTime().Double();
+    if ((rows_count_ + 1) * row_size_ <= rows_.size()) {
+        const double nan = std::numeric_limits<double >::quiet_NaN();
+        double *row = &rows_[rows_count_ * row_size_];
+        size_t idx = 0;
+        row[idx++] = sim_time;
+        row[idx++] = begin_ns * 1.0e-9;
+        row[idx++] = (end_ns - begin_ns) * 1.0e-9;
+        row[idx++] = hooks_ns * 1.0e-9;
+        for (int i = 0; i < channels_.size(); ++i) {
+            row[idx++] = channels_[i].joint ? channels_[i].joint->Position(0) : nan;
+        }
+        for (int i = 0; i < channels_.size(); ++i) {
+            if (channels_[i].driven) {
+                row[idx++] = getSetpoint(i, sim_time);
+            }
+        }
+        for (int i = 0; i < objects_.size(); ++i) {
+            if (objects_[i].model) {
+                const ignition::math::Pose3d pose = objects_[i].model->WorldPose();
+                row[idx++] = pose.Pos().X();
+                row[idx++] = pose.Pos().Y();
+                row[idx++] = pose.Pos().Z();
+                row[idx++] = pose.Rot().W();
+                row[idx++] = pose.Rot().X();
+                row[idx++] = pose.Rot().Y();
+                row[idx++] = pose.Rot().Z();
+            }
+            else {
+                for (int j = 0; j < 7; ++j) {
+                    row[idx++] = nan;
+                }
+            }
+        }
+        ++rows_count_;
+    }
+
+    if (sim_time >= end_time_) {
+        // the motion is finished, the simulation goes on
+        finished_ = true;
+        writeOutput();
+    }
+}
+
+bool BenchmarkMotion::writeOutput() {
+    Logger::In in("BenchmarkMotion::writeOutput");
+
+    // the file is written to a temporary path first, so the script
+    // that waits for it never reads a partial file
+    const std::string tmp_path = output_path_ + ".tmp";
+    FILE *f = fopen(tmp_path.c_str(), "w");
+    if (!f) {
+        Logger::log() << Logger::Error << "could not write " << tmp_path << Logger::endl;
+        return false;
+    }
+
+    fprintf(f, "sim_time,wall_time,step_time,hooks_time");
+    for (int i = 0; i < channels_.size(); ++i) {
+        fprintf(f, ",%s", channels_[i].joint_name.c_str());
+    }
+    for (int i = 0; i < channels_.size(); ++i) {
+        if (channels_[i].driven) {
+            fprintf(f, ",%s_setpoint", channels_[i].joint_name.c_str());
+        }
+    }
+    const char* const pose_fields[7] = {"x", "y", "z", "qw", "qx", "qy", "qz"};
+    for (int i = 0; i < objects_.size(); ++i) {
+        for (int j = 0; j < 7; ++j) {
+            fprintf(f, ",%s_%s", objects_[i].model_name.c_str(), pose_fields[j]);
+        }
+    }
+    fprintf(f, "\n");
+
+    for (size_t r = 0; r < rows_count_; ++r) {
+        const double *row = &rows_[r * row_size_];
+        for (size_t i = 0; i < row_size_; ++i) {
+            fprintf(f, (i == 0) ? "%.12g" : ",%.12g", row[i]);
+        }
+        fprintf(f, "\n");
+    }
+    fclose(f);
+
+    if (rename(tmp_path.c_str(), output_path_.c_str()) != 0) {
+        Logger::log() << Logger::Error << "could not write " << output_path_ << Logger::endl;
+        return false;
+    }
+    Logger::log() << Logger::Info << "saved " << rows_count_ << " steps of the benchmark in " << output_path_ << Logger::endl;
+    return true;
+}
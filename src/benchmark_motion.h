@@ -0,0 +1,145 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef BENCHMARK_MOTION_H__
+#define BENCHMARK_MOTION_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <gazebo/gazebo.hh>
+#include <gazebo/physics/physics.hh>
+#include <gazebo/common/common.hh>
+
+//
+// The scripted motion of the physics benchmark. The script is a text file
+// given in the VELMA_SIM_BENCHMARK_MOTION environment variable; its lines are:
+//   time model joint position          - a setpoint of the joint, the setpoints
+//                                        are interpolated linearly in sim time
+//   @gains joint stiffness damping     - the gains of the position loop of the
+//                                        joint (for LWRGazebo: the damping ratio)
+//   @move time component q1 q2 q3 spread velocity
+//                                      - a move command of BarrettHandGazebo
+//   @record model joint                - a joint that is only recorded
+//   @object model                      - a model whose pose is recorded
+//   @end time                          - the end of the benchmark
+// In the benchmark mode the components follow the script instead of their
+// command ports. Every step is recorded (the wall time, the time of the step
+// and the hooks, the positions and setpoints of the joints and the poses of
+// the objects) and written as CSV to VELMA_SIM_BENCHMARK_OUTPUT at the end
+// of the benchmark; scripts/benchmark_physics_profiles compares the runs.
+//
+class BenchmarkMotion {
+public:
+    static BenchmarkMotion& getInstance();
+
+    ~BenchmarkMotion();
+
+    bool isEnabled() const {
+        return enabled_;
+    }
+
+    // non-RT, returns -1 if the joint is not driven by the script
+    int addJoint(const std::string &joint_name);
+
+    // RT, the setpoint at the given sim time
+    double getSetpoint(int channel, double sim_time) const;
+    double getStiffness(int channel) const;
+    double getDamping(int channel) const;
+
+    // non-RT, returns -1 if there are no moves of the component
+    int addComponent(const std::string &component_name);
+
+    // RT, physics thread; returns true if a move of the component starts
+    // at or before the given sim time (each move is returned once)
+    bool getMove(int component, double sim_time, double q[4], double &velocity);
+
+protected:
+    BenchmarkMotion();
+
+    struct Setpoint {
+        double time;
+        double position;
+    };
+
+    struct Channel {
+        std::string model_name;
+        std::string joint_name;
+        bool driven;
+        double stiffness;
+        double damping;
+        std::vector<Setpoint > setpoints;
+        gazebo::physics::JointPtr joint;
+    };
+
+    struct Move {
+        double time;
+        double q[4];
+        double velocity;
+    };
+
+    struct MoveList {
+        std::string component_name;
+        std::vector<Move > moves;
+        size_t next;
+    };
+
+    struct Object {
+        std::string model_name;
+        gazebo::physics::ModelPtr model;
+    };
+
+    bool readScript(const std::string &path);
+    bool resolve();
+    void onWorldUpdateBegin();
+    void onWorldUpdateEnd();
+    bool writeOutput();
+
+    bool enabled_;
+    std::string output_path_;
+    double end_time_;
+
+    std::vector<Channel > channels_;
+    std::vector<MoveList > move_lists_;
+    std::vector<Object > objects_;
+
+    gazebo::physics::WorldPtr world_;
+    gazebo::event::ConnectionPtr begin_connection_;
+    gazebo::event::ConnectionPtr end_connection_;
+    bool resolved_;
+    bool finished_;
+    int64_t step_begin_ns_;
+
+    // the recorded steps, one row of row_size_ values per step
+    std::vector<double > rows_;
+    size_t row_size_;
+    size_t rows_count_;
+};
+
+#endif  // BENCHMARK_MOTION_H__
@@ -0,0 +1,61 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "can_bus_timing.h"
+
+#include <algorithm>
+
+CanBusTiming::CanBusTiming()
+    : frame_time_(0)
+    , puck_latency_(0)
+    , bus_free_time_(0)
+{}
+
+bool CanBusTiming::configure(double bit_rate, double puck_latency) {
+    if (bit_rate <= 0 || puck_latency < 0) {
+        return false;
+    }
+    frame_time_ = CAN_FRAME_BITS / bit_rate;
+    puck_latency_ = puck_latency;
+    reset();
+    return true;
+}
+
+void CanBusTiming::reset() {
+    bus_free_time_ = 0;
+}
+
+double CanBusTiming::send(double time, int frames) {
+    const double start = std::max(time, bus_free_time_);
+    bus_free_time_ = start + frames * frame_time_;
+    return bus_free_time_ + puck_latency_;
+}
+
+double CanBusTiming::getFrameTime() const {
+    return frame_time_;
+}
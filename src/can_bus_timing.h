@@ -0,0 +1,64 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef CAN_BUS_TIMING_H__
+#define CAN_BUS_TIMING_H__
+
+//
+// Timing of the frames on a CAN bus, in sim time. The frames are sent one
+// after another, each of them occupies the bus for CAN_FRAME_BITS bit times;
+// a frame sent while the bus is busy waits until the previous frames are
+// transmitted. The receiving puck reacts puck_latency after the last frame.
+//
+// the bits of a standard frame with 8 data bytes, with the interframe space
+// and the typical number of stuff bits
+#define CAN_FRAME_BITS  125
+
+class CanBusTiming {
+public:
+    CanBusTiming();
+
+    // non-RT
+    bool configure(double bit_rate, double puck_latency);
+
+    // forgets the frames sent so far
+    void reset();
+
+    // RT, sends the given number of frames at time; returns the time when
+    // the receiver reacts to them
+    double send(double time, int frames);
+
+    double getFrameTime() const;
+
+protected:
+    double frame_time_;
+    double puck_latency_;
+    double bus_free_time_;
+};
+
+#endif  // CAN_BUS_TIMING_H__
@@ -0,0 +1,203 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "ft_gage_emulator.h"
+
+#include <cmath>
+#include <limits>
+
+FtGageEmulator::FtGageEmulator()
+    : internal_period_(1.0/28000.0)
+    , oversampling_(1)
+    , history_index_(0)
+    , phase_(0)
+    , initialized_(false)
+    , prev_time_(0)
+    , next_sample_time_(0)
+    , sample_counter_(0)
+{
+    calibration_inv_.setIdentity();
+    bias_.setZero();
+    prev_ft_.setZero();
+    pending_.n_samples = 0;
+    pending_.n_dropped = 0;
+    for (int i = 0; i < 6; ++i) {
+        last_sample_.gage[i] = 0;
+    }
+    last_sample_.status = 0;
+    last_sample_.counter = 0;
+}
+
+bool FtGageEmulator::configure(const Matrix66d &calibration, const Vector6d &bias, double output_rate,
+                                int oversampling, int fir_taps) {
+    if (output_rate <= 0 || oversampling < 1 || fir_taps < 1) {
+        return false;
+    }
+
+    Eigen::FullPivLU<Matrix66d > lu(calibration);
+    if (!lu.isInvertible()) {
+        return false;
+    }
+    calibration_inv_ = lu.inverse();
+    bias_ = bias;
+
+    oversampling_ = oversampling;
+    internal_period_ = 1.0 / (output_rate * oversampling);
+
+    // windowed-sinc low-pass with the cutoff at 0.4 of the output rate
+    // (below the output Nyquist frequency), normalized to the unit DC gain
+    fir_.resize(fir_taps);
+    const double fc = 0.4 / oversampling;
+    double sum = 0;
+    for (int i = 0; i < fir_taps; ++i) {
+        double n = i - (fir_taps - 1) / 2.0;
+        double sinc = (std::fabs(n) < 1e-9) ? (2.0 * fc) : (std::sin(2.0 * M_PI * fc * n) / (M_PI * n));
+        double window = (fir_taps == 1) ? 1.0 : (0.54 - 0.46 * std::cos(2.0 * M_PI * i / (fir_taps - 1)));
+        fir_[i] = sinc * window;
+        sum += fir_[i];
+    }
+    for (int i = 0; i < fir_taps; ++i) {
+        fir_[i] /= sum;
+    }
+
+    history_.resize(fir_taps);
+    reset();
+
+    return true;
+}
+
+void FtGageEmulator::reset() {
+    for (int i = 0; i < history_.size(); ++i) {
+        history_[i].setZero();
+    }
+    history_index_ = 0;
+    phase_ = 0;
+    initialized_ = false;
+}
+
+double FtGageEmulator::getInternalRate() const {
+    return 1.0 / internal_period_;
+}
+
+const FtGageSample& FtGageEmulator::getLastSample() const {
+    return last_sample_;
+}
+
+void FtGageEmulator::addWrench(double time, const Vector6d &ft) {
+    if (history_.empty()) {
+        return;
+    }
+
+    // the first sample, or the simulation was reset or stalled for a long time
+    if (!initialized_ || time < prev_time_ || time - prev_time_ > 1.0) {
+        reset();
+        for (int i = 0; i < history_.size(); ++i) {
+            history_[i] = ft;
+        }
+        prev_ft_ = ft;
+        prev_time_ = time;
+        next_sample_time_ = time + internal_period_;
+        initialized_ = true;
+        return;
+    }
+
+    const double dt = time - prev_time_;
+    if (dt <= 0) {
+        return;
+    }
+
+    while (next_sample_time_ <= time) {
+        const double a = (next_sample_time_ - prev_time_) / dt;
+        pushInternalSample(prev_ft_ + a * (ft - prev_ft_));
+        next_sample_time_ += internal_period_;
+    }
+
+    prev_ft_ = ft;
+    prev_time_ = time;
+}
+
+void FtGageEmulator::pushInternalSample(const Vector6d &ft) {
+    history_[history_index_] = ft;
+    history_index_ = (history_index_ + 1) % history_.size();
+
+    // decimation: the filter is evaluated only for the output samples
+    ++phase_;
+    if (phase_ < oversampling_) {
+        return;
+    }
+    phase_ = 0;
+
+    Vector6d filtered = Vector6d::Zero();
+    int idx = history_index_;
+    for (int i = 0; i < fir_.size(); ++i) {
+        filtered += fir_[i] * history_[idx];
+        idx = (idx + 1) % history_.size();
+    }
+    pushOutputSample(filtered);
+}
+
+void FtGageEmulator::pushOutputSample(const Vector6d &ft) {
+    // the filter has the unit DC gain, so the calibration may be applied
+    // after filtering
+    Vector6d gage = calibration_inv_ * ft + bias_;
+
+    FtGageSample sample;
+    for (int i = 0; i < 6; ++i) {
+        // quantization and saturation of the ADC
+        double g = std::floor(gage(i) + 0.5);
+        if (g > std::numeric_limits<int32_t >::max()) {
+            g = std::numeric_limits<int32_t >::max();
+        }
+        else if (g < std::numeric_limits<int32_t >::min()) {
+            g = std::numeric_limits<int32_t >::min();
+        }
+        sample.gage[i] = static_cast<int32_t >(g);
+    }
+    sample.status = 0;
+    sample.counter = sample_counter_++;
+
+    if (pending_.n_samples == FT_GAGE_BURST_MAX) {
+        // the reader is too slow - drop the oldest sample
+        for (int i = 1; i < FT_GAGE_BURST_MAX; ++i) {
+            pending_.samples[i-1] = pending_.samples[i];
+        }
+        --pending_.n_samples;
+        ++pending_.n_dropped;
+    }
+    pending_.samples[pending_.n_samples++] = sample;
+    last_sample_ = sample;
+}
+
+void FtGageEmulator::takeBurst(FtGageBurst &burst) {
+    burst.n_samples = pending_.n_samples;
+    burst.n_dropped = pending_.n_dropped;
+    for (int i = 0; i < pending_.n_samples; ++i) {
+        burst.samples[i] = pending_.samples[i];
+    }
+    pending_.n_samples = 0;
+    pending_.n_dropped = 0;
+}
@@ -0,0 +1,108 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef FT_GAGE_EMULATOR_H__
+#define FT_GAGE_EMULATOR_H__
+
+#include <stdint.h>
+#include <vector>
+
+#include "Eigen/Dense"
+
+// must match the size of samples in msg/FtGageBurst.msg
+#define FT_GAGE_BURST_MAX   64
+
+struct FtGageSample {
+    int32_t gage[6];
+    uint32_t status;
+    uint32_t counter;
+};
+
+// All gage samples produced since the previous read of the controller.
+struct FtGageBurst {
+    uint32_t n_samples;
+    uint32_t n_dropped;
+    FtGageSample samples[FT_GAGE_BURST_MAX];
+};
+
+//
+// Emulation of ATI gage-level output. The wrench measured once per physics
+// step is linearly interpolated to the internal (oversampled) rate,
+// low-pass filtered with the anti-aliasing FIR, decimated to the output rate
+// and converted to gage counts using the inverse of the calibration matrix.
+//
+class FtGageEmulator {
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    typedef Eigen::Matrix<double, 6, 1> Vector6d;
+    typedef Eigen::Matrix<double, 6, 6> Matrix66d;
+
+    FtGageEmulator();
+
+    // non-RT
+    // calibration maps gages (bias removed) to the wrench [N, Nm]: ft = C * (g - b)
+    bool configure(const Matrix66d &calibration, const Vector6d &bias, double output_rate,
+                    int oversampling, int fir_taps);
+
+    // RT, called once per physics step with the wrench in the sensor frame
+    void addWrench(double time, const Vector6d &ft);
+
+    // RT, moves all pending samples to burst
+    void takeBurst(FtGageBurst &burst);
+
+    const FtGageSample& getLastSample() const;
+
+    double getInternalRate() const;
+
+protected:
+    void reset();
+    void pushInternalSample(const Vector6d &ft);
+    void pushOutputSample(const Vector6d &ft);
+
+    Matrix66d calibration_inv_;
+    Vector6d bias_;
+
+    double internal_period_;
+    int oversampling_;
+
+    std::vector<double > fir_;
+    std::vector<Vector6d, Eigen::aligned_allocator<Vector6d > > history_;
+    int history_index_;
+    int phase_;
+
+    bool initialized_;
+    double prev_time_;
+    double next_sample_time_;
+    Vector6d prev_ft_;
+
+    FtGageBurst pending_;
+    FtGageSample last_sample_;
+    uint32_t sample_counter_;
+};
+
+#endif  // FT_GAGE_EMULATOR_H__
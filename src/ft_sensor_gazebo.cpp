@@ -26,7 +26,11 @@
 */
 
 #include "ft_sensor_gazebo.h"
+#include "sim_physics_gazebo.h"
+#include "robot_state_export.h"
 #include <rtt/Logger.hpp>
+#include "allocation_audit.h"
+#include "step_monitor.h"
 
 using namespace RTT;
 
@@ -48,8 +52,11 @@ bool FtSensorGazebo::gazeboConfigureHook(gazebo::physics::ModelPtr model) {
         return false;
     }
 
+    return simConfigureHook(SimModelPtr(new GazeboSimModel(model)));
+}
+
+bool FtSensorGazebo::simConfigureHook(SimModelPtr model) {
     model_ = model;
-    
     return true;
 }
 
@@ -57,26 +64,41 @@ bool FtSensorGazebo::gazeboConfigureHook(gazebo::physics::ModelPtr model) {
 // Update the controller
 void FtSensorGazebo::gazeboUpdateHook(gazebo::physics::ModelPtr model)
 {
+    simUpdateHook();
+}
+
+void FtSensorGazebo::simUpdateHook()
+{
+    VELMA_SIM_RT_SCOPE("FtSensorGazebo::simUpdateHook");
+    VELMA_SIM_HOOK_TIMER();
+
+    // Synchronize with configureHook() and updateHook()
+    RTT::os::MutexLock lock(gazebo_mutex_);
+
     if (joint_.get() == NULL) {
         return;
     }
-    ignition::math::Vector3d force = joint_->LinkForce(0);
-    ignition::math::Vector3d torque = joint_->LinkTorque(0);
+    SimVector3 force, torque;
+    joint_->getLinkWrench(force, torque);
 
-    KDL::Wrench wr_W = KDL::Wrench(-KDL::Vector(force.X(), force.Y(), force.Z()), -KDL::Vector(torque.X(), torque.Y(), torque.Z()));
+    KDL::Wrench wr_W = KDL::Wrench(-KDL::Vector(force.x, force.y, force.z), -KDL::Vector(torque.x, torque.y, torque.z));
     KDL::Wrench wr_S = (T_W_S_.Inverse() * wr_W);
 
-    {
-        RTT::os::MutexLock lock(gazebo_mutex_);
-        // TODO: data conversion:
-        double mult = 1000000.0;
-        FxGage0_out_ = wr_S.force.x() * mult;
-        FyGage1_out_ = wr_S.force.y() * mult;
-        FzGage2_out_ = wr_S.force.z() * mult;
-        TxGage3_out_ = wr_S.torque.x() * mult;
-        TyGage4_out_ = wr_S.torque.y() * mult;
-        TzGage5_out_ = wr_S.torque.z() * mult;
-        data_valid_ = true;
+    FtGageEmulator::Vector6d ft;
+    ft << wr_S.force.x(), wr_S.force.y(), wr_S.force.z(), wr_S.torque.x(), wr_S.torque.y(), wr_S.torque.z();
+
+    gage_emulator_.addWrench(model_->getSimTime(), ft);
+    data_valid_ = true;
+
+    // the state of the whole robot, written to the shared memory at the end of the step
+    if (state_side_ >= 0) {
+        velma_sim_gazebo::RobotStateShmData *state = RobotStateExport::getInstance().getState();
+        for (int i = 0; i < 3; ++i) {
+            state->ft[state_side_].force[i] = ft(i);
+            state->ft[state_side_].torque[i] = ft(i + 3);
+        }
+        state->updated |= (state_side_ == velma_sim_gazebo::ROBOT_STATE_SHM_RIGHT)
+            ? velma_sim_gazebo::ROBOT_STATE_SHM_RIGHT_FT : velma_sim_gazebo::ROBOT_STATE_SHM_LEFT_FT;
     }
 }
 
@@ -38,10 +38,16 @@
 #include <rtt/TaskContext.hpp>
 
 #include <geometry_msgs/Wrench.h>
+#include <velma_sim_gazebo/FtGageBurst.h>
+
+#include "ft_gage_emulator.h"
+#include "sim_physics.h"
 
 class FtSensorGazebo : public RTT::TaskContext
 {
 public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
     int32_t FxGage0_out_;
     int32_t FyGage1_out_;
     int32_t FzGage2_out_;
@@ -60,6 +66,9 @@ public:
     RTT::OutputPort<uint32_t > port_StatusCode_out_;
     RTT::OutputPort<uint32_t > port_SampleCounter_out_;
 
+    velma_sim_gazebo::FtGageBurst GageBurst_out_;
+    RTT::OutputPort<velma_sim_gazebo::FtGageBurst > port_GageBurst_out_;
+
     RTT::InputPort<uint32_t > port_Control1_in_;
     RTT::InputPort<uint32_t > port_Control2_in_;
 
@@ -69,9 +78,14 @@ public:
     void updateHook();
     bool startHook();
     bool configureHook();
+    void cleanupHook();
     bool gazeboConfigureHook(gazebo::physics::ModelPtr model);
     void gazeboUpdateHook(gazebo::physics::ModelPtr model);
 
+    // the hooks without Gazebo, called by the hooks above
+    bool simConfigureHook(SimModelPtr model);
+    void simUpdateHook();
+
   protected:
 
     void WrenchKDLToMsg(const KDL::Wrench &in, geometry_msgs::Wrench &out) const;
@@ -80,10 +94,15 @@ public:
     std::string joint_name_;
     std::vector<double> transform_xyz_;
     std::vector<double> transform_rpy_;
+    std::vector<double> calibration_matrix_;
+    std::vector<double> gage_bias_;
+    double output_rate_;
+    int oversampling_;
+    int fir_taps_;
+    bool legacy_ports_;
 
-    gazebo::physics::ModelPtr model_;
-    gazebo::physics::JointPtr joint_;
-    gazebo::physics::LinkPtr link_;
+    SimModelPtr model_;
+    SimJointPtr joint_;
 
     std::vector<KDL::Wrench> slow_buffer_;
     std::vector<KDL::Wrench> fast_buffer_;
@@ -103,10 +122,18 @@ public:
 
     KDL::Frame T_W_S_;
 
+    FtGageEmulator gage_emulator_;
+
+    // the samples taken from gage_emulator_ in the last updateHook
+    FtGageBurst gage_burst_;
+
     //! Synchronization
     RTT::os::MutexRecursive gazebo_mutex_;
 
     bool data_valid_;
+
+    // the side of the sensor in the exported state of the robot, -1 if not exported
+    int state_side_;
 };
 
 #endif  // FT_SENSOR_GAZEBO_H__
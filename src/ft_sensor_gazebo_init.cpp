@@ -35,10 +35,22 @@ FtSensorGazebo::FtSensorGazebo(std::string const& name)
     , slow_buffer_index_(0)
     , fast_buffer_index_(0)
     , data_valid_(false)
+    , output_rate_(7000.0)
+    , oversampling_(4)
+    , fir_taps_(32)
+    , legacy_ports_(true)
+    , port_GageBurst_out_("GageBurst_OUTPORT", false)
+    , state_side_(-1)
 {
     addProperty("joint_name", joint_name_);
     addProperty("transform_xyz", transform_xyz_);
     addProperty("transform_rpy", transform_rpy_);
+    addProperty("calibration_matrix", calibration_matrix_);
+    addProperty("gage_bias", gage_bias_);
+    addProperty("output_rate", output_rate_);
+    addProperty("oversampling", oversampling_);
+    addProperty("fir_taps", fir_taps_);
+    addProperty("legacy_ports", legacy_ports_);
 
     // Add required gazebo interfaces
     this->provides("gazebo")->addOperation("configure",&FtSensorGazebo::gazeboConfigureHook,this,RTT::ClientThread);
@@ -52,12 +64,19 @@ FtSensorGazebo::FtSensorGazebo(std::string const& name)
     this->ports()->addPort("TzGage5_OUTPORT", port_TzGage5_out_);
     this->ports()->addPort("StatusCode_OUTPORT", port_StatusCode_out_);
     this->ports()->addPort("SampleCounter_OUTPORT", port_SampleCounter_out_);
+    this->ports()->addPort(port_GageBurst_out_);
 
     this->ports()->addPort("Control1_INPORT", port_Control1_in_);
     this->ports()->addPort("Control2_INPORT", port_Control2_in_);
 
     slow_buffer_.resize(slow_buffer_size_);
     fast_buffer_.resize(fast_buffer_size_);
+
+    gage_burst_.n_samples = 0;
+    gage_burst_.n_dropped = 0;
+    GageBurst_out_.n_samples = 0;
+    GageBurst_out_.n_dropped = 0;
+    port_GageBurst_out_.setDataSample(GageBurst_out_);
 }
 
 FtSensorGazebo::~FtSensorGazebo() {
@@ -26,49 +26,98 @@
 */
 
 #include "ft_sensor_gazebo.h"
+#include "startup_coordinator.h"
+#include "robot_state_export.h"
 #include <rtt/Logger.hpp>
+#include "allocation_audit.h"
 
 using namespace RTT;
 
 void FtSensorGazebo::updateHook() {
-    // Synchronize with gazeboUpdate()
-    RTT::os::MutexLock lock(gazebo_mutex_);
-
-    if (!data_valid_) {
-        return;
+    VELMA_SIM_RT_SCOPE("FtSensorGazebo::updateHook");
+    FtGageSample last_sample;
+    {
+        // Synchronize with gazeboUpdate()
+        RTT::os::MutexLock lock(gazebo_mutex_);
+
+        if (!data_valid_) {
+            return;
+        }
+
+        gage_emulator_.takeBurst(gage_burst_);
+        last_sample = gage_emulator_.getLastSample();
     }
 
     uint32_t Control1 = 0, Control2 = 0;
     port_Control1_in_.read(Control1);
     port_Control2_in_.read(Control2);
 
-    port_FxGage0_out_.write(FxGage0_out_);
-    port_FyGage1_out_.write(FyGage1_out_);
-    port_FzGage2_out_.write(FzGage2_out_);
-    port_TxGage3_out_.write(TxGage3_out_);
-    port_TyGage4_out_.write(TyGage4_out_);
-    port_TzGage5_out_.write(TzGage5_out_);
-
-    StatusCode_out_ = 0;    // TODO
-    port_StatusCode_out_.write(StatusCode_out_);
-    port_SampleCounter_out_.write(SampleCounter_out_);
-    ++SampleCounter_out_;
+    // the burst carries the gages, the status and the counter of each sample
+    GageBurst_out_.n_samples = gage_burst_.n_samples;
+    GageBurst_out_.n_dropped = gage_burst_.n_dropped;
+    for (uint32_t i = 0; i < gage_burst_.n_samples; ++i) {
+        const FtGageSample &s = gage_burst_.samples[i];
+        velma_sim_gazebo::FtGageSample &out = GageBurst_out_.samples[i];
+        for (int j = 0; j < 6; ++j) {
+            out.gage[j] = s.gage[j];
+        }
+        out.status = s.status;
+        out.counter = s.counter;
+    }
+    port_GageBurst_out_.write(GageBurst_out_);
+
+    if (legacy_ports_) {
+        // the most recent sample for the per-gage ports
+        FxGage0_out_ = last_sample.gage[0];
+        FyGage1_out_ = last_sample.gage[1];
+        FzGage2_out_ = last_sample.gage[2];
+        TxGage3_out_ = last_sample.gage[3];
+        TyGage4_out_ = last_sample.gage[4];
+        TzGage5_out_ = last_sample.gage[5];
+        StatusCode_out_ = last_sample.status;
+        SampleCounter_out_ = last_sample.counter;
+
+        port_FxGage0_out_.write(FxGage0_out_);
+        port_FyGage1_out_.write(FyGage1_out_);
+        port_FzGage2_out_.write(FzGage2_out_);
+        port_TxGage3_out_.write(TxGage3_out_);
+        port_TyGage4_out_.write(TyGage4_out_);
+        port_TzGage5_out_.write(TzGage5_out_);
+        port_StatusCode_out_.write(StatusCode_out_);
+        port_SampleCounter_out_.write(SampleCounter_out_);
+    }
 }
 
 bool FtSensorGazebo::startHook() {
     return true;
 }
 
+void FtSensorGazebo::cleanupHook() {
+    {
+        // Synchronize with gazeboUpdate()
+        RTT::os::MutexLock lock(gazebo_mutex_);
+        joint_.reset();
+        state_side_ = -1;
+        data_valid_ = false;
+    }
+    RobotStateExport::getInstance().release(getName());
+}
+
 bool FtSensorGazebo::configureHook() {
     Logger::In in("FtSensorGazebo::configureHook");
+    StartupCoordinator::ScopedPhase phase(getName(), "configure");
 
-    joint_ = model_->GetJoint(joint_name_);
-    if (joint_.get() == NULL) {
-        Logger::log() << Logger::Error << "could not find joint \"" << joint_name_ << "\"" << Logger::endl;
+    if (model_.get() == NULL) {
+        Logger::log() << Logger::Error << "the model is NULL" << Logger::endl;
         return false;
     }
 
-    link_ = joint_->GetJointLink(0);
+    // the joint is published to simUpdateHook only after the whole setup succeeded
+    SimJointPtr joint = model_->getJoint(joint_name_);
+    if (joint.get() == NULL) {
+        Logger::log() << Logger::Error << "could not find joint \"" << joint_name_ << "\"" << Logger::endl;
+        return false;
+    }
 
     if (transform_xyz_.size() != 3) {
         Logger::log() << Logger::Error << "wrong transform_xyz: vector size is " << transform_xyz_.size() << ", should be 3" << Logger::endl;
@@ -80,7 +129,53 @@ bool FtSensorGazebo::configureHook() {
         return false;
     }
 
-    T_W_S_ = KDL::Frame(KDL::Rotation::RPY(transform_rpy_[0], transform_rpy_[1], transform_rpy_[2]), KDL::Vector(transform_xyz_[0], transform_xyz_[1], transform_xyz_[2]));
+    KDL::Frame T_W_S = KDL::Frame(KDL::Rotation::RPY(transform_rpy_[0], transform_rpy_[1], transform_rpy_[2]), KDL::Vector(transform_xyz_[0], transform_xyz_[1], transform_xyz_[2]));
+
+    // by default, gages are scaled by 1000000 with no bias
+    FtGageEmulator::Matrix66d calibration = FtGageEmulator::Matrix66d::Identity() * 0.000001;
+    if (!calibration_matrix_.empty()) {
+        if (calibration_matrix_.size() != 36) {
+            Logger::log() << Logger::Error << "wrong calibration_matrix: vector size is " << calibration_matrix_.size() << ", should be 36" << Logger::endl;
+            return false;
+        }
+        for (int i = 0; i < 6; ++i) {
+            for (int j = 0; j < 6; ++j) {
+                calibration(i, j) = calibration_matrix_[i * 6 + j];
+            }
+        }
+    }
+
+    FtGageEmulator::Vector6d bias = FtGageEmulator::Vector6d::Zero();
+    if (!gage_bias_.empty()) {
+        if (gage_bias_.size() != 6) {
+            Logger::log() << Logger::Error << "wrong gage_bias: vector size is " << gage_bias_.size() << ", should be 6" << Logger::endl;
+            return false;
+        }
+        for (int i = 0; i < 6; ++i) {
+            bias(i) = gage_bias_[i];
+        }
+    }
+
+    {
+        // Synchronize with gazeboUpdate()
+        RTT::os::MutexLock lock(gazebo_mutex_);
+
+        if (!gage_emulator_.configure(calibration, bias, output_rate_, oversampling_, fir_taps_)) {
+            Logger::log() << Logger::Error << "could not configure gage emulation: calibration_matrix must be invertible, output_rate > 0, oversampling >= 1, fir_taps >= 1" << Logger::endl;
+            return false;
+        }
+        T_W_S_ = T_W_S;
+        data_valid_ = false;
+        joint_ = joint;
+    }
+
+    Logger::log() << Logger::Info << "gage output rate: " << output_rate_ << " Hz, internal rate: " << gage_emulator_.getInternalRate() << " Hz" << Logger::endl;
+
+    // the last step, so that no error path leaves the registration behind
+    if (RobotStateExport::getInstance().acquire(getName())) {
+        RTT::os::MutexLock lock(gazebo_mutex_);
+        state_side_ = RobotStateExport::getSide(joint_name_);
+    }
 
     return true;
 }
@@ -0,0 +1,125 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "imu_preintegrator.h"
+
+static Eigen::Matrix3d skew(const Eigen::Vector3d &v) {
+    Eigen::Matrix3d m;
+    m <<    0, -v(2),  v(1),
+         v(2),     0, -v(0),
+        -v(1),  v(0),     0;
+    return m;
+}
+
+// right Jacobian of SO(3)
+static Eigen::Matrix3d rightJacobian(const Eigen::Vector3d &phi) {
+    const double theta = phi.norm();
+    const Eigen::Matrix3d W = skew(phi);
+    if (theta < 1e-6) {
+        return Eigen::Matrix3d::Identity() - 0.5 * W;
+    }
+    const double theta2 = theta * theta;
+    return Eigen::Matrix3d::Identity() - (1.0 - std::cos(theta)) / theta2 * W
+            + (theta - std::sin(theta)) / (theta2 * theta) * W * W;
+}
+
+ImuPreintegrator::ImuPreintegrator()
+    : gyro_var_(0.0)
+    , accel_var_(0.0)
+{
+    reset();
+}
+
+void ImuPreintegrator::setNoise(double gyro_noise_density, double accel_noise_density) {
+    gyro_var_ = gyro_noise_density * gyro_noise_density;
+    accel_var_ = accel_noise_density * accel_noise_density;
+}
+
+void ImuPreintegrator::reset() {
+    dR_.setIdentity();
+    dv_.setZero();
+    dp_.setZero();
+    cov_.setZero();
+    dR_dbg_.setZero();
+    dv_dbg_.setZero();
+    dv_dba_.setZero();
+    dp_dbg_.setZero();
+    dp_dba_.setZero();
+    dt_ = 0.0;
+    n_samples_ = 0;
+}
+
+void ImuPreintegrator::integrate(const Eigen::Vector3d &w, const Eigen::Vector3d &a, double dt) {
+    if (dt <= 0.0) {
+        return;
+    }
+
+    const Eigen::Vector3d phi = w * dt;
+    const double angle = phi.norm();
+    Eigen::Quaterniond dR_inc;
+    if (angle < 1e-12) {
+        dR_inc.setIdentity();
+    }
+    else {
+        dR_inc = Eigen::Quaterniond(Eigen::AngleAxisd(angle, phi / angle));
+    }
+    const Eigen::Matrix3d R_inc = dR_inc.toRotationMatrix();
+    const Eigen::Matrix3d R = dR_.toRotationMatrix();
+    const Eigen::Matrix3d Jr = rightJacobian(phi);
+    const Eigen::Matrix3d R_ax = R * skew(a);
+    const double dt2 = dt * dt;
+
+    // covariance propagation, the noise of the discrete samples is density^2 / dt
+    Matrix99d A = Matrix99d::Identity();
+    A.block<3,3>(0,0) = R_inc.transpose();
+    A.block<3,3>(3,0) = -R_ax * dt;
+    A.block<3,3>(6,0) = -0.5 * R_ax * dt2;
+    A.block<3,3>(6,3) = Eigen::Matrix3d::Identity() * dt;
+    Eigen::Matrix<double, 9, 3> B = Eigen::Matrix<double, 9, 3>::Zero();
+    Eigen::Matrix<double, 9, 3> C = Eigen::Matrix<double, 9, 3>::Zero();
+    B.block<3,3>(0,0) = Jr * dt;
+    C.block<3,3>(3,0) = R * dt;
+    C.block<3,3>(6,0) = 0.5 * R * dt2;
+    cov_ = A * cov_ * A.transpose() + (gyro_var_ / dt) * B * B.transpose()
+            + (accel_var_ / dt) * C * C.transpose();
+
+    // bias Jacobians, position and velocity use the rotation Jacobian from before the step
+    dp_dba_ += dv_dba_ * dt - 0.5 * R * dt2;
+    dp_dbg_ += dv_dbg_ * dt - 0.5 * R_ax * dR_dbg_ * dt2;
+    dv_dba_ -= R * dt;
+    dv_dbg_ -= R_ax * dR_dbg_ * dt;
+    dR_dbg_ = R_inc.transpose() * dR_dbg_ - Jr * dt;
+
+    // deltas
+    const Eigen::Vector3d acc = R * a;
+    dp_ += dv_ * dt + 0.5 * acc * dt2;
+    dv_ += acc * dt;
+    dR_ = (dR_ * dR_inc).normalized();
+
+    dt_ += dt;
+    ++n_samples_;
+}
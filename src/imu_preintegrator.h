@@ -0,0 +1,87 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef IMU_PREINTEGRATOR_H__
+#define IMU_PREINTEGRATOR_H__
+
+#include "Eigen/Dense"
+
+//
+// IMU preintegration on the manifold (Forster et al., "On-Manifold
+// Preintegration for Real-Time Visual-Inertial Odometry"). Angular velocity
+// and specific force are integrated into the relative rotation, velocity and
+// position in the body frame at the start of the window. Gravity is not
+// removed and the biases are assumed zero; the Jacobians w.r.t. the biases
+// allow the consumer to correct the deltas for its bias estimates.
+// The covariance is of the error state [rotation, velocity, position].
+//
+class ImuPreintegrator {
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    typedef Eigen::Matrix<double, 9, 9> Matrix99d;
+
+    ImuPreintegrator();
+
+    // noise densities: gyro [rad/s/sqrt(Hz)], accelerometer [m/s^2/sqrt(Hz)]
+    void setNoise(double gyro_noise_density, double accel_noise_density);
+
+    void reset();
+
+    // integrates the measurement over dt seconds
+    void integrate(const Eigen::Vector3d &w, const Eigen::Vector3d &a, double dt);
+
+    const Eigen::Quaterniond& getDeltaRotation() const { return dR_; }
+    const Eigen::Vector3d& getDeltaVelocity() const { return dv_; }
+    const Eigen::Vector3d& getDeltaPosition() const { return dp_; }
+    const Matrix99d& getCovariance() const { return cov_; }
+    const Eigen::Matrix3d& getDRdbg() const { return dR_dbg_; }
+    const Eigen::Matrix3d& getDvdbg() const { return dv_dbg_; }
+    const Eigen::Matrix3d& getDvdba() const { return dv_dba_; }
+    const Eigen::Matrix3d& getDpdbg() const { return dp_dbg_; }
+    const Eigen::Matrix3d& getDpdba() const { return dp_dba_; }
+    double getDeltaTime() const { return dt_; }
+    int getSamplesCount() const { return n_samples_; }
+
+protected:
+    double gyro_var_;
+    double accel_var_;
+
+    Eigen::Quaterniond dR_;
+    Eigen::Vector3d dv_;
+    Eigen::Vector3d dp_;
+    Matrix99d cov_;
+    Eigen::Matrix3d dR_dbg_;
+    Eigen::Matrix3d dv_dbg_;
+    Eigen::Matrix3d dv_dba_;
+    Eigen::Matrix3d dp_dbg_;
+    Eigen::Matrix3d dp_dba_;
+    double dt_;
+    int n_samples_;
+};
+
+#endif  // IMU_PREINTEGRATOR_H__
@@ -0,0 +1,273 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "latency_trace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+#include <rtt/Logger.hpp>
+
+using namespace RTT;
+
+namespace {
+
+const char* const STAGE_NAMES[LatencyTrace::STAGES_COUNT] = {
+    "port read",
+    "mutex exchange",
+    "physics apply"
+};
+
+struct TracedEvent {
+    uint16_t channel;
+    uint32_t seq;
+    uint16_t stage;
+    uint64_t time_ns;
+
+    bool operator<(const TracedEvent &e) const {
+        if (channel != e.channel) {
+            return channel < e.channel;
+        }
+        if (seq != e.seq) {
+            return seq < e.seq;
+        }
+        if (stage != e.stage) {
+            return stage < e.stage;
+        }
+        return time_ns < e.time_ns;
+    }
+};
+
+uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t >(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+void writeEvent(FILE *f, bool &first, const char *name, int tid, uint64_t begin_ns, uint64_t end_ns, uint32_t seq) {
+    if (end_ns < begin_ns) {
+        return;
+    }
+    fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"latency\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"seq\":%u}}",
+                (first ? "" : ","), name, tid, begin_ns * 1.0e-3, (end_ns - begin_ns) * 1.0e-3, seq);
+    first = false;
+}
+
+}   // namespace
+
+LatencyTrace& LatencyTrace::getInstance() {
+    static LatencyTrace trace;
+    return trace;
+}
+
+LatencyTrace::LatencyTrace()
+    : enabled_(false)
+    , events_(NULL)
+    , mask_(0)
+    , write_index_(0)
+    , running_users_(0)
+{
+    const char *path = getenv("VELMA_SIM_LATENCY_TRACE");
+    if (!path || path[0] == 0) {
+        return;
+    }
+    path_ = path;
+
+    uint64_t size = 65536;
+    const char *size_str = getenv("VELMA_SIM_LATENCY_TRACE_SIZE");
+    if (size_str) {
+        size = std::max(1L, atol(size_str));
+    }
+    // the capacity is rounded up to a power of 2
+    uint64_t capacity = 1;
+    while (capacity < size) {
+        capacity *= 2;
+    }
+
+    events_ = new Event[capacity];
+    for (uint64_t i = 0; i < capacity; ++i) {
+        events_[i].stamp.store(0, std::memory_order_relaxed);
+    }
+    mask_ = capacity - 1;
+    enabled_ = true;
+}
+
+LatencyTrace::~LatencyTrace() {
+    // the trace is written by the components, the logger may be destroyed already
+    delete[] events_;
+}
+
+bool LatencyTrace::dump() {
+    return writeChromeTrace(path_);
+}
+
+int LatencyTrace::addChannel(const std::string &name) {
+    if (!enabled_) {
+        return -1;
+    }
+    RTT::os::MutexLock lock(channels_mutex_);
+    channels_.push_back(name);
+    return channels_.size() - 1;
+}
+
+void LatencyTrace::startUser() {
+    if (!enabled_) {
+        return;
+    }
+    RTT::os::MutexLock lock(channels_mutex_);
+    ++running_users_;
+}
+
+void LatencyTrace::stopUser() {
+    if (!enabled_) {
+        return;
+    }
+    {
+        RTT::os::MutexLock lock(channels_mutex_);
+        if (running_users_ == 0 || --running_users_ > 0) {
+            return;
+        }
+    }
+    dump();
+}
+
+void LatencyTrace::record(int channel, uint32_t seq, Stage stage) {
+    if (!enabled_ || channel < 0) {
+        return;
+    }
+    const uint64_t index = write_index_.fetch_add(1, std::memory_order_relaxed);
+    Event &e = events_[index & mask_];
+    e.stamp.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    e.time_ns = nowNs();
+    e.seq = seq;
+    e.channel = channel;
+    e.stage = stage;
+    e.stamp.store(index + 1, std::memory_order_release);
+}
+
+bool LatencyTrace::writeChromeTrace(const std::string &path) {
+    if (!enabled_) {
+        return false;
+    }
+
+    // the events that are overwritten or written at the moment are skipped
+    const uint64_t end = write_index_.load(std::memory_order_acquire);
+    const uint64_t begin = (end > mask_ + 1) ? (end - mask_ - 1) : 0;
+    std::vector<TracedEvent > events;
+    events.reserve(end - begin);
+    for (uint64_t index = begin; index < end; ++index) {
+        const Event &e = events_[index & mask_];
+        if (e.stamp.load(std::memory_order_acquire) != index + 1) {
+            continue;
+        }
+        TracedEvent te;
+        te.channel = e.channel;
+        te.seq = e.seq;
+        te.stage = e.stage;
+        te.time_ns = e.time_ns;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (e.stamp.load(std::memory_order_relaxed) != index + 1) {
+            continue;
+        }
+        events.push_back(te);
+    }
+    std::sort(events.begin(), events.end());
+
+    std::vector<std::string > channels;
+    {
+        RTT::os::MutexLock lock(channels_mutex_);
+        channels = channels_;
+    }
+
+    Logger::In in("LatencyTrace::writeChromeTrace");
+    FILE *f = fopen(path.c_str(), "w");
+    if (!f) {
+        Logger::log() << Logger::Error << "could not write " << path << Logger::endl;
+        return false;
+    }
+
+    fprintf(f, "{\"traceEvents\":[");
+    bool first = true;
+    for (int i = 0; i < channels.size(); ++i) {
+        fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                (first ? "" : ","), i, channels[i].c_str());
+        first = false;
+    }
+
+    // every command is an event from the first to the last recorded stage,
+    // with nested events for the intervals between the stages
+    for (size_t i = 0; i < events.size(); ) {
+        size_t j = i;
+        uint64_t stage_time[STAGES_COUNT];
+        bool stage_valid[STAGES_COUNT] = {false};
+        for ( ; j < events.size() && events[j].channel == events[i].channel && events[j].seq == events[i].seq; ++j) {
+            if (!stage_valid[events[j].stage]) {
+                stage_valid[events[j].stage] = true;
+                stage_time[events[j].stage] = events[j].time_ns;
+            }
+        }
+
+        int first_stage = -1;
+        int last_stage = -1;
+        for (int s = 0; s < STAGES_COUNT; ++s) {
+            if (stage_valid[s]) {
+                if (first_stage < 0) {
+                    first_stage = s;
+                }
+                last_stage = s;
+            }
+        }
+        if (first_stage != last_stage) {
+            writeEvent(f, first, "command", events[i].channel, stage_time[first_stage], stage_time[last_stage],
+                        events[i].seq);
+        }
+
+        int prev = -1;
+        for (int s = 0; s < STAGES_COUNT; ++s) {
+            if (!stage_valid[s]) {
+                continue;
+            }
+            if (prev < 0) {
+                prev = s;
+                continue;
+            }
+            writeEvent(f, first, STAGE_NAMES[s], events[i].channel, stage_time[prev], stage_time[s], events[i].seq);
+            prev = s;
+        }
+        i = j;
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+
+    Logger::log() << Logger::Info << "saved " << events.size() << " events in " << path << Logger::endl;
+    return true;
+}
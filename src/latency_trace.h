@@ -0,0 +1,107 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef LATENCY_TRACE_H__
+#define LATENCY_TRACE_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <rtt/os/Mutex.hpp>
+
+//
+// Timestamps of the commands on their way from the input ports to the
+// physics step. The command messages of the io_buffers have no sequence
+// number or timestamp, so every component numbers the commands when it
+// reads them from the port and records the stages of each command in a
+// lock-free ring; the ring is written as a Chrome trace (chrome://tracing,
+// Perfetto) when the last running traced component is stopped, or on demand.
+// Tracing is enabled by the VELMA_SIM_LATENCY_TRACE environment variable,
+// which is the path of the trace file; VELMA_SIM_LATENCY_TRACE_SIZE is
+// the capacity of the ring (default 65536 events).
+//
+class LatencyTrace {
+public:
+    enum Stage {
+        STAGE_READ = 0,     // the command is read from the port
+        STAGE_EXCHANGE,     // the command is copied to the physics thread
+        STAGE_APPLY,        // the command is applied in the physics step
+        STAGES_COUNT
+    };
+
+    static LatencyTrace& getInstance();
+
+    ~LatencyTrace();
+
+    bool isEnabled() const {
+        return enabled_;
+    }
+
+    // non-RT, returns -1 if tracing is disabled
+    int addChannel(const std::string &name);
+
+    // non-RT, called in startHook and stopHook of the traced components;
+    // the trace is written when the last started component is stopped
+    void startUser();
+    void stopUser();
+
+    // RT, lock-free; seq is the number of the command in the channel
+    void record(int channel, uint32_t seq, Stage stage);
+
+    // non-RT, the events in the ring are written as a Chrome trace
+    bool writeChromeTrace(const std::string &path);
+
+    // non-RT, writes the trace to the file set in VELMA_SIM_LATENCY_TRACE
+    bool dump();
+
+protected:
+    LatencyTrace();
+
+    struct Event {
+        std::atomic<uint64_t> stamp;    // index + 1 of the event, 0 while written
+        uint64_t time_ns;
+        uint32_t seq;
+        uint16_t channel;
+        uint16_t stage;
+    };
+
+    bool enabled_;
+    std::string path_;
+
+    Event *events_;
+    uint64_t mask_;
+    std::atomic<uint64_t> write_index_;
+
+    RTT::os::Mutex channels_mutex_;
+    std::vector<std::string > channels_;
+    int running_users_;
+};
+
+#endif  // LATENCY_TRACE_H__
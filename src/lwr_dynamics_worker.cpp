@@ -0,0 +1,194 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "lwr_dynamics_worker.h"
+
+#include <algorithm>
+
+ArmDynamics::ArmDynamics(gazebo::physics::ModelPtr model, const std::vector<gazebo::physics::JointPtr > &joints,
+                            double tool_mass, const ignition::math::Vector3d &tool_cog, double tool_IXX, double tool_IXY,
+                            double tool_IXZ, double tool_IYY, double tool_IYZ, double tool_IZZ)
+    : model_(model)
+    , joints_(joints)
+    , tool_mass_(tool_mass)
+    , tool_cog_(tool_cog)
+    , mm_(model, joints.front()->GetScopedName(), joints.back()->GetScopedName(), tool_mass, tool_cog,
+            tool_IXX, tool_IXY, tool_IXZ, tool_IYY, tool_IYZ, tool_IZZ)
+    , mass_matrix_(Eigen::MatrixXd::Zero(joints.size(), joints.size()))
+    , grav_(Eigen::VectorXd::Zero(joints.size()))
+{
+    for (int i = 0; i < joints_.size(); ++i) {
+        links_.push_back(joints_[i]->GetChild());
+    }
+}
+
+void ArmDynamics::setToolInertia(double tool_mass, const ignition::math::Vector3d &tool_cog, double tool_IXX, double tool_IXY,
+                            double tool_IXZ, double tool_IYY, double tool_IYZ, double tool_IZZ) {
+    tool_mass_ = tool_mass;
+    tool_cog_ = tool_cog;
+    mm_.setToolInertia(tool_mass, tool_cog, tool_IXX, tool_IXY, tool_IXZ, tool_IYY, tool_IYZ, tool_IZZ);
+}
+
+int ArmDynamics::getDofs() const {
+    return joints_.size();
+}
+
+const Eigen::MatrixXd& ArmDynamics::getMassMatrix() const {
+    return mass_matrix_;
+}
+
+const Eigen::VectorXd& ArmDynamics::getGravityTorque() const {
+    return grav_;
+}
+
+manipulator_mass_matrix::Manipulator& ArmDynamics::getManipulator() {
+    return mm_;
+}
+
+void ArmDynamics::compute() {
+    updateKinematics();
+    mass_matrix_ = mm_.getMassMatrix();
+}
+
+void ArmDynamics::updateKinematics() {
+    mm_.updatePoses(model_);
+    computeGravityTorque();
+}
+
+void ArmDynamics::setBatchInput(BatchedMassMatrix &batch, int chain) const {
+    for (int i = 0; i < mm_.getDofs(); ++i) {
+        const manipulator_mass_matrix::Link &link = mm_.getLink(i);
+        // the spatial inertia is symmetric, so its storage order does not matter
+        batch.setJointAxis(chain, i, link.getJacobian().data());
+        batch.setInertia(chain, i, link.getSpatialInertia().data());
+        const Eigen::Isometry3d T = link.getRelativeTransform();
+        const Eigen::Matrix<double, 3, 3, Eigen::RowMajor> R(T.linear());
+        const Eigen::Vector3d p(T.translation());
+        batch.setRelativePose(chain, i, R.data(), p.data());
+    }
+}
+
+void ArmDynamics::getBatchOutput(const BatchedMassMatrix &batch, int chain) {
+    // the mass matrix is symmetric
+    batch.getMassMatrix(chain, mass_matrix_.data());
+}
+
+void ArmDynamics::computeGravityTorque() {
+    const ignition::math::Vector3d gr = model_->GetWorld()->Gravity();
+    const int n = joints_.size();
+
+    // the tool is attached to the last link
+    ignition::math::Vector3d cog = links_[n-1]->WorldPose().CoordPositionAdd(tool_cog_);
+    double mass = tool_mass_;
+    ignition::math::Vector3d r = cog - joints_[n-1]->WorldPose().Pos();
+    grav_(n-1) = -joints_[n-1]->GlobalAxis(0).Dot(r.Cross(mass * gr));
+
+    for (int i = n-1; i > 0; i--) {
+        const gazebo::physics::LinkPtr &link = links_[i-1];
+        const double link_mass = link->GetInertial()->Mass();
+        cog = (cog * mass + link->WorldCoGPose().Pos() * link_mass) / (mass + link_mass);
+        mass += link_mass;
+        r = cog - joints_[i-1]->WorldPose().Pos();
+        grav_(i-1) = -joints_[i-1]->GlobalAxis(0).Dot(r.Cross(mass * gr));
+    }
+}
+
+LWRDynamicsWorker& LWRDynamicsWorker::getInstance() {
+    static LWRDynamicsWorker worker;
+    return worker;
+}
+
+LWRDynamicsWorker::LWRDynamicsWorker()
+    : last_iteration_(0)
+    , updated_(false)
+{
+}
+
+void LWRDynamicsWorker::registerArm(ArmDynamics *arm) {
+    RTT::os::MutexLock lock(mutex_);
+    if (std::find(arms_.begin(), arms_.end(), arm) == arms_.end()) {
+        arms_.push_back(arm);
+    }
+    updateBatches();
+    // the new arm is computed in the next update
+    updated_ = false;
+}
+
+void LWRDynamicsWorker::unregisterArm(ArmDynamics *arm) {
+    RTT::os::MutexLock lock(mutex_);
+    arms_.erase(std::remove(arms_.begin(), arms_.end(), arm), arms_.end());
+    updateBatches();
+}
+
+void LWRDynamicsWorker::updateBatches() {
+    // group the arms by the number of joints
+    batches_.clear();
+    for (int i = 0; i < arms_.size(); ++i) {
+        int b = 0;
+        for (; b < batches_.size(); ++b) {
+            if (batches_[b].arms.front()->getDofs() == arms_[i]->getDofs()) {
+                break;
+            }
+        }
+        if (b == batches_.size()) {
+            batches_.push_back(Batch());
+        }
+        batches_[b].arms.push_back(arms_[i]);
+    }
+
+    // a single arm is computed in the scalar path
+    for (int b = 0; b < batches_.size(); ++b) {
+        if (batches_[b].arms.size() > 1) {
+            batches_[b].kernel.reset(new BatchedMassMatrix());
+            batches_[b].kernel->configure(batches_[b].arms.front()->getDofs(), batches_[b].arms.size());
+        }
+    }
+}
+
+void LWRDynamicsWorker::update(uint64_t iteration) {
+    RTT::os::MutexLock lock(mutex_);
+    if (updated_ && iteration == last_iteration_) {
+        return;
+    }
+    for (int b = 0; b < batches_.size(); ++b) {
+        Batch &batch = batches_[b];
+        if (!batch.kernel) {
+            batch.arms.front()->compute();
+            continue;
+        }
+        for (int i = 0; i < batch.arms.size(); ++i) {
+            batch.arms[i]->updateKinematics();
+            batch.arms[i]->setBatchInput(*batch.kernel, i);
+        }
+        batch.kernel->compute();
+        for (int i = 0; i < batch.arms.size(); ++i) {
+            batch.arms[i]->getBatchOutput(*batch.kernel, i);
+        }
+    }
+    last_iteration_ = iteration;
+    updated_ = true;
+}
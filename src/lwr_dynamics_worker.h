@@ -0,0 +1,123 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef LWR_DYNAMICS_WORKER_H__
+#define LWR_DYNAMICS_WORKER_H__
+
+#include <stdint.h>
+#include <vector>
+#include <memory>
+
+#include <gazebo/gazebo.hh>
+#include <gazebo/physics/physics.hh>
+
+#include <rtt/os/Mutex.hpp>
+
+#include "Eigen/Dense"
+
+#include "manipulator_mass_matrix.h"
+#include "batched_mass_matrix.h"
+
+//
+// Dynamics of one serial arm: the mass matrix and the gravity torques of
+// the chain, with the tool attached to the last link.
+//
+class ArmDynamics {
+public:
+    ArmDynamics(gazebo::physics::ModelPtr model, const std::vector<gazebo::physics::JointPtr > &joints,
+                            double tool_mass, const ignition::math::Vector3d &tool_cog, double tool_IXX, double tool_IXY,
+                            double tool_IXZ, double tool_IYY, double tool_IYZ, double tool_IZZ);
+
+    // RT, called by the dynamics worker once per physics step
+    void compute();
+
+    // RT, the same as compute(), but the mass matrix is computed in a batch
+    void updateKinematics();
+    void setBatchInput(BatchedMassMatrix &batch, int chain) const;
+    void getBatchOutput(const BatchedMassMatrix &batch, int chain);
+
+    // RT, the new tool is used in the next computation
+    void setToolInertia(double tool_mass, const ignition::math::Vector3d &tool_cog, double tool_IXX, double tool_IXY,
+                            double tool_IXZ, double tool_IYY, double tool_IYZ, double tool_IZZ);
+
+    int getDofs() const;
+    const Eigen::MatrixXd& getMassMatrix() const;
+    const Eigen::VectorXd& getGravityTorque() const;
+
+    manipulator_mass_matrix::Manipulator& getManipulator();
+
+protected:
+    void computeGravityTorque();
+
+    gazebo::physics::ModelPtr model_;
+    std::vector<gazebo::physics::JointPtr > joints_;
+    std::vector<gazebo::physics::LinkPtr > links_;
+    double tool_mass_;
+    ignition::math::Vector3d tool_cog_;
+
+    manipulator_mass_matrix::Manipulator mm_;
+    Eigen::MatrixXd mass_matrix_;
+    Eigen::VectorXd grav_;
+};
+
+//
+// All arms in the world are registered in one worker. The first arm
+// component that is updated in a physics step computes the dynamics of all
+// registered arms in one pass; the other components only read the results.
+// The mass matrices of arms with the same number of joints are computed
+// together in BatchedMassMatrix.
+//
+class LWRDynamicsWorker {
+public:
+    static LWRDynamicsWorker& getInstance();
+
+    // non-RT
+    void registerArm(ArmDynamics *arm);
+    void unregisterArm(ArmDynamics *arm);
+
+    // RT, computes the dynamics of all arms if it was not done in this iteration
+    void update(uint64_t iteration);
+
+protected:
+    LWRDynamicsWorker();
+
+    // non-RT, called with the mutex locked
+    void updateBatches();
+
+    struct Batch {
+        std::vector<ArmDynamics* > arms;
+        std::shared_ptr<BatchedMassMatrix > kernel;
+    };
+
+    RTT::os::Mutex mutex_;
+    std::vector<ArmDynamics* > arms_;
+    std::vector<Batch > batches_;
+    uint64_t last_iteration_;
+    bool updated_;
+};
+
+#endif  // LWR_DYNAMICS_WORKER_H__
@@ -27,67 +27,188 @@
 
 #include "lwr_gazebo.h"
 #include <rtt/Logger.hpp>
+#include "allocation_audit.h"
+#include "step_monitor.h"
 #include "velma_sim_conversion.h"
-#include <gazebo/physics/dart/DARTModel.hh>
-#include <gazebo/physics/dart/DARTJoint.hh>
+#include "sim_physics_gazebo.h"
+#include "topology_cache.h"
+#include "benchmark_motion.h"
+#include "robot_state_export.h"
 
-//#define CALCULATE_TOOL_INERTIA
-
-#ifdef CALCULATE_TOOL_INERTIA
-#include <eigen_conversions/eigen_kdl.h>
-#include <kdl/rigidbodyinertia.hpp>
-#endif
+#include <algorithm>
 
 using namespace RTT;
 
+static SimInertia toSimInertia(const geometry_msgs::Inertia &in) {
+    SimInertia result;
+    result.mass = in.m;
+    result.cog.x = in.com.x;
+    result.cog.y = in.com.y;
+    result.cog.z = in.com.z;
+    result.ixx = in.ixx;
+    result.ixy = in.ixy;
+    result.ixz = in.ixz;
+    result.iyy = in.iyy;
+    result.iyz = in.iyz;
+    result.izz = in.izz;
+    return result;
+}
+
 void LWRGazebo::getExternalForces(LWRGazebo::Joints &q) {
     for (int i=0; i<joints_.size(); i++) {
-        q[i] = joints_[i]->GetForce(0);
+        q[i] = joints_[i]->getForce();
     }
 }
 
 void LWRGazebo::getJointPositionAndVelocity(LWRGazebo::Joints &q, LWRGazebo::Joints &dq) {
     for (int i=0; i<joints_.size(); i++) {
-        q[i] = joints_[i]->Position();
-        dq[i] = joints_[i]->GetVelocity(0);
+        q[i] = joints_[i]->getPosition();
+        dq[i] = joints_[i]->getVelocity();
     }
 }
 
 void LWRGazebo::setForces(const LWRGazebo::Joints &t) {
     for (int i=0; i<joints_.size(); i++) {
-        joints_[i]->SetForce(0, t[i]);
+        joints_[i]->setForce(t[i]);
     }
 }
 
-void LWRGazebo::getGravComp(LWRGazebo::Joints &t) {
-    KDL::Vector gr = gz2kdl(gazebo::physics::get_world()->Gravity());
-
-    gazebo::physics::LinkPtr link = links_[6];
-    gazebo::physics::JointPtr joint = joints_[6];
-    KDL::Frame T_W_L7 = gz2kdl(link->WorldPose());
-    KDL::Vector cog = T_W_L7 * KDL::Vector(tool_.com.x, tool_.com.y, tool_.com.z);
-    KDL::Vector r = cog - gz2kdl(joint->WorldPose().Pos());
-    double mass = tool_.m;
-    KDL::Vector torque = r * (mass * gr);
-    KDL::Vector axis = gz2kdl(joint->GlobalAxis(0));
-    t[6] = KDL::dot(axis, torque);
-
-    for (int i = 6; i > 0; i--) {
-        link = links_[i-1];
-        joint = joints_[i-1];
-        cog = (cog * mass + gz2kdl(link->WorldCoGPose().Pos()) * link->GetInertial()->Mass()) / (mass+link->GetInertial()->Mass());
-        mass += link->GetInertial()->Mass();
-        r = cog - gz2kdl(joint->WorldPose().Pos());
-        torque = r * (mass * gr);
-        axis = gz2kdl(joint->GlobalAxis(0));
-        t[i-1] = KDL::dot(axis, torque);
-    }
-
-    for (int i = 0; i < 7; ++i) {
-        t[i] = -t[i];
+void LWRGazebo::addJointImpedance(const LWRGazebo::Joints &q, const LWRGazebo::Joints &dq, LWRGazebo::Joints &t) const {
+    // as in the KRC, the damping is given as the damping ratio
+    // and it is scaled by the joint space inertia
+    for (int i=0; i<joints_.size(); i++) {
+        const double k = std::max(0.0, tmp_JointStiffness_in_[i]);
+        const double d = 2.0 * tmp_JointDamping_in_[i] * std::sqrt(k * tmp_MassMatrix_out_(i,i));
+        t[i] += k * (tmp_JointPositionCommand_in_[i] - q[i]) - d * dq[i];
     }
 }
 
+void LWRGazebo::predictState(SimChainDynamics &dyn, const LWRGazebo::Joints &q, const LWRGazebo::Joints &dq, const LWRGazebo::Joints &t) {
+    for (int i=0; i<joints_.size(); i++) {
+        pred_dq_(i) = dq[i];
+        pred_t_(i) = t[i];
+    }
+
+    dyn.predictState(pred_dq_, pred_t_, prediction_horizon_, pred_q_offset_, pred_dq_out_);
+
+    for (int i=0; i<joints_.size(); i++) {
+        tmp_PredictedJointPosition_out_[i] = q[i] + pred_q_offset_(i);
+        tmp_PredictedJointVelocity_out_[i] = pred_dq_out_(i);
+    }
+}
+
+void LWRGazebo::updateObserver(SimChainDynamics &dyn, const LWRGazebo::Joints &dq, uint64_t iteration) {
+    // the observer is restarted if any physics step was missed, e.g. after reset
+    if (iteration != last_iteration_ + 1) {
+        observer_.reset();
+    }
+    last_iteration_ = iteration;
+
+    for (int i=0; i<joints_.size(); i++) {
+        obs_dq_(i) = dq[i];
+        obs_t_(i) = last_t_[i];
+    }
+    dyn.getBiasTorques(obs_dq_, obs_bias_);
+    observer_.update(dyn.getMassMatrix(), obs_dq_, obs_t_, obs_bias_, model_->getMaxStepSize());
+
+    const Eigen::VectorXd &r = observer_.getResidual();
+    tmp_Collision_out_ = false;
+    for (int i=0; i<joints_.size(); i++) {
+        tmp_ExternalJointTorque_out_[i] = r(i);
+        if (std::fabs(r(i)) > collision_threshold_) {
+            tmp_Collision_out_ = true;
+        }
+    }
+}
+
+geometry_msgs::Inertia LWRGazebo::calculateToolInertia(bool refresh_links) {
+    Logger::In in("LWRGazebo::calculateToolInertia");
+
+    geometry_msgs::Inertia result;
+    if (joints_.empty()) {
+        Logger::log() << Logger::Error << "the component is not configured" << Logger::endl;
+        return result;
+    }
+    if (!gazebo_model_) {
+        Logger::log() << Logger::Error << "the links are known only for the Gazebo model" << Logger::endl;
+        return result;
+    }
+
+    // the physics is not updated during the calculation
+    boost::recursive_mutex::scoped_lock lock(*gazebo_model_->GetWorld()->Physics()->GetPhysicsUpdateMutex());
+
+    if (tool_links_.empty() || refresh_links) {
+        const std::string scope = model_scope_.empty() ? model_->getName() : model_scope_;
+        gazebo::physics::JointPtr last_joint = TopologyCache::getInstance(gazebo_model_).getJoint(
+                scope + "::" + joint_names_.back());
+        tool_links_.clear();
+        tool_links_.push_back(last_joint->GetChild());
+        for (int i = 0; i < tool_links_.size(); ++i) {
+            gazebo::physics::Link_V children = tool_links_[i]->GetChildJointsLinks();
+            for (int j = 0; j < children.size(); ++j) {
+                if (std::find(tool_links_.begin(), tool_links_.end(), children[j]) == tool_links_.end()) {
+                    tool_links_.push_back(children[j]);
+                }
+            }
+        }
+    }
+
+    // the masses, the CoGs and the rotational inertias about the CoGs, in the base frame
+    const ignition::math::Pose3d T_W_B = tool_links_[0]->WorldPose();
+    const ignition::math::Matrix3d R_B_W(T_W_B.Rot().Inverse());
+    double mass = 0.0;
+    ignition::math::Vector3d com;
+    for (int i = 0; i < tool_links_.size(); ++i) {
+        const gazebo::physics::InertialPtr in = tool_links_[i]->GetInertial();
+        const ignition::math::Vector3d cog_B = T_W_B.Rot().RotateVectorReverse(tool_links_[i]->WorldCoGPose().Pos() - T_W_B.Pos());
+        com += cog_B * in->Mass();
+        mass += in->Mass();
+    }
+    if (mass <= 0.0) {
+        Logger::log() << Logger::Error << "the mass of the tool is zero" << Logger::endl;
+        return result;
+    }
+    com /= mass;
+
+    ignition::math::Matrix3d I;
+    for (int i = 0; i < tool_links_.size(); ++i) {
+        const gazebo::physics::InertialPtr in = tool_links_[i]->GetInertial();
+        const ignition::math::Pose3d T_W_I = tool_links_[i]->WorldCoGPose();
+        const ignition::math::Matrix3d R_B_I = R_B_W * ignition::math::Matrix3d(T_W_I.Rot());
+        const ignition::math::Matrix3d I_I(
+            in->IXX(), in->IXY(), in->IXZ(),
+            in->IXY(), in->IYY(), in->IYZ(),
+            in->IXZ(), in->IYZ(), in->IZZ());
+
+        // the rotational inertia of the link, moved to the CoG of the tool
+        const ignition::math::Vector3d d = T_W_B.Rot().RotateVectorReverse(T_W_I.Pos() - T_W_B.Pos()) - com;
+        I += R_B_I * I_I * R_B_I.Transposed()
+            + (ignition::math::Matrix3d::Identity * d.SquaredLength()
+                - ignition::math::Matrix3d(
+                    d.X()*d.X(), d.X()*d.Y(), d.X()*d.Z(),
+                    d.Y()*d.X(), d.Y()*d.Y(), d.Y()*d.Z(),
+                    d.Z()*d.X(), d.Z()*d.Y(), d.Z()*d.Z())) * in->Mass();
+    }
+
+    result.m = mass;
+    result.com.x = com.X();
+    result.com.y = com.Y();
+    result.com.z = com.Z();
+    result.ixx = I(0, 0);
+    result.ixy = I(0, 1);
+    result.ixz = I(0, 2);
+    result.iyy = I(1, 1);
+    result.iyz = I(1, 2);
+    result.izz = I(2, 2);
+
+    Logger::log() << Logger::Info << "tool of " << name_ << " LWR (" << tool_links_.size() << " links): mass: " << mass
+        << ", com: " << com.X() << " " << com.Y() << " " << com.Z()
+        << ", I: " << result.ixx << " " << result.ixy << " " << result.ixz << " "
+        << result.iyy << " " << result.iyz << " " << result.izz << Logger::endl;
+
+    return result;
+}
+
 bool LWRGazebo::gazeboConfigureHook(gazebo::physics::ModelPtr model) {
     Logger::In in("LWRGazebo::gazeboConfigureHook");
 
@@ -96,147 +217,114 @@ bool LWRGazebo::gazeboConfigureHook(gazebo::physics::ModelPtr model) {
         return false;
     }
 
+    gazebo_model_ = model;
+
+    return simConfigureHook(SimModelPtr(new GazeboSimModel(model)));
+}
+
+bool LWRGazebo::simConfigureHook(SimModelPtr model) {
+    Logger::In in("LWRGazebo::simConfigureHook");
+
+    if (!model) {
+        Logger::log() << Logger::Error << "the model is NULL" << Logger::endl;
+        return false;
+    }
+
     model_ = model;
 
-    counter_ = 0;
     return true;
 }
 
-void LWRGazebo::setInitialPosition(const std::vector<double> &init_q) {
-    // non-RT code
-    init_q_vec_ = init_q;
-
-    for (int i = 0; i < joints_.size(); ++i) {
-        gazebo::physics::DARTJointPtr joint_dart = boost::dynamic_pointer_cast<gazebo::physics::DARTJoint>(joints_[i]);
-        if (joint_dart != NULL) {
-            joint_dart->GetDARTJoint()->setPosition(0, init_q_vec_[i]);
+bool LWRGazebo::buildDynamics(SimModelPtr model, const std::string &scope,
+                                const std::vector<std::string > &joint_names,
+                                const std::map<std::string, double > &init_joint_map,
+                                const geometry_msgs::Inertia &tool) {
+    // non-RT code, runs on the startup pool
+    Logger::In in("LWRGazebo::buildDynamics");
+
+    std::vector<std::string > scoped_names;
+    std::vector<SimJointPtr > joints;
+    std::vector<double > init_q;
+    for (int i = 0; i < joint_names.size(); ++i) {
+        scoped_names.push_back(scope + "::" + joint_names[i]);
+        SimJointPtr joint = model->getJoint(scoped_names.back());
+        if (!joint) {
+            Logger::log() << Logger::Error << "could not find joint " << scoped_names.back() << Logger::endl;
+            return false;
         }
-        joints_[i]->SetPosition(0, init_q_vec_[i]);
-        joints_[i]->SetVelocity(0, 0);
+        joints.push_back(joint);
+
+        // the map is indexed by the names of the joints without the scope
+        const std::string::size_type sep = joint_names[i].rfind("::");
+        const std::string name = (sep == std::string::npos) ? joint_names[i] : joint_names[i].substr(sep + 2);
+        std::map<std::string, double>::const_iterator it = init_joint_map.find(name);
+        if (it == init_joint_map.end()) {
+            Logger::log() << Logger::Error <<
+                "could not find joint " << name << "in init_joint_map ROS parameter" << Logger::endl;
+            return false;
+        }
+        init_q.push_back(it->second);
     }
+
+    // the chain is validated and, for Gazebo, the batched mass matrix of the arms is set up here
+    SimChainDynamicsPtr dyn = model->createChainDynamics(scoped_names, toSimInertia(tool));
+    if (!dyn) {
+        Logger::log() << Logger::Error << "could not create the dynamics model of the chain" << Logger::endl;
+        return false;
+    }
+
+    for (int i = 0; i < joints.size(); ++i) {
+        model->setInitialPosition(scoped_names[i], init_q[i]);
+    }
+    pending_joints_ = joints;
+    pending_init_q_ = init_q;
+    pending_dyn_ = dyn;
+    return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 // Update the controller
 void LWRGazebo::gazeboUpdateHook(gazebo::physics::ModelPtr model)
 {
-    if (!mm_) {
-        return;
-    }
-
-#ifdef CALCULATE_TOOL_INERTIA
-    //
-    // This code calculates and displays inertia of tool.
-    // It uses real mass matrix (taken from Gazebo).
-    //
-    dart::dynamics::SkeletonPtr sk = boost::dynamic_pointer_cast<gazebo::physics::DARTModel >(model)->DARTSkeleton();
-
-    Eigen::MatrixXd mm = sk->getMassMatrix();
-
-    Eigen::Matrix<int, 7, 1 > idx;
+    simUpdateHook();
+}
 
-    idx(0) = sk->getJoint(name_ + "_arm_0_joint")->getIndexInSkeleton(0);
-    idx(1) = sk->getJoint(name_ + "_arm_1_joint")->getIndexInSkeleton(0);
-    idx(2) = sk->getJoint(name_ + "_arm_2_joint")->getIndexInSkeleton(0);
-    idx(3) = sk->getJoint(name_ + "_arm_3_joint")->getIndexInSkeleton(0);
-    idx(4) = sk->getJoint(name_ + "_arm_4_joint")->getIndexInSkeleton(0);
-    idx(5) = sk->getJoint(name_ + "_arm_5_joint")->getIndexInSkeleton(0);
-    idx(6) = sk->getJoint(name_ + "_arm_6_joint")->getIndexInSkeleton(0);
+void LWRGazebo::simUpdateHook()
+{
+    VELMA_SIM_HOOK_TIMER();
 
-    for (int i = 0; i < 7; i++) {
-        for (int j = 0; j < 7; j++) {
-            tmp_MassMatrix_out_(i,j) = mm(idx(i),idx(j));
-        }
+    // the dynamics model is kept for the whole step, even if cleanupHook resets it
+    SimChainDynamicsPtr dyn;
+    {
+        RTT::os::MutexLock lock(gazebo_mutex_);
+        dyn = dyn_;
     }
-
-    if (counter_ < 1000) {
-        ++counter_;
+    if (!dyn) {
+        return;
     }
-    else {
-        counter_ = 0;
-
-        dart::dynamics::BodyNode *b = sk->getJoint(name_ + "_arm_6_joint")->getChildBodyNode();
-
-        std::vector<dart::dynamics::BodyNode* > all;
-        std::vector<dart::dynamics::BodyNode* > to_check;
-        std::vector<dart::dynamics::BodyNode* > to_check_new;
-        to_check.push_back(b);
-        all.push_back(b);
-
-        KDL::Frame base_tf;
-        tf::transformEigenToKDL(b->getTransform(), base_tf);
-
-        while (to_check.size() > 0) {
-            to_check_new.clear();
-            for (int i = 0; i < to_check.size(); ++i) {
-                for (int j = 0; j < to_check[i]->getNumChildBodyNodes(); ++j) {
-                    b = to_check[i]->getChildBodyNode(j);
-                    to_check_new.push_back( b );
-                    all.push_back(b);
-                }
-            }
-            to_check = to_check_new;
-        }
 
-        Logger::log() << Logger::Error << "links below joint " << name_ << "_arm_6_joint" << Logger::endl;
-        // calculate com
-        KDL::Vector COM;
-        double MASS = 0;
-        for (int i = 0; i < all.size(); ++i) {
-            Logger::log() << Logger::Error << "    " << all[i]->getName() << Logger::endl;
-            KDL::Vector com;
-            tf::vectorEigenToKDL(all[i]->getLocalCOM(), com);
-            KDL::Frame tf;
-            tf::transformEigenToKDL(all[i]->getTransform(), tf);
-            COM = COM + (base_tf.Inverse() * tf) * com * all[i]->getMass();
-            MASS += all[i]->getMass();
-        }
-        COM = COM * (1.0 / MASS);
-        Logger::log() << Logger::Error << "mass: " << MASS << ", com: " << COM.x() << " " << COM.y() << " " << COM.z() << Logger::endl;
-
-        KDL::Frame T_B_WI = base_tf * KDL::Frame(COM);
-        KDL::RigidBodyInertia RBI;
-        // calculate moment of inertia
-        for (int i = 0; i < all.size(); ++i) {
-            double Ixx, Iyy, Izz, Ixy, Ixz, Iyz;
-            all[i]->getMomentOfInertia(Ixx, Iyy, Izz, Ixy, Ixz, Iyz);
-            KDL::Vector com;
-            tf::vectorEigenToKDL(all[i]->getLocalCOM(), com);
-            KDL::RigidBodyInertia rbI(all[i]->getMass(), com,  KDL::RotationalInertia(Ixx, Iyy, Izz, Ixy, Ixz, Iyz));
-            KDL::Frame T_B_L;
-            tf::transformEigenToKDL(all[i]->getTransform(), T_B_L);
-            KDL::Frame T_B_LI = T_B_L * KDL::Frame(com);
-            KDL::RigidBodyInertia rbI_WI = (T_B_WI.Inverse() * T_B_LI) * rbI;
-            RBI = RBI + rbI_WI;
-        }
-        Logger::log() << Logger::Error << "I: " << RBI.getRotationalInertia().data[0] << " " << RBI.getRotationalInertia().data[1] << " " << RBI.getRotationalInertia().data[2] << Logger::endl;
-        Logger::log() << Logger::Error << "   " << RBI.getRotationalInertia().data[3] << " " << RBI.getRotationalInertia().data[4] << " " << RBI.getRotationalInertia().data[5] << Logger::endl;
-        Logger::log() << Logger::Error << "   " << RBI.getRotationalInertia().data[6] << " " << RBI.getRotationalInertia().data[7] << " " << RBI.getRotationalInertia().data[8] << Logger::endl;
-    }
-#else
-    //
-    // Use fixed tool inertia.
-    //
+    VELMA_SIM_RT_SCOPE("LWRGazebo::simUpdateHook");
+
+    dyn->update();
+
     // mass matrix
-    mm_->updatePoses(model);
-    const Eigen::MatrixXd &mm = mm_->getMassMatrix();
+    const Eigen::MatrixXd &mm = dyn->getMassMatrix();
 
-    for (int i = 0; i < 7; i++) {
-        for (int j = 0; j < 7; j++) {
+    for (int i = 0; i < joints_.size(); i++) {
+        for (int j = 0; j < joints_.size(); j++) {
             tmp_MassMatrix_out_(i,j) = mm(i,j);
         }
     }
-#endif
 
     // gravity forces
     Joints grav;
-    for (int i = 0; i < 7; ++i) {
-        grav[i] = 0;
+    const Eigen::VectorXd &gt = dyn->getGravityTorque();
+    for (int i = 0; i < joints_.size(); ++i) {
+        grav[i] = gt(i);
     }
-    getGravComp(grav);
 
     // gravity forces
-    for (int i = 0; i < 7; i++) {
+    for (int i = 0; i < joints_.size(); i++) {
         tmp_GravityTorque_out_[i] = grav[i];
     }
 
@@ -244,7 +332,7 @@ void LWRGazebo::gazeboUpdateHook(gazebo::physics::ModelPtr model)
     getExternalForces(ext_f);
 
     // external forces
-    for (int i = 0; i < 7; i++) {
+    for (int i = 0; i < joints_.size(); i++) {
         tmp_JointTorque_out_[i] = ext_f[i] - grav[i];
     }
 
@@ -252,15 +340,18 @@ void LWRGazebo::gazeboUpdateHook(gazebo::physics::ModelPtr model)
     getJointPositionAndVelocity(q, dq);
 
     // joint position
-    for (int i = 0; i < 7; i++) {
+    for (int i = 0; i < joints_.size(); i++) {
         tmp_JointPosition_out_[i] = q[i];
     }
 
     // joint velocity
-    for (int i = 0; i < 7; i++) {
+    for (int i = 0; i < joints_.size(); i++) {
         tmp_JointVelocity_out_[i] = dq[i];
     }
 
+    // external torques, for the torques applied in the previous step
+    updateObserver(*dyn, dq, model_->getIterations());
+
 /*
     // TODO
     // calculate the wrench on the wrist
@@ -290,6 +381,8 @@ void LWRGazebo::gazeboUpdateHook(gazebo::physics::ModelPtr model)
 */
 
     bool tmp_command_mode;
+    bool tmp_tool_changed;
+    uint32_t tmp_cmd_seq;
 
     // exchange the data between Orocos and Gazebo
     {
@@ -301,14 +394,57 @@ void LWRGazebo::gazeboUpdateHook(gazebo::physics::ModelPtr model)
         JointPosition_out_ = tmp_JointPosition_out_;
         JointVelocity_out_ = tmp_JointVelocity_out_;
         CartesianWrench_out_ = tmp_CartesianWrench_out_;
+        ExternalJointTorque_out_ = tmp_ExternalJointTorque_out_;
+        Collision_out_ = tmp_Collision_out_;
         tmp_JointTorqueCommand_in_ = JointTorqueCommand_in_;
+        tmp_JointPositionCommand_in_ = JointPositionCommand_in_;
+        tmp_JointStiffness_in_ = JointStiffness_in_;
+        tmp_JointDamping_in_ = JointDamping_in_;
         tmp_command_mode = command_mode_;
+        tmp_tool_changed = tool_changed_;
+        tmp_cmd_seq = cmd_seq_;
+        if (tool_changed_) {
+            tmp_ToolInertia_in_ = ToolInertia_in_;
+            tool_changed_ = false;
+        }
         data_valid_ = true;
     }
 
+    if (tmp_cmd_seq != traced_cmd_seq_) {
+        LatencyTrace::getInstance().record(trace_channel_, tmp_cmd_seq, LatencyTrace::STAGE_EXCHANGE);
+    }
+
+    // the scripted motion of the benchmark replaces the commands,
+    // the joints that are not scripted hold the initial position
+    if (benchmark_) {
+        const BenchmarkMotion &motion = BenchmarkMotion::getInstance();
+        const double sim_time = model_->getSimTime();
+        for (int i = 0; i < joints_.size(); i++) {
+            const int ch = benchmark_channels_[i];
+            tmp_JointPositionCommand_in_[i] = (ch >= 0) ? motion.getSetpoint(ch, sim_time) : init_q_vec_[i];
+            if (ch >= 0) {
+                tmp_JointStiffness_in_[i] = motion.getStiffness(ch);
+                tmp_JointDamping_in_[i] = motion.getDamping(ch);
+            }
+            tmp_JointTorqueCommand_in_[i] = 0.0;
+        }
+        tmp_command_mode = true;
+    }
+
+    // only the inertia of the last link is changed, the dynamics
+    // are computed with it in the next step
+    if (tmp_tool_changed) {
+        dyn->setToolInertia(toSimInertia(tmp_ToolInertia_in_));
+    }
+
     // torque command
     if (tmp_command_mode) {
-        for (int i = 0; i < 7; i++) {
+        // the joint impedance controller runs at the physics rate,
+        // the torque command is the feed-forward torque
+        if (joint_impedance_ || benchmark_) {
+            addJointImpedance(q, dq, grav);
+        }
+        for (int i = 0; i < joints_.size(); i++) {
             grav[i] += tmp_JointTorqueCommand_in_[i];
         }
     }
@@ -319,5 +455,36 @@ void LWRGazebo::gazeboUpdateHook(gazebo::physics::ModelPtr model)
     }
 
     setForces(grav);
+    last_t_ = grav;
+
+    if (tmp_cmd_seq != traced_cmd_seq_) {
+        traced_cmd_seq_ = tmp_cmd_seq;
+        LatencyTrace::getInstance().record(trace_channel_, tmp_cmd_seq, LatencyTrace::STAGE_APPLY);
+    }
+
+    // the state of the whole robot, written to the shared memory at the end of the step
+    if (state_side_ >= 0) {
+        velma_sim_gazebo::RobotStateShmData *state = RobotStateExport::getInstance().getState();
+        velma_sim_gazebo::RobotStateShmArm &arm = state->arm[state_side_];
+        for (int i = 0; i < joints_.size(); i++) {
+            arm.q[i] = q[i];
+            arm.dq[i] = dq[i];
+            arm.t[i] = grav[i];
+            arm.t_ext[i] = tmp_ExternalJointTorque_out_[i];
+            arm.gravity[i] = tmp_GravityTorque_out_[i];
+        }
+        arm.command_mode = tmp_command_mode ? 1 : 0;
+        state->updated |= (state_side_ == velma_sim_gazebo::ROBOT_STATE_SHM_RIGHT)
+            ? velma_sim_gazebo::ROBOT_STATE_SHM_RIGHT_ARM : velma_sim_gazebo::ROBOT_STATE_SHM_LEFT_ARM;
+    }
+
+    if (prediction_horizon_ > 0.0) {
+        predictState(*dyn, q, dq, grav);
+
+        RTT::os::MutexLock lock(gazebo_mutex_);
+        PredictedJointPosition_out_ = tmp_PredictedJointPosition_out_;
+        PredictedJointVelocity_out_ = tmp_PredictedJointVelocity_out_;
+        prediction_valid_ = true;
+    }
 }
 
@@ -28,6 +28,8 @@
 #ifndef LWR_GAZEBO_H__
 #define LWR_GAZEBO_H__
 
+#include <map>
+
 #include <std_msgs/Int32.h>
 #include <geometry_msgs/Wrench.h>
 #include <geometry_msgs/Inertia.h>
@@ -48,7 +50,11 @@
 #include <lwr_msgs/FriRobotState.h>
 #include <lwr_msgs/FriIntfState.h>
 
-#include "manipulator_mass_matrix.h"
+#include <velma_core_ve_re_lwr_msgs/Status.h>
+
+#include "sim_physics.h"
+#include "momentum_observer.h"
+#include "latency_trace.h"
 
 typedef Eigen::Matrix<double, 7, 7> Matrix77d;
 
@@ -63,6 +69,10 @@ public:
     // right KUKA FRI ports
     RTT::InputPort<Joints >                 port_JointTorqueCommand_in_;  // FRIx.JointTorqueCommand
     RTT::InputPort<std_msgs::Int32 >        port_KRL_CMD_in_;             // FRIx.KRL_CMD
+    RTT::InputPort<Joints >                 port_JointPositionCommand_in_;    // joint impedance setpoint
+    RTT::InputPort<Joints >                 port_JointStiffness_in_;      // joint impedance stiffness [Nm/rad]
+    RTT::InputPort<Joints >                 port_JointDamping_in_;        // joint impedance damping ratio
+    RTT::InputPort<geometry_msgs::Inertia > port_ToolInertia_in_;         // the tool with the payload
     RTT::OutputPort<lwr_msgs::FriRobotState >   port_RobotState_out_;     // FRIx.RobotState
     RTT::OutputPort<lwr_msgs::FriIntfState >    port_FRIState_out_;       // FRIx.FRIState
     RTT::OutputPort<Joints >                port_JointPosition_out_;      // FRIx.JointPosition
@@ -71,9 +81,18 @@ public:
     RTT::OutputPort<Matrix77d >             port_MassMatrix_out_;         // FRIx.MassMatrix
     RTT::OutputPort<Joints >                port_JointTorque_out_;        // FRIx.JointTorque
     RTT::OutputPort<Joints >                port_GravityTorque_out_;      // FRIx.GravityTorque
+    RTT::OutputPort<velma_core_ve_re_lwr_msgs::Status > port_State_out_;  // all of the above in one sample
+    RTT::OutputPort<Joints >                port_PredictedJointPosition_out_; // the state after prediction_horizon
+    RTT::OutputPort<Joints >                port_PredictedJointVelocity_out_;
+    RTT::OutputPort<Joints >                port_ExternalJointTorque_out_;    // momentum observer estimate
+    RTT::OutputPort<bool >                  port_Collision_out_;
 
     Joints                  JointTorqueCommand_in_;
     std_msgs::Int32         KRL_CMD_in_;
+    Joints                  JointPositionCommand_in_;
+    Joints                  JointStiffness_in_;
+    Joints                  JointDamping_in_;
+    geometry_msgs::Inertia  ToolInertia_in_;
     lwr_msgs::FriRobotState RobotState_out_;
     lwr_msgs::FriIntfState  FRIState_out_;
     Joints                  JointPosition_out_;
@@ -82,25 +101,52 @@ public:
     Matrix77d               MassMatrix_out_;
     Joints                  JointTorque_out_;
     Joints                  GravityTorque_out_;
+    velma_core_ve_re_lwr_msgs::Status State_out_;
+    Joints                  PredictedJointPosition_out_;
+    Joints                  PredictedJointVelocity_out_;
+    Joints                  ExternalJointTorque_out_;
+    bool                    Collision_out_;
 
     // public methods
     LWRGazebo(std::string const& name);
     ~LWRGazebo();
     void updateHook();
     bool startHook();
+    void stopHook();
     bool configureHook();
+    void cleanupHook();
     bool gazeboConfigureHook(gazebo::physics::ModelPtr model);
     void gazeboUpdateHook(gazebo::physics::ModelPtr model);
 
+    // the hooks without Gazebo, e.g. for FakeSimModel
+    bool simConfigureHook(SimModelPtr model);
+    void simUpdateHook();
+
+    // non-RT, the inertia of the links below the last joint, in the frame
+    // of the last link; the list of the links is built at the first call
+    // or if refresh_links is set, e.g. after an object was attached
+    geometry_msgs::Inertia calculateToolInertia(bool refresh_links);
+
   protected:
 
     // ROS parameters
     std::string name_;
+    std::string model_scope_;
+    std::vector<std::string> joint_names_;
     std::vector<std::string> init_joint_names_;
 	std::vector<double> init_joint_positions_;
     geometry_msgs::Inertia tool_;
+    bool legacy_ports_;
+    bool joint_impedance_;
+    double prediction_horizon_;
+    double observer_gain_;
+    double collision_threshold_;
 
     Joints                  tmp_JointTorqueCommand_in_;
+    Joints                  tmp_JointPositionCommand_in_;
+    Joints                  tmp_JointStiffness_in_;
+    Joints                  tmp_JointDamping_in_;
+    geometry_msgs::Inertia  tmp_ToolInertia_in_;
     std_msgs::Int32         tmp_KRL_CMD_in_;
     Joints                  tmp_JointPosition_out_;
     Joints                  tmp_JointVelocity_out_;
@@ -108,14 +154,40 @@ public:
     Matrix77d               tmp_MassMatrix_out_;
     Joints                  tmp_JointTorque_out_;
     Joints                  tmp_GravityTorque_out_;
+    Joints                  tmp_PredictedJointPosition_out_;
+    Joints                  tmp_PredictedJointVelocity_out_;
+    Joints                  tmp_ExternalJointTorque_out_;
+    bool                    tmp_Collision_out_;
+
+    // a new tool was received, it is applied in the next physics step
+    bool                    tool_changed_;
+
+    // the number of the last torque command, for the latency trace
+    uint32_t cmd_seq_;
+    uint32_t traced_cmd_seq_;
+    int trace_channel_;
+
+    // the channels of the joints in the benchmark motion, -1 if not scripted
+    std::vector<int >       benchmark_channels_;
+    bool                    benchmark_;
+
+    // the side of the arm in the exported state of the robot, -1 if not exported
+    int                     state_side_;
 
     bool data_valid_;
+    bool prediction_valid_;
 
     bool parseDisableCollision(std::string &link1, std::string &link2, TiXmlElement *c);
     bool parseSRDF(const std::string &xml_string, std::vector<std::pair<std::string, std::string> > &disabled_collisions);
-    void setInitialPosition(const std::vector<double > &init_q);
+    bool buildDynamics(SimModelPtr model, const std::string &scope,
+                        const std::vector<std::string > &joint_names,
+                        const std::map<std::string, double > &init_joint_map,
+                        const geometry_msgs::Inertia &tool);
+
+    SimModelPtr model_;
 
-    gazebo::physics::ModelPtr model_;
+    // the Gazebo model, for calculateToolInertia; NULL for the other models
+    gazebo::physics::ModelPtr gazebo_model_;
 
     // torso and KUKA LWRs
     bool command_mode_;
@@ -129,18 +201,40 @@ public:
     void getExternalForces(Joints &q);
     void getJointPositionAndVelocity(Joints &q, Joints &dq);
     void setForces(const Joints &t);
-    void getGravComp(Joints &t);
-
-    std::shared_ptr<manipulator_mass_matrix::Manipulator > mm_;
+    void addJointImpedance(const Joints &q, const Joints &dq, Joints &t) const;
+    void predictState(SimChainDynamics &dyn, const Joints &q, const Joints &dq, const Joints &t);
+    void updateObserver(SimChainDynamics &dyn, const Joints &dq, uint64_t iteration);
+    void releaseDynamics();
+
+    // set in startHook and reset in cleanupHook under gazebo_mutex_,
+    // simUpdateHook keeps a copy for the step
+    SimChainDynamicsPtr dyn_;
+
+    // built on the startup pool in configureHook, used from startHook
+    SimChainDynamicsPtr pending_dyn_;
+    std::vector<SimJointPtr > pending_joints_;
+    std::vector<double > pending_init_q_;
+    int dyn_task_;
+
+    // buffers of the state predictor
+    Eigen::VectorXd pred_dq_;
+    Eigen::VectorXd pred_t_;
+    Eigen::VectorXd pred_q_offset_;
+    Eigen::VectorXd pred_dq_out_;
+
+    // the external torques estimator
+    MomentumObserver observer_;
+    Eigen::VectorXd obs_dq_;
+    Eigen::VectorXd obs_t_;
+    Eigen::VectorXd obs_bias_;
+    Joints last_t_;
+    uint64_t last_iteration_;
 
     std::vector<double > init_q_vec_;
 
-    std::vector<std::string> link_names_;
-
-    std::vector<gazebo::physics::JointPtr > joints_;
-    std::vector<gazebo::physics::LinkPtr > links_;
+    std::vector<SimJointPtr > joints_;
 
-    int counter_;
+    std::vector<gazebo::physics::LinkPtr > tool_links_;
 
     ros::Time last_update_time_;
 };
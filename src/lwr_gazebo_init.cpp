@@ -28,30 +28,72 @@
 #include "lwr_gazebo.h"
 #include <rtt/Component.hpp>
 
+#include "startup_coordinator.h"
+
     LWRGazebo::LWRGazebo(std::string const& name)
         : TaskContext(name, RTT::TaskContext::PreOperational)
-        , data_valid_(false)
-        , port_CartesianWrench_out_("CartesianWrench_OUTPORT", false)
         , port_RobotState_out_("RobotState_OUTPORT", false)
         , port_FRIState_out_("FRIState_OUTPORT", false)
+        , port_JointPosition_out_("JointPosition_OUTPORT", false)
         , port_JointVelocity_out_("JointVelocity_OUTPORT", false)
+        , port_CartesianWrench_out_("CartesianWrench_OUTPORT", false)
         , port_MassMatrix_out_("MassMatrix_OUTPORT", false)
         , port_JointTorque_out_("JointTorque_OUTPORT", false)
         , port_GravityTorque_out_("GravityTorque_OUTPORT", false)
-        , port_JointPosition_out_("JointPosition_OUTPORT", false)
+        , port_State_out_("State_OUTPORT", false)
+        , port_PredictedJointPosition_out_("PredictedJointPosition_OUTPORT", false)
+        , port_PredictedJointVelocity_out_("PredictedJointVelocity_OUTPORT", false)
+        , port_ExternalJointTorque_out_("ExternalJointTorque_OUTPORT", false)
+        , port_Collision_out_("Collision_OUTPORT", false)
+        , Collision_out_(false)
+        , legacy_ports_(false)
+        , joint_impedance_(false)
+        , prediction_horizon_(0.0)
+        , observer_gain_(50.0)
+        , collision_threshold_(10.0)
+        , tmp_Collision_out_(false)
+        , tool_changed_(false)
+        , cmd_seq_(0)
+        , traced_cmd_seq_(0)
+        , trace_channel_(-1)
+        , benchmark_(false)
+        , state_side_(-1)
+        , data_valid_(false)
+        , prediction_valid_(false)
+        , dyn_task_(-1)
+        , last_iteration_(0)
     {
         addProperty("init_joint_names", init_joint_names_);
         addProperty("init_joint_positions", init_joint_positions_);
         addProperty("name", name_);
+        addProperty("model_scope", model_scope_);
+        addProperty("joint_names", joint_names_);
         addProperty("tool", tool_);
+        addProperty("legacy_ports", legacy_ports_);
+        addProperty("joint_impedance", joint_impedance_);
+        addProperty("prediction_horizon", prediction_horizon_);
+        addProperty("observer_gain", observer_gain_);
+        addProperty("collision_threshold", collision_threshold_);
 
         // Add required gazebo interfaces
         this->provides("gazebo")->addOperation("configure",&LWRGazebo::gazeboConfigureHook,this,RTT::ClientThread);
         this->provides("gazebo")->addOperation("update",&LWRGazebo::gazeboUpdateHook,this,RTT::ClientThread);
 
+        this->addOperation("calculateToolInertia", &LWRGazebo::calculateToolInertia, this, RTT::ClientThread)
+            .doc("calculates the inertia of the links below the last joint, in the frame of the last link")
+            .arg("refresh_links", "search for the links again, e.g. after an object was attached");
+
+        this->addOperation("dumpLatencyTrace", &LatencyTrace::writeChromeTrace, &LatencyTrace::getInstance(), RTT::ClientThread)
+            .doc("writes the latency trace of the commands as a Chrome trace, if tracing is enabled")
+            .arg("path", "the output file");
+
         // right KUKA FRI ports
         this->ports()->addPort("JointTorqueCommand_INPORT",         port_JointTorqueCommand_in_).doc("");
         this->ports()->addPort("KRL_CMD_INPORT",                    port_KRL_CMD_in_).doc("");
+        this->ports()->addPort("JointPositionCommand_INPORT",       port_JointPositionCommand_in_).doc("joint impedance setpoint");
+        this->ports()->addPort("JointStiffness_INPORT",             port_JointStiffness_in_).doc("joint impedance stiffness [Nm/rad]");
+        this->ports()->addPort("JointDamping_INPORT",               port_JointDamping_in_).doc("joint impedance damping ratio, 0..1");
+        this->ports()->addPort("ToolInertia_INPORT",                port_ToolInertia_in_).doc("inertia of the tool with the payload, in the last link frame");
         this->ports()->addPort(port_CartesianWrench_out_);
         this->ports()->addPort(port_RobotState_out_);
         this->ports()->addPort(port_FRIState_out_);
@@ -60,15 +102,30 @@
         this->ports()->addPort(port_JointTorque_out_);
         this->ports()->addPort(port_GravityTorque_out_);
         this->ports()->addPort(port_JointPosition_out_);
+        this->ports()->addPort(port_State_out_);
+        this->ports()->addPort(port_PredictedJointPosition_out_);
+        this->ports()->addPort(port_PredictedJointVelocity_out_);
+        this->ports()->addPort(port_ExternalJointTorque_out_);
+        this->ports()->addPort(port_Collision_out_);
 
         for (int i = 0; i < 7; ++i) {
             JointTorqueCommand_in_[i] = 0;
+            JointPositionCommand_in_[i] = 0;
+            ExternalJointTorque_out_[i] = 0;
+            last_t_[i] = 0;
+            // the defaults of the KRC joint impedance controller
+            JointStiffness_in_[i] = 1000.0;
+            JointDamping_in_[i] = 0.7;
         }
 
         command_mode_ = false;
     }
 
     LWRGazebo::~LWRGazebo() {
+        if (dyn_task_ >= 0) {
+            StartupCoordinator::getInstance().wait(dyn_task_);
+        }
+        releaseDynamics();
     }
 
 ORO_LIST_COMPONENT_TYPE(LWRGazebo)
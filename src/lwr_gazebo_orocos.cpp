@@ -26,88 +26,276 @@
 */
 
 #include "lwr_gazebo.h"
+#include "startup_coordinator.h"
+#include "benchmark_motion.h"
+#include "robot_state_export.h"
 #include <rtt/Logger.hpp>
+#include "allocation_audit.h"
 
 #include <lwr_msgs/FriIntfState.h>
 
 using namespace RTT;
 
-    void LWRGazebo::updateHook() {
+// The concatenator of the io_buffer sets <field>_valid for every field of the
+// message that has such a flag. State_OUTPORT replaces the concatenator, so
+// the flags are set here; a field without the flag is skipped at compile time.
+#define LWR_STATUS_VALID_FLAG(FIELD) \
+    template <typename Msg > static auto setValid_##FIELD(Msg &msg, int) -> decltype((void)(msg.FIELD##_valid = true)) { msg.FIELD##_valid = true; } \
+    template <typename Msg > static void setValid_##FIELD(Msg &, long) {}
 
-        // Synchronize with gazeboUpdate()
-        RTT::os::MutexLock lock(gazebo_mutex_);
+LWR_STATUS_VALID_FLAG(q)
+LWR_STATUS_VALID_FLAG(dq)
+LWR_STATUS_VALID_FLAG(t)
+LWR_STATUS_VALID_FLAG(gt)
+LWR_STATUS_VALID_FLAG(w)
+LWR_STATUS_VALID_FLAG(mmx)
+LWR_STATUS_VALID_FLAG(iState)
+LWR_STATUS_VALID_FLAG(rState)
 
+static void setStatusValid(velma_core_ve_re_lwr_msgs::Status &st) {
+    setValid_q(st, 0);
+    setValid_dq(st, 0);
+    setValid_t(st, 0);
+    setValid_gt(st, 0);
+    setValid_w(st, 0);
+    setValid_mmx(st, 0);
+    setValid_iState(st, 0);
+    setValid_rState(st, 0);
+}
 
-        if (!data_valid_) {
-            Logger::In in("LWRGazebo::updateHook");
-            Logger::log() << Logger::Debug << "gazebo is not initialized" << Logger::endl;
-            return;
-        }
+    void LWRGazebo::updateHook() {
+        VELMA_SIM_RT_SCOPE("LWRGazebo::updateHook");
+        bool tmp_prediction_valid = false;
+        Joints tmp_PredictedJointPosition;
+        Joints tmp_PredictedJointVelocity;
+        Joints tmp_ExternalJointTorque;
+        bool tmp_Collision;
+        Matrix77d tmp_MassMatrix;
+        {
+            // Synchronize with gazeboUpdate()
+            RTT::os::MutexLock lock(gazebo_mutex_);
+
+            if (!data_valid_) {
+                //Logger::In in("LWRGazebo::updateHook");
+                //Logger::log() << Logger::Debug << "gazebo is not initialized" << Logger::endl;
+                return;
+            }
 
-        port_MassMatrix_out_.write(MassMatrix_out_);
-        port_GravityTorque_out_.write(GravityTorque_out_);
-        port_JointTorque_out_.write(JointTorque_out_);
-        port_JointPosition_out_.write(JointPosition_out_);
-        port_JointVelocity_out_.write(JointVelocity_out_);
+            tmp_MassMatrix = MassMatrix_out_;
+            State_out_.gt = GravityTorque_out_;
+            State_out_.t = JointTorque_out_;
+            State_out_.q = JointPosition_out_;
+            State_out_.dq = JointVelocity_out_;
+            State_out_.w = CartesianWrench_out_;
+            tmp_ExternalJointTorque = ExternalJointTorque_out_;
+            tmp_Collision = Collision_out_;
+            tmp_prediction_valid = prediction_valid_;
+            tmp_PredictedJointPosition = PredictedJointPosition_out_;
+            tmp_PredictedJointVelocity = PredictedJointVelocity_out_;
 
-        if (port_KRL_CMD_in_.read(KRL_CMD_in_) == RTT::NewData) {
-            if (KRL_CMD_in_.data == lwr_msgs::FriIntfState::FRI_STATE_CMD) {
-                if (!command_mode_) {
-                    command_mode_ = true;
-                    Logger::log() << Logger::Info <<  "switched to command mode" << Logger::endl;
+            if (port_KRL_CMD_in_.read(KRL_CMD_in_) == RTT::NewData) {
+                if (KRL_CMD_in_.data == lwr_msgs::FriIntfState::FRI_STATE_CMD) {
+                    if (!command_mode_) {
+                        command_mode_ = true;
+                        // hold the current position until the setpoint is received
+                        JointPositionCommand_in_ = JointPosition_out_;
+                        Logger::log() << Logger::Info <<  "switched to command mode" << Logger::endl;
+                    }
+                    else {
+                        Logger::log() << Logger::Warning <<  "tried to switch to command mode while in command mode" << Logger::endl;
+                    }
                 }
-                else {
-                    Logger::log() << Logger::Warning <<  "tried to switch to command mode while in command mode" << Logger::endl;
+                else if (KRL_CMD_in_.data == lwr_msgs::FriIntfState::FRI_STATE_MON) {
+                    if (command_mode_) {
+                        command_mode_ = false;
+                        Logger::log() << Logger::Info << "switched to monitor mode" << Logger::endl;
+                    }
+                    else {
+                        Logger::log() << Logger::Warning <<  "tried to switch to monitor mode while in monitor mode" << Logger::endl;
+                    }
                 }
             }
-            else if (KRL_CMD_in_.data == lwr_msgs::FriIntfState::FRI_STATE_MON) {
-                if (command_mode_) {
-                    command_mode_ = false;
-                    Logger::log() << Logger::Info << "switched to monitor mode" << Logger::endl;
-                }
-                else {
-                    Logger::log() << Logger::Warning <<  "tried to switch to monitor mode while in monitor mode" << Logger::endl;
-                }
+
+            if (port_JointTorqueCommand_in_.read(JointTorqueCommand_in_) == RTT::NewData) {
+                ++cmd_seq_;
+                LatencyTrace::getInstance().record(trace_channel_, cmd_seq_, LatencyTrace::STAGE_READ);
             }
-        }
 
-        if (port_JointTorqueCommand_in_.read(JointTorqueCommand_in_) == RTT::NewData) {
-        }
+            // the impedance parameters are kept until new values are received
+            Joints imp_in;
+            if (port_JointPositionCommand_in_.read(imp_in) == RTT::NewData) {
+                JointPositionCommand_in_ = imp_in;
+            }
+            if (port_JointStiffness_in_.read(imp_in) == RTT::NewData) {
+                JointStiffness_in_ = imp_in;
+            }
+            if (port_JointDamping_in_.read(imp_in) == RTT::NewData) {
+                JointDamping_in_ = imp_in;
+            }
 
-        ros::Time now = rtt_rosclock::host_now();
-        double cmd_div = std::max(1.0, (now - last_update_time_).toSec()/0.001);
-        last_update_time_ = now;
-        for (int i = 0; i < JointTorqueCommand_in_.size(); ++i) {
-            JointTorqueCommand_in_[i] = JointTorqueCommand_in_[i] / cmd_div;
-        }
+            // the new tool is applied in the next physics step
+            if (port_ToolInertia_in_.read(ToolInertia_in_) == RTT::NewData) {
+                tool_changed_ = true;
+            }
 
-        // FRI comm state
-        FRIState_out_.quality = lwr_msgs::FriIntfState::FRI_QUALITY_PERFECT;
-        if (command_mode_) {
-            FRIState_out_.state = lwr_msgs::FriIntfState::FRI_STATE_CMD;
-        }
-        else {
-            FRIState_out_.state = lwr_msgs::FriIntfState::FRI_STATE_MON;
+            ros::Time now = rtt_rosclock::host_now();
+            double cmd_div = std::max(1.0, (now - last_update_time_).toSec()/0.001);
+            last_update_time_ = now;
+            for (int i = 0; i < JointTorqueCommand_in_.size(); ++i) {
+                JointTorqueCommand_in_[i] = JointTorqueCommand_in_[i] / cmd_div;
+            }
+
+            // FRI comm state
+            FRIState_out_.quality = lwr_msgs::FriIntfState::FRI_QUALITY_PERFECT;
+            if (command_mode_) {
+                FRIState_out_.state = lwr_msgs::FriIntfState::FRI_STATE_CMD;
+            }
+            else {
+                FRIState_out_.state = lwr_msgs::FriIntfState::FRI_STATE_MON;
+            }
         }
-        port_FRIState_out_.write(FRIState_out_);
-        port_FRIState_out_.write(FRIState_out_);
 
         // FRI robot state
         RobotState_out_.power = 0x7F;
         RobotState_out_.error = 0;
         RobotState_out_.warning = 0;
         RobotState_out_.control = lwr_msgs::FriRobotState::FRI_CTRL_JNT_IMP;
-        port_RobotState_out_.write(RobotState_out_);
 
-        port_CartesianWrench_out_.write(CartesianWrench_out_);
+        State_out_.iState = FRIState_out_;
+        State_out_.rState = RobotState_out_;
+
+        // the mass matrix is symmetric, Status.mmx holds its upper triangle row by row
+        for (int i = 0, k = 0; i < 7; ++i) {
+            for (int j = i; j < 7; ++j, ++k) {
+                State_out_.mmx[k] = tmp_MassMatrix(i, j);
+            }
+        }
+
+        // all fields are written in every cycle
+        setStatusValid(State_out_);
+
+        // the ports are written outside of the critical section, so
+        // the Gazebo thread is not blocked by the data flow
+        if (port_State_out_.connected()) {
+            port_State_out_.write(State_out_);
+        }
+
+        port_ExternalJointTorque_out_.write(tmp_ExternalJointTorque);
+        port_Collision_out_.write(tmp_Collision);
+
+        if (tmp_prediction_valid) {
+            port_PredictedJointPosition_out_.write(tmp_PredictedJointPosition);
+            port_PredictedJointVelocity_out_.write(tmp_PredictedJointVelocity);
+        }
+
+        if (legacy_ports_) {
+            port_MassMatrix_out_.write(tmp_MassMatrix);
+            port_GravityTorque_out_.write(State_out_.gt);
+            port_JointTorque_out_.write(State_out_.t);
+            port_JointPosition_out_.write(State_out_.q);
+            port_JointVelocity_out_.write(State_out_.dq);
+            port_FRIState_out_.write(State_out_.iState);
+            port_RobotState_out_.write(State_out_.rState);
+            port_CartesianWrench_out_.write(State_out_.w);
+        }
     }
 
     bool LWRGazebo::startHook() {
-      return true;
+        if (dyn_task_ >= 0) {
+            const bool built = StartupCoordinator::getInstance().wait(dyn_task_);
+            dyn_task_ = -1;
+            if (built) {
+                joints_ = pending_joints_;
+                init_q_vec_ = pending_init_q_;
+                {
+                    // Synchronize with gazeboUpdate()
+                    RTT::os::MutexLock lock(gazebo_mutex_);
+                    dyn_ = pending_dyn_;
+                }
+                pending_dyn_.reset();
+            }
+        }
+        // dyn_ is written only in this thread
+        if (!dyn_) {
+            Logger::In in("LWRGazebo::startHook");
+            Logger::log() << Logger::Error << "the dynamics model is not built" << Logger::endl;
+            return false;
+        }
+
+        // the first started component writes the initial state of all components
+        StartupCoordinator::getInstance().applyInitialState();
+
+        // the tool of the state snapshot: m, com (x, y, z), ixx, ixy, ixz, iyy, iyz, izz
+        std::vector<double > tool;
+        if (StartupCoordinator::getInstance().getComponentState(getName(), "tool", tool)) {
+            if (tool.size() == 10) {
+                RTT::os::MutexLock lock(gazebo_mutex_);
+                ToolInertia_in_.m = tool[0];
+                ToolInertia_in_.com.x = tool[1];
+                ToolInertia_in_.com.y = tool[2];
+                ToolInertia_in_.com.z = tool[3];
+                ToolInertia_in_.ixx = tool[4];
+                ToolInertia_in_.ixy = tool[5];
+                ToolInertia_in_.ixz = tool[6];
+                ToolInertia_in_.iyy = tool[7];
+                ToolInertia_in_.iyz = tool[8];
+                ToolInertia_in_.izz = tool[9];
+                tool_changed_ = true;
+            }
+            else {
+                Logger::In in("LWRGazebo::startHook");
+                Logger::log() << Logger::Warning << "the tool of the state snapshot has " << tool.size()
+                    << " values instead of 10" << Logger::endl;
+            }
+        }
+
+        if (trace_channel_ >= 0) {
+            LatencyTrace::getInstance().startUser();
+        }
+        return true;
+    }
+
+    void LWRGazebo::stopHook() {
+        // the latency trace is complete when all traced components are stopped
+        if (trace_channel_ >= 0) {
+            LatencyTrace::getInstance().stopUser();
+        }
+    }
+
+    void LWRGazebo::cleanupHook() {
+        if (dyn_task_ >= 0) {
+            StartupCoordinator::getInstance().wait(dyn_task_);
+            dyn_task_ = -1;
+        }
+        releaseDynamics();
+
+        state_side_ = -1;
+        RobotStateExport::getInstance().release(getName());
+    }
+
+    void LWRGazebo::releaseDynamics() {
+        // the model that was built, but not started; the task is finished
+        pending_dyn_.reset();
+
+        // the Gazebo model is removed from the shared dynamics worker when
+        // the last copy is released, i.e. here or at the end of the current
+        // physics step
+        SimChainDynamicsPtr dyn;
+        {
+            // Synchronize with gazeboUpdate()
+            RTT::os::MutexLock lock(gazebo_mutex_);
+            dyn.swap(dyn_);
+        }
     }
 
     bool LWRGazebo::configureHook() {
         Logger::In in("LWRGazebo::configureHook");
+        StartupCoordinator::ScopedPhase phase(getName(), "configure");
+
+        if (!model_) {
+            Logger::log() << Logger::Error << "the model is not set" << Logger::endl;
+            return false;
+        }
 
         if (init_joint_names_.size() != init_joint_positions_.size()) {
             Logger::log() << Logger::Error <<
@@ -130,31 +318,17 @@ using namespace RTT;
             init_joint_map[init_joint_names_[i]] = init_joint_positions_[i];
         }
 
-        for (int i = 0; i < 7; ++i) {
-            std::string joint_name = std::string("velma::") + name_ + "_arm_" + std::to_string(i) + "_joint";
-            joints_.push_back(model_->GetJoint(joint_name));
-        }
-
-        std::vector<double > init_q_vec;
-        for (int i = 0; i < joints_.size(); ++i) {
-            std::map<std::string, double>::const_iterator it = init_joint_map.find(joints_[i]->GetName());
-            if (it == init_joint_map.end()) {
-                Logger::log() << Logger::Error <<
-                    "could not find joint " << joints_[i]->GetName() << "in init_joint_map ROS parameter" << Logger::endl;
-                return false;
+        // the default joints are the LWR joints of Velma
+        if (joint_names_.empty()) {
+            for (int i = 0; i < 7; ++i) {
+                joint_names_.push_back(name_ + "_arm_" + std::to_string(i) + "_joint");
             }
-            init_q_vec.push_back(init_joint_map[joints_[i]->GetName()]);
-
-            // keep the initial position as it is
-            //init_q_vec_.push_back(joints_[i]->Position(0));
         }
-        setInitialPosition(init_q_vec);
-        
 
-        link_names_.resize(7);
-        for (int i = 0; i < 7; ++i) {
-            link_names_[i] = std::string("velma::") + name_ + "_arm_" + std::to_string(i+1) + "_link";
-            links_.push_back(model_->GetLink(link_names_[i]));
+        if (joint_names_.size() != JointTorqueCommand_in_.size()) {
+            Logger::log() << Logger::Error << "wrong number of joints: " << joint_names_.size()
+                << ", the FRI interface has " << JointTorqueCommand_in_.size() << Logger::endl;
+            return false;
         }
 
         Logger::log() << Logger::Info <<
@@ -164,19 +338,49 @@ using namespace RTT;
             tool_.com.y << " " <<
             tool_.com.z << Logger::endl;
 
-        mm_.reset(new manipulator_mass_matrix::Manipulator(
-            model_,
-            name_ + "_arm_0_joint",
-            name_ + "_arm_6_joint",
-            tool_.m,
-            ignition::math::Vector3d(tool_.com.x, tool_.com.y, tool_.com.z),
-            tool_.ixx,
-            tool_.ixy,
-            tool_.ixz,
-            tool_.iyy,
-            tool_.iyz,
-            tool_.izz
-        ));
+        // the buffers are allocated before the dynamics are
+        // set, as gazeboUpdateHook starts to use them then
+        pred_dq_ = Eigen::VectorXd::Zero(joint_names_.size());
+        pred_t_ = Eigen::VectorXd::Zero(joint_names_.size());
+        pred_q_offset_ = Eigen::VectorXd::Zero(joint_names_.size());
+        pred_dq_out_ = Eigen::VectorXd::Zero(joint_names_.size());
+
+        observer_.configure(joint_names_.size(), observer_gain_);
+        obs_dq_ = Eigen::VectorXd::Zero(joint_names_.size());
+        obs_t_ = Eigen::VectorXd::Zero(joint_names_.size());
+        obs_bias_ = Eigen::VectorXd::Zero(joint_names_.size());
+
+        if (dyn_task_ >= 0) {
+            StartupCoordinator::getInstance().wait(dyn_task_);
+        }
+        releaseDynamics();
+
+        if (trace_channel_ < 0) {
+            trace_channel_ = LatencyTrace::getInstance().addChannel(getName() + " torque command");
+        }
+
+        // in the benchmark mode the arm follows the scripted motion
+        benchmark_ = false;
+        benchmark_channels_.assign(joint_names_.size(), -1);
+        for (int i = 0; i < joint_names_.size(); ++i) {
+            benchmark_channels_[i] = BenchmarkMotion::getInstance().addJoint(joint_names_[i]);
+            benchmark_ = benchmark_ || (benchmark_channels_[i] >= 0);
+        }
+
+        state_side_ = RobotStateExport::getInstance().acquire(getName()) ? RobotStateExport::getSide(name_) : -1;
+
+        // the joints are resolved in the topology of the model and the
+        // dynamics model is built on the startup pool, so the deployer can
+        // configure the other components in the meantime; the task gets
+        // copies of the properties, as they can be changed by the deployer
+        const SimModelPtr model = model_;
+        const std::string scope = model_scope_.empty() ? model_->getName() : model_scope_;
+        const std::vector<std::string > joint_names = joint_names_;
+        const geometry_msgs::Inertia tool = tool_;
+        dyn_task_ = StartupCoordinator::getInstance().submit(getName(), "topology and dynamics model",
+                [this, model, scope, joint_names, init_joint_map, tool]() {
+                    return buildDynamics(model, scope, joint_names, init_joint_map, tool);
+                });
 
         return true;
     }
@@ -26,6 +26,10 @@
 */
 
 #include "manipulator_mass_matrix.h"
+#include "topology_cache.h"
+
+#include <algorithm>
+#include <cmath>
 
 namespace manipulator_mass_matrix {
 
@@ -67,18 +71,19 @@ static ignition::math::Pose3d ConvPose(const Eigen::Isometry3d &_T)
 Manipulator::Manipulator(gazebo::physics::ModelPtr model, const std::string &first_joint, const std::string &last_joint,
                             double tool_mass, const ignition::math::Vector3d &tool_cog, double tool_IXX, double tool_IXY,
                             double tool_IXZ, double tool_IYY, double tool_IYZ, double tool_IZZ) {
-    gazebo::physics::Joint_V js = model->GetJoints();
-    gazebo::physics::JointPtr joint = model->GetJoint(last_joint);
+    // the joint names are scoped, so many robots may be in one world
+    const TopologyCache &topology = TopologyCache::getInstance(model);
+    gazebo::physics::JointPtr joint = topology.getJoint(last_joint);
 
     LinkList links;
 
-    links.push_front(LinkPtr(new Link(joint->GetChild()->GetName(), model->GetLink(joint->GetChild()->GetName()) )));
+    links.push_front(LinkPtr(new Link(joint->GetChild()->GetName(), joint->GetChild())));
     links.front()->setInertia(tool_mass, tool_cog, tool_IXX, tool_IXY,
                             tool_IXZ, tool_IYY, tool_IYZ, tool_IZZ);
-    links.front()->setJointName(joint->GetName());
+    links.front()->setJointName(joint->GetScopedName());
     links.front()->model_ = model;
 
-    while (joint && joint->GetName() != first_joint) {
+    while (joint && joint->GetScopedName() != first_joint) {
         gazebo::physics::LinkPtr link = joint->GetParent();
         links.push_front(LinkPtr(new Link(link->GetName(), link)));
         gazebo::physics::InertialPtr in = link->GetInertial();
@@ -93,19 +98,14 @@ Manipulator::Manipulator(gazebo::physics::ModelPtr model, const std::string &fir
             in->IZZ()
         );
 
-        for (gazebo::physics::Joint_V::const_iterator it = js.begin(); it != js.end(); it++) {
-            if ( (*it)->GetChild()->GetName() == link->GetName() ) {
-                joint = (*it);
-                break;
-            }
-        }
-        links.front()->setJointName(joint->GetName());
+        joint = topology.getParentJoint(link);
+        links.front()->setJointName(joint->GetScopedName());
         links.front()->model_ = model;
     }
     links_.reserve(links.size());
     for (LinkList::const_iterator it = links.begin(); it != links.end(); it++) {
         links_.push_back( *it );
-        joint = model->GetJoint((*it)->getJointName());
+        joint = topology.getJoint((*it)->getJointName());
         (*it)->updateLocalJacobian(joint->InitialAnchorPose(), joint->AxisFrameOffset(0) * joint->LocalAxis(0));
     }
 
@@ -119,6 +119,22 @@ Manipulator::Manipulator(gazebo::physics::ModelPtr model, const std::string &fir
     }
 
     mM_ = Eigen::MatrixXd::Zero(links_.size(), links_.size());
+    mM_e_ = Eigen::VectorXd::Zero(links_.size());
+
+    const int n = links_.size();
+    aba_T_meas_.resize(n);
+    aba_T_.resize(n);
+    aba_g_.resize(n);
+    aba_X_.resize(n);
+    aba_IA_.resize(n);
+    aba_V_.resize(n);
+    aba_c_.resize(n);
+    aba_pA_.resize(n);
+    aba_U_.resize(n);
+    aba_a_.resize(n);
+    aba_D_ = Eigen::VectorXd::Zero(n);
+    aba_u_ = Eigen::VectorXd::Zero(n);
+    aba_ddq_ = Eigen::VectorXd::Zero(n);
 }
 
 void Manipulator::updatePoses(gazebo::physics::ModelPtr model) {
@@ -134,10 +150,35 @@ void Manipulator::updatePoses(gazebo::physics::ModelPtr model) {
     }
 }
 
+int Manipulator::getDofs() const {
+    return links_.size();
+}
+
+const Link& Manipulator::getLink(int index) const {
+    return *links_[index];
+}
+
+void Manipulator::setToolInertia(double mass, const ignition::math::Vector3d &cog, double IXX, double IXY,
+                            double IXZ, double IYY, double IYZ, double IZZ) {
+    links_.back()->setInertia(mass, cog, IXX, IXY, IXZ, IYY, IYZ, IZZ);
+}
+
 gazebo::physics::LinkPtr Link::getGazeboLink() const {
     return gz_link_;
 }
 
+const Eigen::Matrix<double, 6, 6>& Link::getSpatialInertia() const {
+    return mI_;
+}
+
+const Eigen::Matrix<double, 6, 1>& Link::getJacobian() const {
+    return mJacobian_;
+}
+
+Eigen::Isometry3d Link::getRelativeTransform() const {
+    return ConvPose(relative_pose_);
+}
+
 void Link::setRelativePose(const ignition::math::Pose3d &p) {
     relative_pose_ = p;
 }
@@ -239,7 +280,8 @@ const Eigen::MatrixXd& Manipulator::getMassMatrix() {
     mM_.setZero();
 
     size_t dof = links_.size();
-    Eigen::VectorXd e = Eigen::VectorXd::Zero(dof);
+    Eigen::VectorXd &e = mM_e_;
+    e.setZero();
     for (size_t j = 0; j < dof; ++j) {
         e[j] = 1.0;
         setAccelerations(e);
@@ -315,5 +357,177 @@ void Link::aggregateMassMatrix(Eigen::MatrixXd* _MCol, int _col) {
     _MCol->block(iStart, _col, 1, 1).noalias() = mJacobian_.transpose() * mM_F_;
 }
 
+static Eigen::Matrix3d Skew(const Eigen::Vector3d &_v) {
+    Eigen::Matrix3d res;
+    res <<     0.0, -_v(2),  _v(1),
+             _v(2),    0.0, -_v(0),
+            -_v(1),  _v(0),    0.0;
+    return res;
+}
+
+// motion transform from the parent frame to the frame _T (given in the parent frame)
+static Eigen::Matrix<double, 6, 6> MotionTransform(const Eigen::Isometry3d& _T) {
+    const Eigen::Matrix3d Rt = _T.linear().transpose();
+    Eigen::Matrix<double, 6, 6> res;
+    res.topLeftCorner<3, 3>() = Rt;
+    res.topRightCorner<3, 3>().setZero();
+    res.bottomLeftCorner<3, 3>().noalias() = -Rt * Skew(_T.translation());
+    res.bottomRightCorner<3, 3>() = Rt;
+    return res;
+}
+
+// spatial cross product for motion vectors, _V x _M
+static Eigen::Matrix<double, 6, 1> CrossMotion(const Eigen::Matrix<double, 6, 1>& _V,
+                        const Eigen::Matrix<double, 6, 1>& _M) {
+    Eigen::Matrix<double, 6, 1> res;
+    res.head<3>() = _V.head<3>().cross(_M.head<3>());
+    res.tail<3>() = _V.head<3>().cross(_M.tail<3>()) + _V.tail<3>().cross(_M.head<3>());
+    return res;
+}
+
+// spatial cross product for force vectors, _V x* _F
+static Eigen::Matrix<double, 6, 1> CrossForce(const Eigen::Matrix<double, 6, 1>& _V,
+                        const Eigen::Matrix<double, 6, 1>& _F) {
+    Eigen::Matrix<double, 6, 1> res;
+    res.head<3>() = _V.head<3>().cross(_F.head<3>()) + _V.tail<3>().cross(_F.tail<3>());
+    res.tail<3>() = _V.head<3>().cross(_F.tail<3>());
+    return res;
+}
+
+// the motion of the joint with the twist _S (in the child frame) by _q
+static Eigen::Isometry3d JointMotion(const Eigen::Matrix<double, 6, 1>& _S, double _q) {
+    Eigen::Isometry3d res = Eigen::Isometry3d::Identity();
+    const double w_norm = _S.head<3>().norm();
+    if (w_norm < 1.0e-9) {
+        // prismatic joint
+        res.translation() = _S.tail<3>() * _q;
+        return res;
+    }
+    const Eigen::Vector3d w = _S.head<3>() / w_norm;
+    const Eigen::Vector3d v = _S.tail<3>() / w_norm;
+    const double angle = _q * w_norm;
+    res.linear() = Eigen::AngleAxisd(angle, w).toRotationMatrix();
+    res.translation() = (Eigen::Matrix3d::Identity() - res.linear()) * w.cross(v) + w * w.dot(v) * angle;
+    return res;
+}
+
+void Manipulator::updateAbaPoses(const Eigen::Matrix3d &R_W_B, const Eigen::Vector3d &g_W, const Eigen::VectorXd &q_offset) {
+    Eigen::Matrix3d R_W_L = R_W_B;
+    for (int i = 0; i < links_.size(); ++i) {
+        aba_T_[i] = aba_T_meas_[i] * JointMotion(links_[i]->getJacobian(), q_offset(i));
+        R_W_L = R_W_L * aba_T_[i].linear();
+        aba_g_[i].noalias() = R_W_L.transpose() * g_W;
+    }
+}
+
+void Manipulator::computeForwardDynamics(const Eigen::VectorXd &dq, const Eigen::VectorXd &tau, Eigen::VectorXd &ddq) {
+    const int n = links_.size();
+
+    // velocities and bias forces, from the base to the tip
+    for (int i = 0; i < n; ++i) {
+        const Vector6d &S = links_[i]->getJacobian();
+        const Matrix6d &I = links_[i]->getSpatialInertia();
+        aba_X_[i] = MotionTransform(aba_T_[i]);
+        const Vector6d vJ = S * dq(i);
+        aba_V_[i] = vJ;
+        if (i > 0) {
+            aba_V_[i].noalias() += aba_X_[i] * aba_V_[i-1];
+        }
+        aba_c_[i] = CrossMotion(aba_V_[i], vJ);
+        aba_IA_[i] = I;
+        Vector6d a_grav;
+        a_grav.head<3>().setZero();
+        a_grav.tail<3>() = aba_g_[i];
+        aba_pA_[i] = CrossForce(aba_V_[i], I * aba_V_[i]) - I * a_grav;
+    }
+
+    // articulated inertias, from the tip to the base
+    for (int i = n-1; i >= 0; --i) {
+        const Vector6d &S = links_[i]->getJacobian();
+        aba_U_[i].noalias() = aba_IA_[i] * S;
+        aba_D_(i) = S.dot(aba_U_[i]);
+        aba_u_(i) = tau(i) - S.dot(aba_pA_[i]);
+        if (i > 0) {
+            const Matrix6d Ia = aba_IA_[i] - aba_U_[i] * aba_U_[i].transpose() / aba_D_(i);
+            const Vector6d pa = aba_pA_[i] + Ia * aba_c_[i] + aba_U_[i] * (aba_u_(i) / aba_D_(i));
+            aba_IA_[i-1].noalias() += aba_X_[i].transpose() * Ia * aba_X_[i];
+            aba_pA_[i-1].noalias() += aba_X_[i].transpose() * pa;
+        }
+    }
+
+    // accelerations, from the base to the tip
+    for (int i = 0; i < n; ++i) {
+        const Vector6d &S = links_[i]->getJacobian();
+        Vector6d a = aba_c_[i];
+        if (i > 0) {
+            a.noalias() += aba_X_[i] * aba_a_[i-1];
+        }
+        ddq(i) = (aba_u_(i) - aba_U_[i].dot(a)) / aba_D_(i);
+        aba_a_[i] = a + S * ddq(i);
+    }
+}
+
+void Manipulator::predictState(const Eigen::VectorXd &dq, const Eigen::VectorXd &tau, const ignition::math::Vector3d &gravity,
+                        double horizon, double max_step, Eigen::VectorXd &q_offset, Eigen::VectorXd &dq_pred) {
+    const int n = links_.size();
+
+    // the base frame is the current frame of the first link
+    for (int i = 0; i < n; ++i) {
+        aba_T_meas_[i] = links_[i]->getRelativeTransform();
+    }
+    const Eigen::Matrix3d R_W_B = ConvPose(links_[0]->getGazeboLink()->WorldPose()).linear();
+    const Eigen::Vector3d g_W = ConvVec3(gravity);
+
+    q_offset.setZero();
+    dq_pred = dq;
+
+    const int steps = std::max(1, static_cast<int >(std::ceil(horizon / max_step)));
+    const double h = horizon / steps;
+    for (int s = 0; s < steps; ++s) {
+        updateAbaPoses(R_W_B, g_W, q_offset);
+        computeForwardDynamics(dq_pred, tau, aba_ddq_);
+
+        // semi-implicit Euler
+        dq_pred += h * aba_ddq_;
+        q_offset += h * dq_pred;
+    }
+}
+
+void Manipulator::getBiasTorques(const Eigen::VectorXd &dq, const ignition::math::Vector3d &gravity, Eigen::VectorXd &bias) {
+    const int n = links_.size();
+
+    Eigen::Matrix3d R_W_L = ConvPose(links_[0]->getGazeboLink()->WorldPose()).linear();
+    const Eigen::Vector3d g_W = ConvVec3(gravity);
+
+    // velocities, accelerations and forces for zero joint accelerations, from the base to the tip
+    for (int i = 0; i < n; ++i) {
+        const Vector6d &S = links_[i]->getJacobian();
+        const Matrix6d &I = links_[i]->getSpatialInertia();
+        aba_T_[i] = links_[i]->getRelativeTransform();
+        R_W_L = R_W_L * aba_T_[i].linear();
+        aba_X_[i] = MotionTransform(aba_T_[i]);
+        const Vector6d vJ = S * dq(i);
+        aba_V_[i] = vJ;
+        aba_a_[i].setZero();
+        if (i > 0) {
+            aba_V_[i].noalias() += aba_X_[i] * aba_V_[i-1];
+            aba_a_[i].noalias() += aba_X_[i] * aba_a_[i-1];
+        }
+        aba_a_[i] += CrossMotion(aba_V_[i], vJ);
+        Vector6d a_grav;
+        a_grav.head<3>().setZero();
+        a_grav.tail<3>().noalias() = R_W_L.transpose() * g_W;
+        aba_pA_[i] = I * (aba_a_[i] - a_grav) + CrossForce(aba_V_[i], I * aba_V_[i]);
+    }
+
+    // joint torques, from the tip to the base
+    for (int i = n-1; i >= 0; --i) {
+        bias(i) = links_[i]->getJacobian().dot(aba_pA_[i]);
+        if (i > 0) {
+            aba_pA_[i-1].noalias() += aba_X_[i].transpose() * aba_pA_[i];
+        }
+    }
+}
+
 }   // namespace manipulator_mass_matrix
 
@@ -57,6 +57,10 @@ public:
 
     gazebo::physics::LinkPtr getGazeboLink() const;
 
+    const Eigen::Matrix<double, 6, 6>& getSpatialInertia() const;
+    const Eigen::Matrix<double, 6, 1>& getJacobian() const;
+    Eigen::Isometry3d getRelativeTransform() const;
+
 protected:
     Eigen::Matrix<double, 6, 6> mI_;
     std::string name_;
@@ -80,15 +84,58 @@ public:
 
     const Eigen::MatrixXd& getMassMatrix();
     void updatePoses(gazebo::physics::ModelPtr model);
+    int getDofs() const;
+    const Link& getLink(int index) const;
+
+    // RT, the tool is a part of the last link; the new inertia is used
+    // in the next computation of the dynamics
+    void setToolInertia(double mass, const ignition::math::Vector3d &cog, double IXX, double IXY,
+                            double IXZ, double IYY, double IYZ, double IZZ);
+
+    // RT, predicts the state of the chain after the horizon [s], for constant
+    // joint torques tau, with the articulated body algorithm integrated in
+    // steps not longer than max_step; the base of the chain is at rest.
+    // q_offset is the predicted change of the joint positions.
+    void predictState(const Eigen::VectorXd &dq, const Eigen::VectorXd &tau, const ignition::math::Vector3d &gravity,
+                        double horizon, double max_step, Eigen::VectorXd &q_offset, Eigen::VectorXd &dq_pred);
+
+    // RT, the bias torques C(q, dq) dq + g(q) for the current poses, computed
+    // with the recursive Newton-Euler algorithm; the base of the chain is at rest
+    void getBiasTorques(const Eigen::VectorXd &dq, const ignition::math::Vector3d &gravity, Eigen::VectorXd &bias);
 
 protected:
+    typedef Eigen::Matrix<double, 6, 1> Vector6d;
+    typedef Eigen::Matrix<double, 6, 6> Matrix6d;
+
     void setAccelerations(const Eigen::VectorXd &acc);
 
+    // sets aba_T_ and aba_g_ for the current poses moved by q_offset
+    void updateAbaPoses(const Eigen::Matrix3d &R_W_B, const Eigen::Vector3d &g_W, const Eigen::VectorXd &q_offset);
+
+    // the articulated body algorithm for the poses and the gravity in aba_T_ and aba_g_
+    void computeForwardDynamics(const Eigen::VectorXd &dq, const Eigen::VectorXd &tau, Eigen::VectorXd &ddq);
+
     typedef std::shared_ptr<Link > LinkPtr;
     typedef std::list<LinkPtr > LinkList;
     typedef std::vector<LinkPtr > LinkVec;
     LinkVec links_;
     Eigen::MatrixXd mM_;
+    Eigen::VectorXd mM_e_;      // the unit accelerations, preallocated for getMassMatrix
+
+    // buffers of the articulated body algorithm
+    std::vector<Eigen::Isometry3d, Eigen::aligned_allocator<Eigen::Isometry3d > > aba_T_meas_;
+    std::vector<Eigen::Isometry3d, Eigen::aligned_allocator<Eigen::Isometry3d > > aba_T_;
+    std::vector<Eigen::Vector3d > aba_g_;
+    std::vector<Matrix6d, Eigen::aligned_allocator<Matrix6d > > aba_X_;
+    std::vector<Matrix6d, Eigen::aligned_allocator<Matrix6d > > aba_IA_;
+    std::vector<Vector6d, Eigen::aligned_allocator<Vector6d > > aba_V_;
+    std::vector<Vector6d, Eigen::aligned_allocator<Vector6d > > aba_c_;
+    std::vector<Vector6d, Eigen::aligned_allocator<Vector6d > > aba_pA_;
+    std::vector<Vector6d, Eigen::aligned_allocator<Vector6d > > aba_U_;
+    std::vector<Vector6d, Eigen::aligned_allocator<Vector6d > > aba_a_;
+    Eigen::VectorXd aba_D_;
+    Eigen::VectorXd aba_u_;
+    Eigen::VectorXd aba_ddq_;
 };
 
 }   // namespace manipulator_mass_matrix
@@ -0,0 +1,76 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "momentum_observer.h"
+
+MomentumObserver::MomentumObserver()
+    : gain_(0.0)
+    , initialized_(false)
+{
+}
+
+void MomentumObserver::configure(int dofs, double gain) {
+    gain_ = gain;
+    p0_ = Eigen::VectorXd::Zero(dofs);
+    integral_ = Eigen::VectorXd::Zero(dofs);
+    r_ = Eigen::VectorXd::Zero(dofs);
+    M_prev_ = Eigen::MatrixXd::Zero(dofs, dofs);
+    bias_prev_ = Eigen::VectorXd::Zero(dofs);
+    tmp_ = Eigen::VectorXd::Zero(dofs);
+    initialized_ = false;
+}
+
+void MomentumObserver::reset() {
+    initialized_ = false;
+}
+
+void MomentumObserver::update(const Eigen::MatrixXd &M, const Eigen::VectorXd &dq, const Eigen::VectorXd &tau,
+                    const Eigen::VectorXd &bias, double dt) {
+    if (!initialized_ || dt <= 0.0) {
+        p0_.noalias() = M * dq;
+        integral_.setZero();
+        r_.setZero();
+        M_prev_ = M;
+        bias_prev_ = bias;
+        initialized_ = true;
+        return;
+    }
+
+    // int(tau + dM/dt dq - b + r) dt; the torques were applied in the state
+    // of the previous step, so they are integrated with the bias of that state
+    tmp_.noalias() = (M - M_prev_) * dq;
+    integral_ += tmp_ + (tau - bias_prev_ + r_) * dt;
+    M_prev_ = M;
+    bias_prev_ = bias;
+
+    tmp_.noalias() = M * dq;
+    r_ = gain_ * (tmp_ - p0_ - integral_);
+}
+
+const Eigen::VectorXd& MomentumObserver::getResidual() const {
+    return r_;
+}
@@ -0,0 +1,70 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MOMENTUM_OBSERVER_H__
+#define MOMENTUM_OBSERVER_H__
+
+#include "Eigen/Dense"
+
+//
+// Generalized momentum observer (De Luca et al., "Collision Detection and
+// Safe Reaction with the DLR-III Lightweight Manipulator Arm"). The residual
+//   r = K (p - p0 - int(tau + C^T dq - g + r) dt),  p = M dq
+// is a first order low-pass filtered estimate of the external joint torques,
+// with the time constant 1/K. The Coriolis and gravity terms are given as the
+// bias torques b = C dq + g, and C^T dq = dM/dt dq - C dq is obtained from
+// the difference of the mass matrices in consecutive steps.
+//
+class MomentumObserver {
+public:
+    MomentumObserver();
+
+    // non-RT, allocates the buffers
+    void configure(int dofs, double gain);
+
+    // the next update restarts the observer with zero residual
+    void reset();
+
+    // RT, tau are the torques applied in the last dt seconds,
+    // M, dq and bias are for the current state
+    void update(const Eigen::MatrixXd &M, const Eigen::VectorXd &dq, const Eigen::VectorXd &tau,
+                    const Eigen::VectorXd &bias, double dt);
+
+    const Eigen::VectorXd& getResidual() const;
+
+protected:
+    double gain_;
+    bool initialized_;
+    Eigen::VectorXd p0_;
+    Eigen::VectorXd integral_;
+    Eigen::VectorXd r_;
+    Eigen::MatrixXd M_prev_;
+    Eigen::VectorXd bias_prev_;
+    Eigen::VectorXd tmp_;
+};
+
+#endif  // MOMENTUM_OBSERVER_H__
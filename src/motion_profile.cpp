@@ -0,0 +1,99 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "motion_profile.h"
+
+#include <cmath>
+#include <algorithm>
+
+TrapezoidalProfile::TrapezoidalProfile()
+    : max_vel_(1.0)
+    , max_acc_(1.0)
+    , pos_(0)
+    , vel_(0)
+    , target_(0)
+{}
+
+void TrapezoidalProfile::setLimits(double max_vel, double max_acc) {
+    max_vel_ = std::fabs(max_vel);
+    max_acc_ = std::fabs(max_acc);
+}
+
+void TrapezoidalProfile::reset(double pos, double vel) {
+    pos_ = pos;
+    vel_ = vel;
+    target_ = pos;
+}
+
+void TrapezoidalProfile::setTarget(double target) {
+    target_ = target;
+}
+
+void TrapezoidalProfile::update(double dt) {
+    if (dt <= 0) {
+        return;
+    }
+
+    const double err = target_ - pos_;
+    const double dv_max = max_acc_ * dt;
+
+    // the highest velocity that still allows to stop at the target,
+    // for the reference decelerating by dv_max in each step
+    double vel_des = std::min(max_vel_,
+        0.5 * max_acc_ * (std::sqrt(dt * dt + 8.0 * std::fabs(err) / max_acc_) - dt));
+    if (err < 0) {
+        vel_des = -vel_des;
+    }
+
+    const double vel_new = vel_ + std::max(-dv_max, std::min(vel_des - vel_, dv_max));
+
+    // the target is reached within this step
+    if (std::fabs(err) <= std::fabs(vel_new) * dt + 1e-12 && std::fabs(vel_new) <= dv_max) {
+        pos_ = target_;
+        vel_ = 0;
+        return;
+    }
+
+    pos_ += vel_new * dt;
+    vel_ = vel_new;
+}
+
+double TrapezoidalProfile::getPosition() const {
+    return pos_;
+}
+
+double TrapezoidalProfile::getVelocity() const {
+    return vel_;
+}
+
+double TrapezoidalProfile::getTarget() const {
+    return target_;
+}
+
+bool TrapezoidalProfile::isFinished() const {
+    return pos_ == target_ && vel_ == 0;
+}
@@ -0,0 +1,64 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MOTION_PROFILE_H__
+#define MOTION_PROFILE_H__
+
+//
+// Trapezoidal motion profile, as in the profile position mode of Elmo drives:
+// the new target is applied immediately and the reference moves towards it
+// with the limited velocity and acceleration. The profile is recomputed
+// online, so the target may change at any time, also during motion.
+//
+class TrapezoidalProfile {
+public:
+    TrapezoidalProfile();
+
+    void setLimits(double max_vel, double max_acc);
+
+    // sets the current state of the reference, the target is set to pos
+    void reset(double pos, double vel);
+
+    void setTarget(double target);
+
+    // advances the reference by dt seconds
+    void update(double dt);
+
+    double getPosition() const;
+    double getVelocity() const;
+    double getTarget() const;
+    bool isFinished() const;
+
+protected:
+    double max_vel_;
+    double max_acc_;
+    double pos_;
+    double vel_;
+    double target_;
+};
+
+#endif  // MOTION_PROFILE_H__
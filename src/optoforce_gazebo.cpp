@@ -26,15 +26,19 @@
 */
 
 #include "optoforce_gazebo.h"
+#include "sim_physics_gazebo.h"
+#include "startup_coordinator.h"
 #include <rtt/Component.hpp>
 #include <rtt/Logger.hpp>
+#include "allocation_audit.h"
+#include "step_monitor.h"
 
 using namespace RTT;
 
     OptoforceGazebo::OptoforceGazebo(std::string const& name)
         : TaskContext(name, RTT::TaskContext::PreOperational)
-        , model_(NULL)
         , n_sensors_(3)
+        , last_sim_time_(0.0)
         , data_valid_(false)
         , port_force_out_("force_OUTPORT", false)
         , has_optoforce_(true)
@@ -54,9 +58,10 @@ using namespace RTT;
 
     bool OptoforceGazebo::configureHook() {
         Logger::In in("OptoforceGazebo::configureHook");
+        StartupCoordinator::ScopedPhase phase(getName(), "configure");
 
-        if(model_.get() == NULL) {
-            Logger::log() << Logger::Error << "gazebo model is NULL" << Logger::endl;
+        if (!model_) {
+            Logger::log() << Logger::Error << "the model is not set" << Logger::endl;
             return false;
         }
 
@@ -93,17 +98,18 @@ using namespace RTT;
                 prefix + std::string("_HandFingerTwoKnuckleThreeOptoforceJoint"),
                 prefix + std::string("_HandFingerThreeKnuckleThreeOptoforceJoint") };
 
+            joints_.clear();
+            pids_.clear();
             for (int i=0; i < n_joints; i++) {
-                gazebo::physics::JointPtr jnt = model_->GetJoint(joint_names[i]);
-                if (jnt.get() == NULL) {
+                SimJointPtr jnt = model_->getJoint(joint_names[i]);
+                if (!jnt) {
                     has_optoforce_ = false;
                     return true;
                 }
                 joints_.push_back( jnt );
-                jc_->AddJoint(jnt);
-                jc_->SetPositionPID(jnt->GetScopedName(), gazebo::common::PID(20.0, 0, 0.0, 0, 0, 20.0,-20.0));
-                jc_->SetPositionTarget(jnt->GetScopedName(), 0.0);
+                pids_.push_back(gazebo::common::PID(20.0, 0, 0.0, 0, 0, 20.0,-20.0));
             }
+            last_sim_time_ = model_->getSimTime();
         }
         else {
             std::cout << "ERROR: OptoforceGazebo::configureHook: wrong n_sensors=" << n_sensors_ << ". Should be 1 or 3." << std::endl;
@@ -114,6 +120,7 @@ using namespace RTT;
     }
 
     void OptoforceGazebo::updateHook() {
+        VELMA_SIM_RT_SCOPE("OptoforceGazebo::updateHook");
         if (!has_optoforce_) {
             // Nothing to do - there are no Optoforce sensors
             return;
@@ -149,6 +156,10 @@ using namespace RTT;
             return false;
         }
 
+        return simConfigureHook(SimModelPtr(new GazeboSimModel(model)));
+    }
+
+    bool OptoforceGazebo::simConfigureHook(SimModelPtr model) {
         model_ = model;
 
         return true;
@@ -158,6 +169,13 @@ using namespace RTT;
 // Update the controller
 void OptoforceGazebo::gazeboUpdateHook(gazebo::physics::ModelPtr model)
 {
+    simUpdateHook();
+}
+
+void OptoforceGazebo::simUpdateHook()
+{
+    VELMA_SIM_RT_SCOPE("OptoforceGazebo::simUpdateHook");
+    VELMA_SIM_HOOK_TIMER();
     if (!has_optoforce_) {
         // Nothing to do - there are no Optoforce sensors
         return;
@@ -175,14 +193,23 @@ void OptoforceGazebo::gazeboUpdateHook(gazebo::physics::ModelPtr model)
     for (int i = 0; i < n_sensors_; i++) {
 //        force_out_[i].header.frame_id = frame_id_vec_[i];
 //        force_out_[i].header.stamp = rtt_rosclock::host_now();
-        gazebo::physics::JointWrench wr = joints_[i]->GetForceTorque(0u);
-        force_out_[i].force.x = wr.body2Force.X();
-        force_out_[i].force.y = wr.body2Force.Y();
-        force_out_[i].force.z = wr.body2Force.Z();
+        SimVector3 force, torque;
+        joints_[i]->getChildWrench(force, torque);
+        force_out_[i].force.x = force.x;
+        force_out_[i].force.y = force.y;
+        force_out_[i].force.z = force.z;
         force_out_[i].torque.x = force_out_[i].torque.y = force_out_[i].torque.z = 0.0;
     }
 
-    jc_->Update();
+    // the position controllers of the sensor joints, with the zero target
+    const double sim_time = model_->getSimTime();
+    const double dt = sim_time - last_sim_time_;
+    last_sim_time_ = sim_time;
+    if (dt > 0.0) {
+        for (int i = 0; i < n_sensors_; i++) {
+            joints_[i]->setForce(pids_[i].Update(joints_[i]->getPosition(), dt));
+        }
+    }
     data_valid_ = true;
 }
 
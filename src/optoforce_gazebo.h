@@ -37,6 +37,8 @@
 
 #include <geometry_msgs/Wrench.h>
 
+#include "sim_physics.h"
+
 class OptoforceGazebo : public RTT::TaskContext
 {
 public:
@@ -49,6 +51,10 @@ public:
     bool gazeboConfigureHook(gazebo::physics::ModelPtr model);
     void gazeboUpdateHook(gazebo::physics::ModelPtr model);
 
+    // the hooks without Gazebo, e.g. for FakeSimModel
+    bool simConfigureHook(SimModelPtr model);
+    void simUpdateHook();
+
   protected:
 
     // ROS parameters
@@ -58,10 +64,12 @@ public:
 
     int32_t median_filter_samples_, median_filter_max_samples_;
 
-    gazebo::physics::ModelPtr model_;
+    SimModelPtr model_;
 
-    gazebo::physics::JointControllerPtr jc_;
-    std::vector<gazebo::physics::JointPtr> joints_;
+    // the sensor joints are held at zero by the position controllers
+    std::vector<SimJointPtr > joints_;
+    std::vector<gazebo::common::PID > pids_;
+    double last_sim_time_;
 
     // OROCOS ports
     boost::array<geometry_msgs::Wrench, 3 > force_out_;
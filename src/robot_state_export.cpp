@@ -0,0 +1,268 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "robot_state_export.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include <rtt/Logger.hpp>
+#include <rtt/os/MutexLock.hpp>
+
+using namespace RTT;
+
+RobotStateExport& RobotStateExport::getInstance() {
+    static RobotStateExport state_export;
+    return state_export;
+}
+
+RobotStateExport::RobotStateExport()
+    : enabled_(false)
+    , shm_hdr_(NULL)
+    , imu_rt_(NULL)
+    , imu_stop_(false)
+{
+    memset(&state_, 0, sizeof(state_));
+
+    const char *name = getenv("VELMA_SIM_STATE_SHM");
+    if (!name || name[0] == 0) {
+        return;
+    }
+    shm_name_ = name;
+
+    const char *imu_name = getenv("VELMA_SIM_STATE_SHM_IMU");
+    if (imu_name) {
+        imu_name_ = imu_name;
+    }
+    enabled_ = true;
+}
+
+RobotStateExport::~RobotStateExport() {
+    // the shared memory is removed also if the components are not cleaned up
+    RTT::os::MutexLock lock(mutex_);
+    if (!users_.empty()) {
+        users_.clear();
+        close();
+    }
+}
+
+bool RobotStateExport::acquire(const std::string &user) {
+    if (!enabled_) {
+        return false;
+    }
+    RTT::os::MutexLock lock(mutex_);
+    if (std::find(users_.begin(), users_.end(), user) != users_.end()) {
+        return shm_hdr_ != NULL;
+    }
+    if (users_.empty() && !open()) {
+        return false;
+    }
+    users_.push_back(user);
+    return true;
+}
+
+void RobotStateExport::release(const std::string &user) {
+    RTT::os::MutexLock lock(mutex_);
+    std::vector<std::string >::iterator it = std::find(users_.begin(), users_.end(), user);
+    if (it == users_.end()) {
+        return;
+    }
+    users_.erase(it);
+    if (users_.empty()) {
+        close();
+    }
+}
+
+bool RobotStateExport::open() {
+    Logger::In in("RobotStateExport");
+
+    world_ = gazebo::physics::get_world();
+    if (!world_) {
+        Logger::log() << Logger::Error << "there is no world, the state is not exported" << Logger::endl;
+        return false;
+    }
+
+    const size_t size = velma_sim_gazebo::robotStateShmSize();
+    int fd = shm_open(shm_name_.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        Logger::log() << Logger::Error << "could not create shared memory " << shm_name_ << Logger::endl;
+        world_.reset();
+        return false;
+    }
+    if (ftruncate(fd, size) != 0) {
+        ::close(fd);
+        Logger::log() << Logger::Error << "could not resize shared memory " << shm_name_ << Logger::endl;
+        world_.reset();
+        return false;
+    }
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (ptr == MAP_FAILED) {
+        Logger::log() << Logger::Error << "could not map shared memory " << shm_name_ << Logger::endl;
+        world_.reset();
+        return false;
+    }
+
+    // the readers check the magic number last
+    memset(ptr, 0, size);
+    shm_hdr_ = static_cast<velma_sim_gazebo::RobotStateShmHeader* >(ptr);
+    shm_hdr_->version = ROBOT_STATE_SHM_VERSION;
+    shm_hdr_->data_size = sizeof(velma_sim_gazebo::RobotStateShmData);
+    __atomic_store_n(&shm_hdr_->magic, ROBOT_STATE_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    // the sensors of the robot usually exist at this point, otherwise they
+    // are searched for in the resolver thread
+    if (!resolveImu()) {
+        imu_stop_ = false;
+        imu_thread_ = std::thread(&RobotStateExport::imuResolverLoop, this);
+    }
+
+    end_connection_ = gazebo::event::Events::ConnectWorldUpdateEnd(std::bind(&RobotStateExport::onWorldUpdateEnd, this));
+
+    Logger::log() << Logger::Info << "the state of the robot is exported to shared memory " << shm_name_
+        << " (" << size << " bytes)" << Logger::endl;
+    return true;
+}
+
+void RobotStateExport::close() {
+    end_connection_.reset();
+    if (imu_thread_.joinable()) {
+        {
+            RTT::os::MutexLock lock(imu_mutex_);
+            imu_stop_ = true;
+        }
+        imu_cond_.broadcast();
+        imu_thread_.join();
+    }
+    imu_rt_.store(NULL, std::memory_order_release);
+    imu_.reset();
+    world_.reset();
+    if (shm_hdr_) {
+        munmap(shm_hdr_, velma_sim_gazebo::robotStateShmSize());
+        shm_unlink(shm_name_.c_str());
+        shm_hdr_ = NULL;
+    }
+}
+
+int RobotStateExport::getSide(const std::string &name) {
+    if (name.compare(0, 5, "right") == 0) {
+        return velma_sim_gazebo::ROBOT_STATE_SHM_RIGHT;
+    }
+    if (name.compare(0, 4, "left") == 0) {
+        return velma_sim_gazebo::ROBOT_STATE_SHM_LEFT;
+    }
+    return -1;
+}
+
+bool RobotStateExport::resolveImu() {
+    // non-RT
+    gazebo::sensors::SensorPtr sensor;
+    if (imu_name_.empty()) {
+        gazebo::sensors::Sensor_V sensors = gazebo::sensors::SensorManager::Instance()->GetSensors();
+        for (int i = 0; i < sensors.size() && !sensor; ++i) {
+            if (sensors[i]->Type() == "imu") {
+                sensor = sensors[i];
+            }
+        }
+    }
+    else {
+        sensor = gazebo::sensors::SensorManager::Instance()->GetSensor(imu_name_);
+    }
+    gazebo::sensors::ImuSensorPtr imu = std::dynamic_pointer_cast<gazebo::sensors::ImuSensor >(sensor);
+    if (!imu) {
+        return false;
+    }
+    Logger::In in("RobotStateExport");
+    Logger::log() << Logger::Info << "the IMU is \"" << imu->Name() << "\"" << Logger::endl;
+
+    // imu_ keeps the sensor alive until close() clears imu_rt_
+    imu_ = imu;
+    imu_rt_.store(imu_.get(), std::memory_order_release);
+    return true;
+}
+
+void RobotStateExport::imuResolverLoop() {
+    // the sensors may be created after the model, so the missing IMU is
+    // searched for once per second, a limited number of times
+    const int resolve_tries = 10;
+    RTT::os::MutexLock lock(imu_mutex_);
+    for (int i = 0; i < resolve_tries; ++i) {
+        if (!imu_stop_) {
+            imu_cond_.timed_wait(imu_mutex_, 1.0);
+        }
+        if (imu_stop_) {
+            return;
+        }
+        if (resolveImu()) {
+            return;
+        }
+    }
+    Logger::In in("RobotStateExport");
+    Logger::log() << Logger::Warning << "there is no IMU, it is not exported" << Logger::endl;
+}
+
+void RobotStateExport::onWorldUpdateEnd() {
+    // the export is being closed
+    RTT::os::MutexTryLock lock(mutex_);
+    if (!lock.isSuccessful() || !shm_hdr_) {
+        return;
+    }
+
+    // set by the resolver thread
+    gazebo::sensors::ImuSensor *imu_sensor = imu_rt_.load(std::memory_order_acquire);
+    if (imu_sensor) {
+        const ignition::math::Quaterniond q = imu_sensor->Orientation();
+        const ignition::math::Vector3d w = imu_sensor->AngularVelocity();
+        const ignition::math::Vector3d a = imu_sensor->LinearAcceleration();
+        velma_sim_gazebo::RobotStateShmImu &imu = state_.imu;
+        imu.orientation[0] = q.X();
+        imu.orientation[1] = q.Y();
+        imu.orientation[2] = q.Z();
+        imu.orientation[3] = q.W();
+        imu.angular_velocity[0] = w.X();
+        imu.angular_velocity[1] = w.Y();
+        imu.angular_velocity[2] = w.Z();
+        imu.linear_acceleration[0] = a.X();
+        imu.linear_acceleration[1] = a.Y();
+        imu.linear_acceleration[2] = a.Z();
+        state_.updated |= velma_sim_gazebo::ROBOT_STATE_SHM_IMU;
+    }
+
+    state_.iteration = world_->Iterations();
+    state_.sim_time = world_->SimTime().Double();
+
+    // the only writer; the sequence number is odd while the state is written
+    const uint64_t seq = shm_hdr_->seq;
+    __atomic_store_n(&shm_hdr_->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(velma_sim_gazebo::robotStateShmData(shm_hdr_), &state_, sizeof(state_));
+    __atomic_store_n(&shm_hdr_->seq, seq + 2, __ATOMIC_RELEASE);
+
+    state_.updated = 0;
+}
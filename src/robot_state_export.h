@@ -0,0 +1,119 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef ROBOT_STATE_EXPORT_H__
+#define ROBOT_STATE_EXPORT_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gazebo/gazebo.hh>
+#include <gazebo/physics/physics.hh>
+#include <gazebo/common/common.hh>
+#include <gazebo/sensors/sensors.hh>
+
+#include <rtt/os/Mutex.hpp>
+#include <rtt/os/Condition.hpp>
+
+#include "velma_sim_gazebo/robot_state_shm.h"
+
+//
+// The writer of the state of the whole robot to the shared memory
+// (velma_sim_gazebo/robot_state_shm.h). The components write their parts
+// to a local copy of the state in their update hooks; at the end of the
+// physics step the copy is written to the shared memory at once. The export
+// is enabled by the VELMA_SIM_STATE_SHM environment variable, which is the
+// name of the shared memory object (e.g. /velma_sim_state). The IMU is read
+// from the sensor VELMA_SIM_STATE_SHM_IMU (default: the first IMU sensor).
+// The shared memory is created when the first component is configured and
+// removed when the last one is cleaned up, or at exit. A missing IMU is
+// searched for in a separate thread and handed over to the physics thread.
+//
+class RobotStateExport {
+public:
+    static RobotStateExport& getInstance();
+
+    bool isEnabled() const {
+        return enabled_;
+    }
+
+    // non-RT, called in configureHook of the component; the export is opened
+    // for the first user; returns false if the export is disabled or failed
+    bool acquire(const std::string &user);
+
+    // non-RT, called in cleanupHook of the component; the export is closed
+    // and the shared memory is removed when the last user is released
+    void release(const std::string &user);
+
+    // the side of the part with this name or prefix ("right...", "left..."), -1 if unknown
+    static int getSide(const std::string &name);
+
+    // RT, physics thread; the state of the current step, NULL if the export is disabled
+    velma_sim_gazebo::RobotStateShmData* getState() {
+        return enabled_ ? &state_ : NULL;
+    }
+
+protected:
+    RobotStateExport();
+    ~RobotStateExport();
+
+    bool open();
+    void close();
+
+    void onWorldUpdateEnd();
+    bool resolveImu();
+    void imuResolverLoop();
+
+    bool enabled_;
+    std::string shm_name_;
+    velma_sim_gazebo::RobotStateShmHeader *shm_hdr_;
+
+    velma_sim_gazebo::RobotStateShmData state_;
+
+    // guards the users and the export against onWorldUpdateEnd
+    RTT::os::Mutex mutex_;
+    std::vector<std::string > users_;
+
+    gazebo::physics::WorldPtr world_;
+    gazebo::event::ConnectionPtr end_connection_;
+
+    std::string imu_name_;
+    gazebo::sensors::ImuSensorPtr imu_;                 // owned by the non-RT side
+    std::atomic<gazebo::sensors::ImuSensor* > imu_rt_;  // read in the physics thread
+
+    // the IMU resolver
+    std::thread imu_thread_;
+    RTT::os::Mutex imu_mutex_;
+    RTT::os::Condition imu_cond_;
+    bool imu_stop_;
+};
+
+#endif  // ROBOT_STATE_EXPORT_H__
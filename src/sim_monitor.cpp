@@ -0,0 +1,286 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "sim_monitor.h"
+#include "step_monitor.h"
+#include <rtt/Component.hpp>
+#include <rtt/Logger.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace RTT;
+
+SimMonitor::SimMonitor(std::string const& name)
+    : TaskContext(name, RTT::TaskContext::PreOperational)
+    , samples_count_(10000)
+    , step_budget_(0.0)
+    , overrun_dump_steps_(200)
+    , overrun_dump_interval_(10.0)
+    , step_begin_ns_(0)
+    , budget_ns_(0)
+    , samples_written_(0)
+    , window_begin_ns_(0)
+    , window_begin_sim_time_(0.0)
+    , last_dump_ns_(0)
+    , stats_ready_(false)
+    , dump_requested_(false)
+    , port_Stats_out_("Stats_OUTPORT", false)
+{
+    // Add required gazebo interfaces
+    this->provides("gazebo")->addOperation("configure",&SimMonitor::gazeboConfigureHook,this,RTT::ClientThread);
+    this->provides("gazebo")->addOperation("update",&SimMonitor::gazeboUpdateHook,this,RTT::ClientThread);
+
+    this->addOperation("dumpSteps", &SimMonitor::dumpSteps, this, RTT::ClientThread)
+        .doc("writes the last steps as CSV")
+        .arg("path", "the output file")
+        .arg("steps", "the number of steps");
+
+    this->ports()->addPort(port_Stats_out_);
+
+    const char *dump_path = getenv("VELMA_SIM_STEP_OVERRUN_DUMP");
+    if (dump_path) {
+        overrun_dump_path_ = dump_path;
+    }
+
+    this->addProperty("samples_count", samples_count_);
+    this->addProperty("step_budget", step_budget_);
+    this->addProperty("overrun_dump_steps", overrun_dump_steps_);
+    this->addProperty("overrun_dump_path", overrun_dump_path_);
+    this->addProperty("overrun_dump_interval", overrun_dump_interval_);
+}
+
+SimMonitor::~SimMonitor() {
+    StepMonitor::getInstance().setEnabled(false);
+}
+
+bool SimMonitor::gazeboConfigureHook(gazebo::physics::ModelPtr model) {
+    Logger::In in("SimMonitor::gazeboConfigureHook");
+
+    if(model.get() == NULL) {
+        Logger::log() << Logger::Error << "gazebo model is NULL" << Logger::endl;
+        return false;
+    }
+
+    world_ = model->GetWorld();
+    return true;
+}
+
+void SimMonitor::gazeboUpdateHook(gazebo::physics::ModelPtr model) {
+    // the steps are measured with the world events
+}
+
+bool SimMonitor::configureHook() {
+    Logger::In in("SimMonitor::configureHook");
+
+    // the component is deployed by the subsystem, not by the model plugin
+    if (!world_) {
+        world_ = gazebo::physics::get_world();
+    }
+    if (!world_) {
+        Logger::log() << Logger::Error << "gazebo world is NULL" << Logger::endl;
+        return false;
+    }
+
+    if (samples_count_ < 1 || overrun_dump_steps_ < 1) {
+        Logger::log() << Logger::Error << "samples_count and overrun_dump_steps must be positive" << Logger::endl;
+        return false;
+    }
+
+    // the wall time of one step at the target real time factor
+    double budget = step_budget_;
+    if (budget <= 0.0) {
+        const double rate = world_->Physics()->GetRealTimeUpdateRate();
+        budget = (rate > 0.0) ? (1.0 / rate) : world_->Physics()->GetMaxStepSize();
+    }
+    Logger::log() << Logger::Info << "step budget: " << budget << " s" << Logger::endl;
+
+    {
+        RTT::os::MutexLock lock(gazebo_mutex_);
+        budget_ns_ = budget * 1.0e9;
+        samples_.assign(samples_count_, StepSample());
+        samples_written_ = 0;
+        window_begin_ns_ = 0;
+        stats_.step_budget = budget;
+    }
+
+    begin_connection_ = gazebo::event::Events::ConnectWorldUpdateBegin(std::bind(&SimMonitor::onWorldUpdateBegin, this));
+    end_connection_ = gazebo::event::Events::ConnectWorldUpdateEnd(std::bind(&SimMonitor::onWorldUpdateEnd, this));
+    StepMonitor::getInstance().setEnabled(true);
+
+    return true;
+}
+
+bool SimMonitor::startHook() {
+    return true;
+}
+
+void SimMonitor::onWorldUpdateBegin() {
+    step_begin_ns_ = StepMonitor::now();
+}
+
+void SimMonitor::onWorldUpdateEnd() {
+    const int64_t end_ns = StepMonitor::now();
+
+    // the hooks of the components may be called before this monitor is
+    // notified about the beginning of the step
+    int64_t first_hook_ns, hooks_ns;
+    StepMonitor::getInstance().takeStep(world_->Iterations(), first_hook_ns, hooks_ns);
+    int64_t begin_ns = step_begin_ns_;
+    if (first_hook_ns != 0 && (begin_ns == 0 || first_hook_ns < begin_ns)) {
+        begin_ns = first_hook_ns;
+    }
+    if (begin_ns == 0) {
+        return;
+    }
+
+    StepSample s;
+    s.sim_time = world_->SimTime().Double();
+    s.wall_ns = begin_ns;
+    s.step_ns = end_ns - begin_ns;
+    s.hooks_ns = hooks_ns;
+    const int64_t physics_ns = s.step_ns - s.hooks_ns;
+
+    RTT::os::MutexTryLock trylock(gazebo_mutex_);
+    if (!trylock.isSuccessful()) {
+        return;
+    }
+
+    samples_[samples_written_ % samples_.size()] = s;
+    ++samples_written_;
+
+    if (window_begin_ns_ == 0) {
+        window_begin_ns_ = begin_ns;
+        window_begin_sim_time_ = s.sim_time;
+        window_steps_ = 0;
+        window_step_sum_ns_ = window_step_max_ns_ = 0;
+        window_hooks_sum_ns_ = window_hooks_max_ns_ = 0;
+        window_physics_sum_ns_ = window_physics_max_ns_ = 0;
+        window_overruns_ = 0;
+    }
+    ++window_steps_;
+    window_step_sum_ns_ += s.step_ns;
+    window_step_max_ns_ = std::max(window_step_max_ns_, s.step_ns);
+    window_hooks_sum_ns_ += s.hooks_ns;
+    window_hooks_max_ns_ = std::max(window_hooks_max_ns_, s.hooks_ns);
+    window_physics_sum_ns_ += physics_ns;
+    window_physics_max_ns_ = std::max(window_physics_max_ns_, physics_ns);
+
+    if (s.step_ns > budget_ns_) {
+        ++window_overruns_;
+        if (!overrun_dump_path_.empty() && !dump_requested_
+                && (last_dump_ns_ == 0 || end_ns - last_dump_ns_ > overrun_dump_interval_ * 1.0e9)) {
+            dump_requested_ = true;
+            last_dump_ns_ = end_ns;
+        }
+    }
+
+    const int64_t window_ns = end_ns - window_begin_ns_;
+    if (window_ns >= 1000000000LL) {
+        const double n = window_steps_;
+        stats_.real_time_factor = (s.sim_time - window_begin_sim_time_) / (window_ns * 1.0e-9);
+        stats_.steps = window_steps_;
+        stats_.step_time_mean = window_step_sum_ns_ * 1.0e-9 / n;
+        stats_.step_time_max = window_step_max_ns_ * 1.0e-9;
+        stats_.hooks_time_mean = window_hooks_sum_ns_ * 1.0e-9 / n;
+        stats_.hooks_time_max = window_hooks_max_ns_ * 1.0e-9;
+        stats_.physics_time_mean = window_physics_sum_ns_ * 1.0e-9 / n;
+        stats_.physics_time_max = window_physics_max_ns_ * 1.0e-9;
+        stats_.overruns = window_overruns_;
+        stats_ready_ = true;
+        window_begin_ns_ = 0;
+    }
+}
+
+void SimMonitor::copySamples(int steps, std::vector<StepSample > &samples) {
+    // the mutex is locked by the caller
+    const uint64_t count = std::min<uint64_t >(std::min<uint64_t >(steps, samples_.size()), samples_written_);
+    samples.resize(count);
+    for (uint64_t i = 0; i < count; ++i) {
+        samples[i] = samples_[(samples_written_ - count + i) % samples_.size()];
+    }
+}
+
+bool SimMonitor::dumpSteps(const std::string &path, int steps) {
+    Logger::In in("SimMonitor::dumpSteps");
+
+    std::vector<StepSample > samples;
+    double budget;
+    {
+        RTT::os::MutexLock lock(gazebo_mutex_);
+        copySamples(steps, samples);
+        budget = budget_ns_ * 1.0e-9;
+    }
+
+    FILE *f = fopen(path.c_str(), "w");
+    if (!f) {
+        Logger::log() << Logger::Error << "could not write " << path << Logger::endl;
+        return false;
+    }
+    fprintf(f, "sim_time,wall_time,step_time,hooks_time,physics_time,overrun\n");
+    for (int i = 0; i < samples.size(); ++i) {
+        const StepSample &s = samples[i];
+        fprintf(f, "%.6f,%.9f,%.9f,%.9f,%.9f,%d\n", s.sim_time, (s.wall_ns - samples[0].wall_ns) * 1.0e-9,
+            s.step_ns * 1.0e-9, s.hooks_ns * 1.0e-9, (s.step_ns - s.hooks_ns) * 1.0e-9,
+            (s.step_ns * 1.0e-9 > budget) ? 1 : 0);
+    }
+    fclose(f);
+    Logger::log() << Logger::Info << "saved " << samples.size() << " steps in " << path << Logger::endl;
+    return true;
+}
+
+void SimMonitor::updateHook() {
+    velma_sim_gazebo::SimStats stats;
+    bool stats_ready;
+    bool dump_requested;
+    {
+        RTT::os::MutexLock lock(gazebo_mutex_);
+        stats = stats_;
+        stats_ready = stats_ready_;
+        stats_ready_ = false;
+        dump_requested = dump_requested_;
+    }
+
+    if (stats_ready) {
+        stats.header.stamp = rtt_rosclock::host_now();
+        port_Stats_out_.write(stats);
+    }
+
+    if (dump_requested) {
+        Logger::In in("SimMonitor::updateHook");
+        Logger::log() << Logger::Warning << "step overrun, the last " << overrun_dump_steps_ << " steps are written to "
+            << overrun_dump_path_ << Logger::endl;
+        dumpSteps(overrun_dump_path_, overrun_dump_steps_);
+
+        RTT::os::MutexLock lock(gazebo_mutex_);
+        dump_requested_ = false;
+    }
+}
+
+ORO_LIST_COMPONENT_TYPE(SimMonitor)
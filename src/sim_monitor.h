@@ -0,0 +1,125 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef SIM_MONITOR_H__
+#define SIM_MONITOR_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <gazebo/gazebo.hh>
+#include <gazebo/physics/physics.hh>
+#include <gazebo/common/common.hh>
+
+#include <rtt/TaskContext.hpp>
+#include <rtt/Port.hpp>
+
+#include "rtt_rosclock/rtt_rosclock.h"
+
+#include <velma_sim_gazebo/SimStats.h>
+
+//
+// Monitor of the simulation steps. At the end of every step of the world,
+// the sim time, the wall time, the duration of the step and the time of the
+// update hooks of the components are stored in a ring of samples. The
+// statistics are written to Stats_OUTPORT once per second of wall time,
+// and the last steps are written to a file after a step longer than the
+// budget.
+//
+class SimMonitor : public RTT::TaskContext
+{
+public:
+    SimMonitor(std::string const& name);
+    ~SimMonitor();
+    void updateHook();
+    bool startHook();
+    bool configureHook();
+    bool gazeboConfigureHook(gazebo::physics::ModelPtr model);
+    void gazeboUpdateHook(gazebo::physics::ModelPtr model);
+
+    // non-RT, writes the last steps as CSV; returns false on error
+    bool dumpSteps(const std::string &path, int steps);
+
+protected:
+    struct StepSample {
+        double sim_time;    // [s]
+        int64_t wall_ns;    // the beginning of the step
+        int64_t step_ns;
+        int64_t hooks_ns;
+    };
+
+    void onWorldUpdateBegin();
+    void onWorldUpdateEnd();
+
+    void copySamples(int steps, std::vector<StepSample > &samples);
+
+    // properties
+    int samples_count_;
+    double step_budget_;            // [s], 0: from the physics settings
+    int overrun_dump_steps_;
+    std::string overrun_dump_path_; // empty: no dump
+    double overrun_dump_interval_;  // [s] of wall time
+
+    gazebo::physics::WorldPtr world_;
+    gazebo::event::ConnectionPtr begin_connection_;
+    gazebo::event::ConnectionPtr end_connection_;
+
+    int64_t step_begin_ns_;
+    int64_t budget_ns_;
+
+    // the ring of samples
+    std::vector<StepSample > samples_;
+    uint64_t samples_written_;
+
+    // the statistics of the current window
+    int64_t window_begin_ns_;
+    double window_begin_sim_time_;
+    uint32_t window_steps_;
+    int64_t window_step_sum_ns_;
+    int64_t window_step_max_ns_;
+    int64_t window_hooks_sum_ns_;
+    int64_t window_hooks_max_ns_;
+    int64_t window_physics_sum_ns_;
+    int64_t window_physics_max_ns_;
+    uint32_t window_overruns_;
+
+    int64_t last_dump_ns_;
+
+    // exchanged with updateHook
+    velma_sim_gazebo::SimStats stats_;
+    bool stats_ready_;
+    bool dump_requested_;
+
+    RTT::OutputPort<velma_sim_gazebo::SimStats > port_Stats_out_;
+
+    //! Synchronization
+    RTT::os::MutexRecursive gazebo_mutex_;
+};
+
+#endif  // SIM_MONITOR_H__
@@ -0,0 +1,167 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef SIM_PHYSICS_H__
+#define SIM_PHYSICS_H__
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Eigen/Dense"
+
+//
+// The joints and links of the simulated model, as seen by the update hooks
+// of the components. GazeboSimModel (sim_physics_gazebo.h) wraps the Gazebo
+// model and FakeSimModel (sim_physics_fake.h) is a scriptable model without
+// a world, used to run the hooks of the components in a loop.
+//
+
+struct SimVector3 {
+    double x;
+    double y;
+    double z;
+};
+
+// the inertia of a body, the rotational inertia is given about the CoG
+struct SimInertia {
+    double mass;
+    SimVector3 cog;
+    double ixx;
+    double ixy;
+    double ixz;
+    double iyy;
+    double iyz;
+    double izz;
+};
+
+class SimJoint {
+public:
+    virtual ~SimJoint() {}
+
+    virtual double getPosition() const = 0;
+    virtual double getVelocity() const = 0;
+
+    // the force set for the current step; the forces set in one step are
+    // added, as in Gazebo
+    virtual double getForce() const = 0;
+    virtual void setForce(double force) = 0;
+
+    // the force and torque applied to the child link, in the world frame
+    // (Joint::LinkForce and Joint::LinkTorque)
+    virtual void getLinkWrench(SimVector3 &force, SimVector3 &torque) const = 0;
+
+    // the force and torque applied to the child link, in the child link frame
+    // (body2 of Joint::GetForceTorque)
+    virtual void getChildWrench(SimVector3 &force, SimVector3 &torque) const = 0;
+};
+
+class SimLink {
+public:
+    virtual ~SimLink() {}
+
+    // the quaternion is (w, x, y, z)
+    virtual void getWorldPose(SimVector3 &position, double quaternion[4]) const = 0;
+};
+
+class SimSensor {
+public:
+    virtual ~SimSensor() {}
+
+    // non-RT, true if the sensor is updated, e.g. if there are subscribers
+    virtual bool isActive() const = 0;
+};
+
+// The joint-space dynamics of a serial chain of joints, with a tool attached
+// to the last link. The vectors and matrices have the size of the chain.
+class SimChainDynamics {
+public:
+    virtual ~SimChainDynamics() {}
+
+    virtual int getDofs() const = 0;
+
+    // RT, computes the mass matrix and the gravity torques for the current
+    // state; it may be called by every user of the model in a step
+    virtual void update() = 0;
+
+    virtual const Eigen::MatrixXd& getMassMatrix() const = 0;
+    virtual const Eigen::VectorXd& getGravityTorque() const = 0;
+
+    // RT, the torques C(q, dq) dq + g(q) for the current poses
+    virtual void getBiasTorques(const Eigen::VectorXd &dq, Eigen::VectorXd &bias) = 0;
+
+    // RT, predicts the state of the chain after the horizon [s], for constant
+    // joint torques; q_offset is the predicted change of the joint positions
+    virtual void predictState(const Eigen::VectorXd &dq, const Eigen::VectorXd &tau, double horizon,
+                                Eigen::VectorXd &q_offset, Eigen::VectorXd &dq_pred) = 0;
+
+    // RT, the new tool is used in the next update
+    virtual void setToolInertia(const SimInertia &tool) = 0;
+};
+
+typedef std::shared_ptr<SimJoint > SimJointPtr;
+typedef std::shared_ptr<SimLink > SimLinkPtr;
+typedef std::shared_ptr<SimSensor > SimSensorPtr;
+typedef std::shared_ptr<SimChainDynamics > SimChainDynamicsPtr;
+
+class SimModel {
+public:
+    virtual ~SimModel() {}
+
+    // the scoped name of the model
+    virtual std::string getName() const = 0;
+
+    virtual double getSimTime() const = 0;
+
+    // the number of the physics steps, e.g. to detect a missed step
+    virtual uint64_t getIterations() const = 0;
+    virtual double getMaxStepSize() const = 0;
+
+    // non-RT, NULL if there is no such joint or link
+    virtual SimJointPtr getJoint(const std::string &name) = 0;
+    virtual SimLinkPtr getLink(const std::string &name) = 0;
+
+    // non-RT, NULL if there is no such sensor; the sensors of the world may
+    // be created after the model, so the lookup can be repeated
+    virtual SimSensorPtr getSensor(const std::string &name) = 0;
+
+    // non-RT, the dynamics of the consecutive joints of one kinematic chain,
+    // NULL if the joints do not form such a chain
+    virtual SimChainDynamicsPtr createChainDynamics(const std::vector<std::string > &joint_names,
+                                                    const SimInertia &tool) = 0;
+
+    // non-RT, the position of the joint at the start of the simulation, with
+    // zero velocity; it may be written later, before the first component is
+    // started
+    virtual void setInitialPosition(const std::string &joint_name, double position) = 0;
+};
+
+typedef std::shared_ptr<SimModel > SimModelPtr;
+
+#endif  // SIM_PHYSICS_H__
@@ -0,0 +1,325 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "sim_physics_fake.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+SimVector3 zero() {
+    SimVector3 v;
+    v.x = v.y = v.z = 0;
+    return v;
+}
+
+}   // namespace
+
+FakeSimJoint::FakeSimJoint(double inertia, double damping)
+    : inertia_(inertia)
+    , damping_(damping)
+    , position_(0)
+    , velocity_(0)
+    , force_(0)
+    , link_force_(zero())
+    , link_torque_(zero())
+    , child_force_(zero())
+    , child_torque_(zero())
+{
+}
+
+double FakeSimJoint::getPosition() const {
+    return position_;
+}
+
+double FakeSimJoint::getVelocity() const {
+    return velocity_;
+}
+
+double FakeSimJoint::getForce() const {
+    return force_;
+}
+
+void FakeSimJoint::setForce(double force) {
+    force_ += force;
+}
+
+void FakeSimJoint::getLinkWrench(SimVector3 &force, SimVector3 &torque) const {
+    force = link_force_;
+    torque = link_torque_;
+}
+
+void FakeSimJoint::getChildWrench(SimVector3 &force, SimVector3 &torque) const {
+    force = child_force_;
+    torque = child_torque_;
+}
+
+void FakeSimJoint::setPosition(double position) {
+    position_ = position;
+}
+
+void FakeSimJoint::setVelocity(double velocity) {
+    velocity_ = velocity;
+}
+
+void FakeSimJoint::setLinkWrench(const SimVector3 &force, const SimVector3 &torque) {
+    link_force_ = force;
+    link_torque_ = torque;
+}
+
+void FakeSimJoint::setChildWrench(const SimVector3 &force, const SimVector3 &torque) {
+    child_force_ = force;
+    child_torque_ = torque;
+}
+
+double FakeSimJoint::getInertia() const {
+    return inertia_;
+}
+
+double FakeSimJoint::getDamping() const {
+    return damping_;
+}
+
+void FakeSimJoint::step(double dt) {
+    velocity_ += (force_ - damping_ * velocity_) / inertia_ * dt;
+    position_ += velocity_ * dt;
+    force_ = 0;
+}
+
+FakeSimLink::FakeSimLink()
+    : position_(zero())
+{
+    quaternion_[0] = 1;
+    quaternion_[1] = quaternion_[2] = quaternion_[3] = 0;
+}
+
+void FakeSimLink::getWorldPose(SimVector3 &position, double quaternion[4]) const {
+    position = position_;
+    for (int i = 0; i < 4; ++i) {
+        quaternion[i] = quaternion_[i];
+    }
+}
+
+void FakeSimLink::setWorldPose(const SimVector3 &position, const double quaternion[4]) {
+    position_ = position;
+    for (int i = 0; i < 4; ++i) {
+        quaternion_[i] = quaternion[i];
+    }
+}
+
+FakeSimSensor::FakeSimSensor()
+    : active_(false)
+{
+}
+
+bool FakeSimSensor::isActive() const {
+    return active_;
+}
+
+void FakeSimSensor::setActive(bool active) {
+    active_ = active;
+}
+
+FakeSimChainDynamics::FakeSimChainDynamics(const std::vector<std::shared_ptr<FakeSimJoint > > &joints)
+    : joints_(joints)
+    , mass_matrix_(Eigen::MatrixXd::Zero(joints.size(), joints.size()))
+    , grav_(Eigen::VectorXd::Zero(joints.size()))
+{
+    for (int i = 0; i < joints_.size(); ++i) {
+        mass_matrix_(i, i) = joints_[i]->getInertia();
+    }
+}
+
+int FakeSimChainDynamics::getDofs() const {
+    return joints_.size();
+}
+
+void FakeSimChainDynamics::update() {
+    // the mass matrix does not depend on the state
+}
+
+const Eigen::MatrixXd& FakeSimChainDynamics::getMassMatrix() const {
+    return mass_matrix_;
+}
+
+const Eigen::VectorXd& FakeSimChainDynamics::getGravityTorque() const {
+    return grav_;
+}
+
+void FakeSimChainDynamics::getBiasTorques(const Eigen::VectorXd &dq, Eigen::VectorXd &bias) {
+    for (int i = 0; i < joints_.size(); ++i) {
+        bias(i) = joints_[i]->getDamping() * dq(i);
+    }
+}
+
+void FakeSimChainDynamics::predictState(const Eigen::VectorXd &dq, const Eigen::VectorXd &tau, double horizon,
+                                        Eigen::VectorXd &q_offset, Eigen::VectorXd &dq_pred) {
+    // the solution of I ddq + d dq = tau
+    for (int i = 0; i < joints_.size(); ++i) {
+        const double inertia = joints_[i]->getInertia();
+        const double damping = joints_[i]->getDamping();
+        if (damping > 0.0) {
+            const double dq_inf = tau(i) / damping;
+            const double e = std::exp(-damping / inertia * horizon);
+            dq_pred(i) = dq_inf + (dq(i) - dq_inf) * e;
+            q_offset(i) = dq_inf * horizon + (dq(i) - dq_inf) * inertia / damping * (1.0 - e);
+        }
+        else {
+            const double ddq = tau(i) / inertia;
+            dq_pred(i) = dq(i) + ddq * horizon;
+            q_offset(i) = (dq(i) + 0.5 * ddq * horizon) * horizon;
+        }
+    }
+}
+
+void FakeSimChainDynamics::setToolInertia(const SimInertia &tool) {
+}
+
+FakeSimModel::FakeSimModel(const std::string &name)
+    : name_(name)
+    , sim_time_(0)
+    , iterations_(0)
+    , max_step_(0.001)
+{
+}
+
+std::string FakeSimModel::getName() const {
+    return name_;
+}
+
+double FakeSimModel::getSimTime() const {
+    return sim_time_;
+}
+
+uint64_t FakeSimModel::getIterations() const {
+    return iterations_;
+}
+
+double FakeSimModel::getMaxStepSize() const {
+    return max_step_;
+}
+
+SimJointPtr FakeSimModel::getJoint(const std::string &name) {
+    return getFakeJoint(name);
+}
+
+SimLinkPtr FakeSimModel::getLink(const std::string &name) {
+    return getFakeLink(name);
+}
+
+SimSensorPtr FakeSimModel::getSensor(const std::string &name) {
+    return getFakeSensor(name);
+}
+
+SimChainDynamicsPtr FakeSimModel::createChainDynamics(const std::vector<std::string > &joint_names,
+                                                        const SimInertia &tool) {
+    std::vector<std::shared_ptr<FakeSimJoint > > joints;
+    for (int i = 0; i < joint_names.size(); ++i) {
+        std::shared_ptr<FakeSimJoint > joint = getFakeJoint(joint_names[i]);
+        if (!joint) {
+            return SimChainDynamicsPtr();
+        }
+        joints.push_back(joint);
+    }
+    if (joints.empty()) {
+        return SimChainDynamicsPtr();
+    }
+    return SimChainDynamicsPtr(new FakeSimChainDynamics(joints));
+}
+
+void FakeSimModel::setInitialPosition(const std::string &joint_name, double position) {
+    std::shared_ptr<FakeSimJoint > joint = getFakeJoint(joint_name);
+    if (joint) {
+        joint->setPosition(position);
+        joint->setVelocity(0.0);
+    }
+}
+
+std::shared_ptr<FakeSimJoint > FakeSimModel::addJoint(const std::string &name, double inertia, double damping) {
+    std::shared_ptr<FakeSimJoint > joint(new FakeSimJoint(inertia, damping));
+    std::shared_ptr<FakeSimJoint > &j = joints_[name];
+    if (j) {
+        joints_list_.erase(std::find(joints_list_.begin(), joints_list_.end(), j.get()));
+    }
+    j = joint;
+    joints_list_.push_back(joint.get());
+    return joint;
+}
+
+std::shared_ptr<FakeSimLink > FakeSimModel::addLink(const std::string &name) {
+    std::shared_ptr<FakeSimLink > link(new FakeSimLink());
+    links_[name] = link;
+    return link;
+}
+
+std::shared_ptr<FakeSimJoint > FakeSimModel::getFakeJoint(const std::string &name) const {
+    std::map<std::string, std::shared_ptr<FakeSimJoint > >::const_iterator it = joints_.find(name);
+    if (it == joints_.end()) {
+        return std::shared_ptr<FakeSimJoint >();
+    }
+    return it->second;
+}
+
+std::shared_ptr<FakeSimLink > FakeSimModel::getFakeLink(const std::string &name) const {
+    std::map<std::string, std::shared_ptr<FakeSimLink > >::const_iterator it = links_.find(name);
+    if (it == links_.end()) {
+        return std::shared_ptr<FakeSimLink >();
+    }
+    return it->second;
+}
+
+std::shared_ptr<FakeSimSensor > FakeSimModel::addSensor(const std::string &name) {
+    std::shared_ptr<FakeSimSensor > sensor(new FakeSimSensor());
+    sensors_[name] = sensor;
+    return sensor;
+}
+
+std::shared_ptr<FakeSimSensor > FakeSimModel::getFakeSensor(const std::string &name) const {
+    std::map<std::string, std::shared_ptr<FakeSimSensor > >::const_iterator it = sensors_.find(name);
+    if (it == sensors_.end()) {
+        return std::shared_ptr<FakeSimSensor >();
+    }
+    return it->second;
+}
+
+void FakeSimModel::setScript(const Script &script) {
+    script_ = script;
+}
+
+void FakeSimModel::step(double dt) {
+    for (int i = 0; i < joints_list_.size(); ++i) {
+        joints_list_[i]->step(dt);
+    }
+    sim_time_ += dt;
+    ++iterations_;
+    max_step_ = dt;
+    if (script_) {
+        script_(*this);
+    }
+}
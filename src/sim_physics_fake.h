@@ -0,0 +1,177 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef SIM_PHYSICS_FAKE_H__
+#define SIM_PHYSICS_FAKE_H__
+
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "sim_physics.h"
+
+//
+// A model without Gazebo. Every joint is a single inertia with viscous
+// damping, driven by the forces set in the step; the wrenches, the poses and
+// the activity of the sensors are set by the user. The script is called after every step, so it can set
+// the state seen by the next update of the components, e.g.
+//
+//   std::shared_ptr<FakeSimModel > model(new FakeSimModel());
+//   model->addJoint("torso_0_joint");
+//   component.simConfigureHook(model);
+//   for (...) { component.simUpdateHook(); model->step(0.001); }
+//
+
+class FakeSimJoint : public SimJoint {
+public:
+    FakeSimJoint(double inertia, double damping);
+
+    virtual double getPosition() const;
+    virtual double getVelocity() const;
+    virtual double getForce() const;
+    virtual void setForce(double force);
+    virtual void getLinkWrench(SimVector3 &force, SimVector3 &torque) const;
+    virtual void getChildWrench(SimVector3 &force, SimVector3 &torque) const;
+
+    void setPosition(double position);
+    void setVelocity(double velocity);
+    void setLinkWrench(const SimVector3 &force, const SimVector3 &torque);
+    void setChildWrench(const SimVector3 &force, const SimVector3 &torque);
+
+    double getInertia() const;
+    double getDamping() const;
+
+    // semi-implicit Euler, the force is cleared as in Gazebo
+    void step(double dt);
+
+protected:
+    double inertia_;
+    double damping_;
+    double position_;
+    double velocity_;
+    double force_;
+    SimVector3 link_force_;
+    SimVector3 link_torque_;
+    SimVector3 child_force_;
+    SimVector3 child_torque_;
+};
+
+class FakeSimLink : public SimLink {
+public:
+    FakeSimLink();
+
+    virtual void getWorldPose(SimVector3 &position, double quaternion[4]) const;
+
+    void setWorldPose(const SimVector3 &position, const double quaternion[4]);
+
+protected:
+    SimVector3 position_;
+    double quaternion_[4];
+};
+
+class FakeSimSensor : public SimSensor {
+public:
+    FakeSimSensor();
+
+    virtual bool isActive() const;
+
+    void setActive(bool active);
+
+protected:
+    bool active_;
+};
+
+// The exact dynamics of the independent joints of FakeSimModel: the mass
+// matrix is diagonal, there is no gravity and the viscous damping of the
+// joints is a part of the bias torques. The tool is ignored.
+class FakeSimChainDynamics : public SimChainDynamics {
+public:
+    explicit FakeSimChainDynamics(const std::vector<std::shared_ptr<FakeSimJoint > > &joints);
+
+    virtual int getDofs() const;
+    virtual void update();
+    virtual const Eigen::MatrixXd& getMassMatrix() const;
+    virtual const Eigen::VectorXd& getGravityTorque() const;
+    virtual void getBiasTorques(const Eigen::VectorXd &dq, Eigen::VectorXd &bias);
+    virtual void predictState(const Eigen::VectorXd &dq, const Eigen::VectorXd &tau, double horizon,
+                                Eigen::VectorXd &q_offset, Eigen::VectorXd &dq_pred);
+    virtual void setToolInertia(const SimInertia &tool);
+
+protected:
+    std::vector<std::shared_ptr<FakeSimJoint > > joints_;
+    Eigen::MatrixXd mass_matrix_;
+    Eigen::VectorXd grav_;
+};
+
+class FakeSimModel : public SimModel {
+public:
+    typedef std::function<void(FakeSimModel &model)> Script;
+
+    explicit FakeSimModel(const std::string &name = "fake_model");
+
+    virtual std::string getName() const;
+    virtual double getSimTime() const;
+    virtual uint64_t getIterations() const;
+    virtual double getMaxStepSize() const;
+    virtual SimJointPtr getJoint(const std::string &name);
+    virtual SimLinkPtr getLink(const std::string &name);
+    virtual SimSensorPtr getSensor(const std::string &name);
+
+    // any joints of the model form a chain
+    virtual SimChainDynamicsPtr createChainDynamics(const std::vector<std::string > &joint_names,
+                                                    const SimInertia &tool);
+
+    // the position is written at once
+    virtual void setInitialPosition(const std::string &joint_name, double position);
+
+    std::shared_ptr<FakeSimJoint > addJoint(const std::string &name, double inertia = 1.0, double damping = 0.0);
+    std::shared_ptr<FakeSimLink > addLink(const std::string &name);
+    std::shared_ptr<FakeSimSensor > addSensor(const std::string &name);
+
+    std::shared_ptr<FakeSimJoint > getFakeJoint(const std::string &name) const;
+    std::shared_ptr<FakeSimLink > getFakeLink(const std::string &name) const;
+    std::shared_ptr<FakeSimSensor > getFakeSensor(const std::string &name) const;
+
+    void setScript(const Script &script);
+
+    // integrates all joints, advances the time and calls the script
+    void step(double dt);
+
+protected:
+    std::string name_;
+    double sim_time_;
+    uint64_t iterations_;
+    double max_step_;
+    std::map<std::string, std::shared_ptr<FakeSimJoint > > joints_;
+    std::map<std::string, std::shared_ptr<FakeSimLink > > links_;
+    std::map<std::string, std::shared_ptr<FakeSimSensor > > sensors_;
+    std::vector<FakeSimJoint* > joints_list_;
+    Script script_;
+};
+
+#endif  // SIM_PHYSICS_FAKE_H__
@@ -0,0 +1,238 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "sim_physics_gazebo.h"
+#include "topology_cache.h"
+#include "startup_coordinator.h"
+
+#include <gazebo/sensors/sensors.hh>
+
+#include <rtt/Logger.hpp>
+
+using namespace RTT;
+
+namespace {
+
+SimVector3 toSim(const ignition::math::Vector3d &v) {
+    SimVector3 result;
+    result.x = v.X();
+    result.y = v.Y();
+    result.z = v.Z();
+    return result;
+}
+
+}   // namespace
+
+GazeboSimJoint::GazeboSimJoint(gazebo::physics::JointPtr joint)
+    : joint_(joint)
+{
+}
+
+double GazeboSimJoint::getPosition() const {
+    return joint_->Position(0);
+}
+
+double GazeboSimJoint::getVelocity() const {
+    return joint_->GetVelocity(0);
+}
+
+double GazeboSimJoint::getForce() const {
+    return joint_->GetForce(0);
+}
+
+void GazeboSimJoint::setForce(double force) {
+    joint_->SetForce(0, force);
+}
+
+void GazeboSimJoint::getLinkWrench(SimVector3 &force, SimVector3 &torque) const {
+    force = toSim(joint_->LinkForce(0));
+    torque = toSim(joint_->LinkTorque(0));
+}
+
+void GazeboSimJoint::getChildWrench(SimVector3 &force, SimVector3 &torque) const {
+    gazebo::physics::JointWrench wr = joint_->GetForceTorque(0u);
+    force = toSim(wr.body2Force);
+    torque = toSim(wr.body2Torque);
+}
+
+GazeboSimLink::GazeboSimLink(gazebo::physics::LinkPtr link)
+    : link_(link)
+{
+}
+
+void GazeboSimLink::getWorldPose(SimVector3 &position, double quaternion[4]) const {
+    const ignition::math::Pose3d &pose = link_->WorldPose();
+    position = toSim(pose.Pos());
+    quaternion[0] = pose.Rot().W();
+    quaternion[1] = pose.Rot().X();
+    quaternion[2] = pose.Rot().Y();
+    quaternion[3] = pose.Rot().Z();
+}
+
+GazeboSimSensor::GazeboSimSensor(gazebo::sensors::SensorPtr sensor)
+    : sensor_(sensor)
+{
+}
+
+bool GazeboSimSensor::isActive() const {
+    return sensor_->IsActive();
+}
+
+GazeboSimChainDynamics::GazeboSimChainDynamics(gazebo::physics::ModelPtr model,
+                                                const std::vector<gazebo::physics::JointPtr > &joints,
+                                                const SimInertia &tool)
+    : model_(model)
+    , dyn_(model, joints, tool.mass, ignition::math::Vector3d(tool.cog.x, tool.cog.y, tool.cog.z),
+            tool.ixx, tool.ixy, tool.ixz, tool.iyy, tool.iyz, tool.izz)
+{
+    // the batched mass matrix of the arms is set up here
+    LWRDynamicsWorker::getInstance().registerArm(&dyn_);
+}
+
+GazeboSimChainDynamics::~GazeboSimChainDynamics() {
+    LWRDynamicsWorker::getInstance().unregisterArm(&dyn_);
+}
+
+int GazeboSimChainDynamics::getDofs() const {
+    return dyn_.getDofs();
+}
+
+void GazeboSimChainDynamics::update() {
+    // the dynamics of all chains are computed in one pass, by the first user updated in this step
+    LWRDynamicsWorker::getInstance().update(model_->GetWorld()->Iterations());
+}
+
+const Eigen::MatrixXd& GazeboSimChainDynamics::getMassMatrix() const {
+    return dyn_.getMassMatrix();
+}
+
+const Eigen::VectorXd& GazeboSimChainDynamics::getGravityTorque() const {
+    return dyn_.getGravityTorque();
+}
+
+void GazeboSimChainDynamics::getBiasTorques(const Eigen::VectorXd &dq, Eigen::VectorXd &bias) {
+    dyn_.getManipulator().getBiasTorques(dq, model_->GetWorld()->Gravity(), bias);
+}
+
+void GazeboSimChainDynamics::predictState(const Eigen::VectorXd &dq, const Eigen::VectorXd &tau, double horizon,
+                                            Eigen::VectorXd &q_offset, Eigen::VectorXd &dq_pred) {
+    // the torques are applied for the whole horizon, the contacts are not predicted
+    dyn_.getManipulator().predictState(dq, tau, model_->GetWorld()->Gravity(), horizon,
+            model_->GetWorld()->Physics()->GetMaxStepSize(), q_offset, dq_pred);
+}
+
+void GazeboSimChainDynamics::setToolInertia(const SimInertia &tool) {
+    dyn_.setToolInertia(tool.mass, ignition::math::Vector3d(tool.cog.x, tool.cog.y, tool.cog.z),
+            tool.ixx, tool.ixy, tool.ixz, tool.iyy, tool.iyz, tool.izz);
+}
+
+GazeboSimModel::GazeboSimModel(gazebo::physics::ModelPtr model)
+    : model_(model)
+{
+}
+
+std::string GazeboSimModel::getName() const {
+    return model_->GetScopedName();
+}
+
+double GazeboSimModel::getSimTime() const {
+    return model_->GetWorld()->SimTime().Double();
+}
+
+uint64_t GazeboSimModel::getIterations() const {
+    return model_->GetWorld()->Iterations();
+}
+
+double GazeboSimModel::getMaxStepSize() const {
+    return model_->GetWorld()->Physics()->GetMaxStepSize();
+}
+
+SimJointPtr GazeboSimModel::getJoint(const std::string &name) {
+    gazebo::physics::JointPtr joint = TopologyCache::getInstance(model_).getJoint(name);
+    if (!joint) {
+        return SimJointPtr();
+    }
+    return SimJointPtr(new GazeboSimJoint(joint));
+}
+
+SimLinkPtr GazeboSimModel::getLink(const std::string &name) {
+    gazebo::physics::LinkPtr link = TopologyCache::getInstance(model_).getLink(name);
+    if (!link) {
+        return SimLinkPtr();
+    }
+    return SimLinkPtr(new GazeboSimLink(link));
+}
+
+SimSensorPtr GazeboSimModel::getSensor(const std::string &name) {
+    gazebo::sensors::SensorPtr sensor = gazebo::sensors::SensorManager::Instance()->GetSensor(name);
+    if (!sensor) {
+        return SimSensorPtr();
+    }
+    return SimSensorPtr(new GazeboSimSensor(sensor));
+}
+
+SimChainDynamicsPtr GazeboSimModel::createChainDynamics(const std::vector<std::string > &joint_names,
+                                                        const SimInertia &tool) {
+    Logger::In in("GazeboSimModel::createChainDynamics");
+
+    const TopologyCache &topology = TopologyCache::getInstance(model_);
+    std::vector<gazebo::physics::JointPtr > joints;
+    for (int i = 0; i < joint_names.size(); ++i) {
+        gazebo::physics::JointPtr joint = topology.getJoint(joint_names[i]);
+        if (!joint) {
+            Logger::log() << Logger::Error << "could not find joint " << joint_names[i] << Logger::endl;
+            return SimChainDynamicsPtr();
+        }
+        joints.push_back(joint);
+    }
+    if (joints.empty()) {
+        Logger::log() << Logger::Error << "the chain has no joints" << Logger::endl;
+        return SimChainDynamicsPtr();
+    }
+
+    // the joints must be the consecutive joints of one kinematic chain,
+    // as the dynamics model is built from the chain
+    for (int i = joints.size() - 1; i > 0; --i) {
+        if (topology.getParentJoint(joints[i]->GetParent()) != joints[i-1]) {
+            Logger::log() << Logger::Error << "the chain from " << joint_names.front() << " to "
+                << joint_names.back() << " does not match the joint list: the parent joint of "
+                << joint_names[i] << " is not " << joint_names[i-1] << Logger::endl;
+            return SimChainDynamicsPtr();
+        }
+    }
+
+    return SimChainDynamicsPtr(new GazeboSimChainDynamics(model_, joints, tool));
+}
+
+void GazeboSimModel::setInitialPosition(const std::string &joint_name, double position) {
+    gazebo::physics::JointPtr joint = TopologyCache::getInstance(model_).getJoint(joint_name);
+    if (joint) {
+        // the positions of all components are written at once, before the first one is started
+        StartupCoordinator::getInstance().queueInitialPosition(joint, position);
+    }
+}
@@ -0,0 +1,118 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef SIM_PHYSICS_GAZEBO_H__
+#define SIM_PHYSICS_GAZEBO_H__
+
+#include <gazebo/gazebo.hh>
+#include <gazebo/physics/physics.hh>
+#include <gazebo/sensors/SensorTypes.hh>
+
+#include "sim_physics.h"
+#include "lwr_dynamics_worker.h"
+
+class GazeboSimJoint : public SimJoint {
+public:
+    explicit GazeboSimJoint(gazebo::physics::JointPtr joint);
+
+    virtual double getPosition() const;
+    virtual double getVelocity() const;
+    virtual double getForce() const;
+    virtual void setForce(double force);
+    virtual void getLinkWrench(SimVector3 &force, SimVector3 &torque) const;
+    virtual void getChildWrench(SimVector3 &force, SimVector3 &torque) const;
+
+protected:
+    gazebo::physics::JointPtr joint_;
+};
+
+class GazeboSimLink : public SimLink {
+public:
+    explicit GazeboSimLink(gazebo::physics::LinkPtr link);
+
+    virtual void getWorldPose(SimVector3 &position, double quaternion[4]) const;
+
+protected:
+    gazebo::physics::LinkPtr link_;
+};
+
+class GazeboSimSensor : public SimSensor {
+public:
+    explicit GazeboSimSensor(gazebo::sensors::SensorPtr sensor);
+
+    virtual bool isActive() const;
+
+protected:
+    gazebo::sensors::SensorPtr sensor_;
+};
+
+// ArmDynamics, computed by the shared dynamics worker together with the other
+// chains of the world; the chain is registered in the worker while it exists
+class GazeboSimChainDynamics : public SimChainDynamics {
+public:
+    GazeboSimChainDynamics(gazebo::physics::ModelPtr model, const std::vector<gazebo::physics::JointPtr > &joints,
+                            const SimInertia &tool);
+    virtual ~GazeboSimChainDynamics();
+
+    virtual int getDofs() const;
+    virtual void update();
+    virtual const Eigen::MatrixXd& getMassMatrix() const;
+    virtual const Eigen::VectorXd& getGravityTorque() const;
+    virtual void getBiasTorques(const Eigen::VectorXd &dq, Eigen::VectorXd &bias);
+    virtual void predictState(const Eigen::VectorXd &dq, const Eigen::VectorXd &tau, double horizon,
+                                Eigen::VectorXd &q_offset, Eigen::VectorXd &dq_pred);
+    virtual void setToolInertia(const SimInertia &tool);
+
+protected:
+    gazebo::physics::ModelPtr model_;
+    ArmDynamics dyn_;
+};
+
+// the names are resolved with the topology cache of the model, and the
+// sensors with the sensor manager; the initial positions are written by
+// the startup coordinator
+class GazeboSimModel : public SimModel {
+public:
+    explicit GazeboSimModel(gazebo::physics::ModelPtr model);
+
+    virtual std::string getName() const;
+    virtual double getSimTime() const;
+    virtual uint64_t getIterations() const;
+    virtual double getMaxStepSize() const;
+    virtual SimJointPtr getJoint(const std::string &name);
+    virtual SimLinkPtr getLink(const std::string &name);
+    virtual SimSensorPtr getSensor(const std::string &name);
+    virtual SimChainDynamicsPtr createChainDynamics(const std::vector<std::string > &joint_names,
+                                                    const SimInertia &tool);
+    virtual void setInitialPosition(const std::string &joint_name, double position);
+
+protected:
+    gazebo::physics::ModelPtr model_;
+};
+
+#endif  // SIM_PHYSICS_GAZEBO_H__
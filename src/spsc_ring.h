@@ -0,0 +1,88 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef SPSC_RING_H__
+#define SPSC_RING_H__
+
+#include <stddef.h>
+#include <atomic>
+
+//
+// Preallocated lock-free ring with a single producer and a single consumer
+// thread. The producer calls full() and push(), the consumer calls front()
+// and pop(). Neither of them blocks or allocates memory.
+//
+template <typename T, size_t N >
+class SpscRing {
+public:
+    SpscRing()
+        : head_(0)
+        , tail_(0)
+    {}
+
+    // producer
+    bool full() const {
+        return head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_acquire) == N;
+    }
+
+    // producer, fails if the ring is full
+    bool push(const T &item) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) == N) {
+            return false;
+        }
+        items_[head % N] = item;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer, the oldest item or NULL if the ring is empty
+    const T* front() const {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (head_.load(std::memory_order_acquire) == tail) {
+            return NULL;
+        }
+        return &items_[tail % N];
+    }
+
+    // consumer, removes the item returned by front()
+    void pop() {
+        tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    T items_[N];
+
+    // the indices are written by different threads, so they are kept in separate cache lines
+    char pad0_[64];
+    std::atomic<size_t > head_;     // the number of pushed items, written by the producer
+    char pad1_[64];
+    std::atomic<size_t > tail_;     // the number of popped items, written by the consumer
+};
+
+#endif  // SPSC_RING_H__
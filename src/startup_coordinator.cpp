@@ -0,0 +1,346 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "startup_coordinator.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+#include <boost/thread/locks.hpp>
+
+#include <gazebo/physics/dart/DARTJoint.hh>
+
+#include <rtt/Logger.hpp>
+
+#include "topology_cache.h"
+
+using namespace RTT;
+
+namespace {
+
+double ticksToSeconds(RTT::os::TimeService::ticks t) {
+    return RTT::os::TimeService::ticks2nsecs(t) * 1.0e-9;
+}
+
+struct SkeletonState {
+    std::vector<size_t > indices;
+    std::vector<double > positions;
+    std::vector<double > velocities;
+};
+
+}   // namespace
+
+StartupCoordinator& StartupCoordinator::getInstance() {
+    static StartupCoordinator coordinator;
+    return coordinator;
+}
+
+StartupCoordinator::StartupCoordinator()
+    : next_id_(0)
+    , stop_(false)
+    , snapshot_opened_(false)
+    , snapshot_applied_(false)
+    , created_(RTT::os::TimeService::Instance()->getTicks())
+{
+}
+
+StartupCoordinator::~StartupCoordinator() {
+    {
+        RTT::os::MutexLock lock(mutex_);
+        stop_ = true;
+        cond_.broadcast();
+    }
+    for (int i = 0; i < workers_.size(); ++i) {
+        workers_[i].join();
+    }
+}
+
+int StartupCoordinator::submit(const std::string &component, const std::string &phase, const Task &task) {
+    RTT::os::MutexLock lock(mutex_);
+
+    // the pool is created at the first use
+    if (workers_.empty()) {
+        const int workers_count = std::max(2u, std::min(8u, std::thread::hardware_concurrency()));
+        for (int i = 0; i < workers_count; ++i) {
+            workers_.push_back(std::thread(&StartupCoordinator::workerLoop, this));
+        }
+    }
+
+    Job job;
+    job.id = next_id_++;
+    job.component = component;
+    job.phase = phase;
+    job.task = task;
+    jobs_.push_back(job);
+    running_.push_back(job.id);
+    cond_.broadcast();
+    return job.id;
+}
+
+bool StartupCoordinator::wait(int id) {
+    RTT::os::MutexLock lock(mutex_);
+    while (true) {
+        for (int i = 0; i < results_.size(); ++i) {
+            if (results_[i].first == id) {
+                return results_[i].second;
+            }
+        }
+        if (std::find(running_.begin(), running_.end(), id) == running_.end()) {
+            // unknown task
+            return false;
+        }
+        cond_.wait(mutex_);
+    }
+}
+
+void StartupCoordinator::workerLoop() {
+    while (true) {
+        Job job;
+        {
+            RTT::os::MutexLock lock(mutex_);
+            while (jobs_.empty() && !stop_) {
+                cond_.wait(mutex_);
+            }
+            if (stop_) {
+                return;
+            }
+            job = jobs_.front();
+            jobs_.pop_front();
+        }
+
+        const RTT::os::TimeService::ticks start = RTT::os::TimeService::Instance()->getTicks();
+        const bool result = job.task();
+        const RTT::os::TimeService::ticks end = RTT::os::TimeService::Instance()->getTicks();
+        record(job.component, job.phase, start, end, true);
+
+        RTT::os::MutexLock lock(mutex_);
+        results_.push_back(std::make_pair(job.id, result));
+        running_.erase(std::remove(running_.begin(), running_.end(), job.id), running_.end());
+        cond_.broadcast();
+    }
+}
+
+void StartupCoordinator::queueInitialPosition(gazebo::physics::JointPtr joint, double position) {
+    RTT::os::MutexLock lock(mutex_);
+    InitialJointState s;
+    s.joint = joint;
+    s.position = position;
+    s.velocity = 0;
+    initial_state_.push_back(s);
+}
+
+void StartupCoordinator::openSnapshot() {
+    // the mutex is locked by the caller
+    if (snapshot_opened_) {
+        return;
+    }
+    snapshot_opened_ = true;
+
+    const char *path = getenv("VELMA_SIM_STATE_SNAPSHOT");
+    if (!path || path[0] == 0) {
+        return;
+    }
+    const char *name = getenv("VELMA_SIM_STATE_SNAPSHOT_NAME");
+    if (!name || name[0] == 0) {
+        name = "home";
+    }
+
+    Logger::In in("StartupCoordinator::openSnapshot");
+    if (!snapshot_.open(path)) {
+        Logger::log() << Logger::Error << "could not open state snapshot file " << path << Logger::endl;
+        return;
+    }
+    if (!snapshot_.select(name)) {
+        std::vector<std::string > names = snapshot_.getNames();
+        std::ostringstream os;
+        for (int i = 0; i < names.size(); ++i) {
+            os << " " << names[i];
+        }
+        Logger::log() << Logger::Error << "there is no snapshot \"" << name << "\" in " << path
+            << ", available snapshots:" << os.str() << Logger::endl;
+        snapshot_.close();
+        return;
+    }
+    Logger::log() << Logger::Info << "using snapshot \"" << name << "\" from " << path << Logger::endl;
+}
+
+bool StartupCoordinator::getComponentState(const std::string &component, const std::string &key,
+                                            std::vector<double > &values) {
+    RTT::os::MutexLock lock(mutex_);
+    openSnapshot();
+    return snapshot_.getComponentState(component, key, values);
+}
+
+void StartupCoordinator::applyInitialState() {
+    std::vector<InitialJointState > state;
+    std::vector<StateSnapshot::Joint > snapshot_joints;
+    {
+        RTT::os::MutexLock lock(mutex_);
+        // the tasks of the pool queue the initial positions of their components
+        while (!running_.empty()) {
+            cond_.wait(mutex_);
+        }
+        state.swap(initial_state_);
+        openSnapshot();
+        if (!snapshot_applied_) {
+            snapshot_applied_ = true;
+            snapshot_joints.resize(snapshot_.getJointsCount());
+            for (int i = 0; i < snapshot_joints.size(); ++i) {
+                snapshot_.getJoint(i, snapshot_joints[i]);
+            }
+        }
+    }
+
+    if (!end_connection_) {
+        end_connection_ = gazebo::event::Events::ConnectWorldUpdateEnd(std::bind(&StartupCoordinator::onWorldUpdateEnd, this));
+    }
+
+    // the components without Gazebo, e.g. with FakeSimModel, do not queue
+    // any positions, and there may be no world
+    if (state.empty() && snapshot_joints.empty()) {
+        return;
+    }
+    gazebo::physics::WorldPtr world = gazebo::physics::get_world();
+
+    // the snapshot is written after the positions set by the components
+    if (!snapshot_joints.empty()) {
+        Logger::In in("StartupCoordinator::applyInitialState");
+        for (int i = 0; i < snapshot_joints.size(); ++i) {
+            const StateSnapshot::Joint &sj = snapshot_joints[i];
+            gazebo::physics::ModelPtr model = world ? world->ModelByName(sj.model) : gazebo::physics::ModelPtr();
+            gazebo::physics::JointPtr joint = model ? TopologyCache::getInstance(model).getJoint(sj.joint)
+                                                    : gazebo::physics::JointPtr();
+            if (!joint) {
+                Logger::log() << Logger::Warning << "the joint " << sj.model << "::" << sj.joint
+                    << " of the state snapshot does not exist" << Logger::endl;
+                continue;
+            }
+            InitialJointState s;
+            s.joint = joint;
+            s.position = sj.position;
+            s.velocity = sj.velocity;
+            state.push_back(s);
+        }
+    }
+
+    if (state.empty()) {
+        return;
+    }
+
+    const RTT::os::TimeService::ticks start = RTT::os::TimeService::Instance()->getTicks();
+
+    // the state is written from the Orocos thread, between the physics steps
+    boost::unique_lock<boost::recursive_mutex > physics_lock;
+    if (world) {
+        physics_lock = boost::unique_lock<boost::recursive_mutex >(*world->Physics()->GetPhysicsUpdateMutex());
+    }
+
+    // one write per DART skeleton; the joints of the other engines are written
+    // with one write per Gazebo model
+    std::map<dart::dynamics::Skeleton*, SkeletonState > skeletons;
+    std::map<gazebo::physics::ModelPtr, std::map<std::string, double > > models;
+    std::vector<int > other_joints;
+    for (int i = 0; i < state.size(); ++i) {
+        gazebo::physics::DARTJointPtr joint_dart = boost::dynamic_pointer_cast<gazebo::physics::DARTJoint>(state[i].joint);
+        if (joint_dart != NULL) {
+            dart::dynamics::Joint *joint = joint_dart->GetDARTJoint();
+            SkeletonState &s = skeletons[joint->getSkeleton().get()];
+            s.indices.push_back(joint->getIndexInSkeleton(0));
+            s.positions.push_back(state[i].position);
+            s.velocities.push_back(state[i].velocity);
+        }
+        else {
+            models[state[i].joint->GetChild()->GetModel()][state[i].joint->GetScopedName()] = state[i].position;
+            other_joints.push_back(i);
+        }
+    }
+
+    for (std::map<dart::dynamics::Skeleton*, SkeletonState >::iterator it = skeletons.begin(); it != skeletons.end(); ++it) {
+        const SkeletonState &s = it->second;
+        it->first->setPositions(s.indices, Eigen::Map<const Eigen::VectorXd >(&s.positions[0], s.indices.size()));
+        it->first->setVelocities(s.indices, Eigen::Map<const Eigen::VectorXd >(&s.velocities[0], s.indices.size()));
+    }
+
+    for (std::map<gazebo::physics::ModelPtr, std::map<std::string, double > >::iterator it = models.begin();
+            it != models.end(); ++it) {
+        it->first->SetJointPositions(it->second);
+    }
+    for (int i = 0; i < other_joints.size(); ++i) {
+        state[other_joints[i]].joint->SetVelocity(0, state[other_joints[i]].velocity);
+    }
+
+    record("StartupCoordinator", "initial state", start, RTT::os::TimeService::Instance()->getTicks(), false);
+}
+
+void StartupCoordinator::record(const std::string &component, const std::string &phase,
+                    RTT::os::TimeService::ticks start, RTT::os::TimeService::ticks end, bool concurrent) {
+    PhaseRecord r;
+    r.component = component;
+    r.phase = phase;
+    r.start = ticksToSeconds(start - created_);
+    r.duration = ticksToSeconds(end - start);
+    r.concurrent = concurrent;
+
+    RTT::os::MutexLock lock(mutex_);
+    phases_.push_back(r);
+}
+
+void StartupCoordinator::onWorldUpdateEnd() {
+    // called once; the connection is removed by Gazebo after the callback
+    end_connection_.reset();
+
+    const double now = ticksToSeconds(RTT::os::TimeService::Instance()->getTicks() - created_);
+
+    std::ostringstream os;
+    os << std::fixed << std::setprecision(3);
+    {
+        RTT::os::MutexLock lock(mutex_);
+        for (int i = 0; i < phases_.size(); ++i) {
+            os << "\n    " << std::setw(8) << phases_[i].start << " s  " << std::setw(8) << phases_[i].duration << " s  "
+                << phases_[i].component << ": " << phases_[i].phase << (phases_[i].concurrent ? " (pool)" : "");
+        }
+    }
+    os << "\n    " << std::setw(8) << now << " s  first physics step";
+
+    Logger::In in("StartupCoordinator");
+    Logger::log() << Logger::Info << "startup time (start, duration, phase):" << os.str() << Logger::endl;
+}
+
+StartupCoordinator::ScopedPhase::ScopedPhase(const std::string &component, const std::string &phase)
+    : component_(component)
+    , phase_(phase)
+    , start_(RTT::os::TimeService::Instance()->getTicks())
+{
+}
+
+StartupCoordinator::ScopedPhase::~ScopedPhase() {
+    StartupCoordinator::getInstance().record(component_, phase_, start_,
+            RTT::os::TimeService::Instance()->getTicks(), false);
+}
@@ -0,0 +1,146 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef STARTUP_COORDINATOR_H__
+#define STARTUP_COORDINATOR_H__
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <deque>
+
+#include <gazebo/gazebo.hh>
+#include <gazebo/common/Events.hh>
+#include <gazebo/physics/physics.hh>
+
+#include <rtt/os/Mutex.hpp>
+#include <rtt/os/Condition.hpp>
+#include <rtt/os/TimeService.hpp>
+
+#include "state_snapshot.h"
+
+//
+// Startup of the simulated components. The expensive parts of the
+// configuration are run concurrently on a pool of worker threads, so the
+// deployer can configure the next component in the meantime. The initial
+// positions of all components are queued and written at once, before the
+// first component is started, together with the state snapshot selected with
+// the VELMA_SIM_STATE_SNAPSHOT and VELMA_SIM_STATE_SNAPSHOT_NAME environment
+// variables. The duration of every phase is recorded and the report is logged
+// at the end of the first physics step after the initial state is written.
+//
+class StartupCoordinator {
+public:
+    typedef std::function<bool()> Task;
+
+    static StartupCoordinator& getInstance();
+
+    ~StartupCoordinator();
+
+    // non-RT, runs the task on the pool; returns the id of the task
+    int submit(const std::string &component, const std::string &phase, const Task &task);
+
+    // non-RT, waits for the task and returns its result
+    bool wait(int id);
+
+    // non-RT, the position is written by applyInitialState()
+    void queueInitialPosition(gazebo::physics::JointPtr joint, double position);
+
+    // non-RT, waits for all tasks of the pool and writes all queued positions
+    // with zero velocities and the joints of the state snapshot; the physics
+    // step is locked during the write
+    void applyInitialState();
+
+    // non-RT, the internal state of the component in the state snapshot
+    bool getComponentState(const std::string &component, const std::string &key, std::vector<double > &values);
+
+    // records the duration of a phase of the configuration in a scope
+    class ScopedPhase {
+    public:
+        ScopedPhase(const std::string &component, const std::string &phase);
+        ~ScopedPhase();
+    private:
+        std::string component_;
+        std::string phase_;
+        RTT::os::TimeService::ticks start_;
+    };
+
+protected:
+    StartupCoordinator();
+
+    struct Job {
+        int id;
+        std::string component;
+        std::string phase;
+        Task task;
+    };
+
+    struct PhaseRecord {
+        std::string component;
+        std::string phase;
+        double start;       // since the creation of the coordinator [s]
+        double duration;    // [s]
+        bool concurrent;
+    };
+
+    void record(const std::string &component, const std::string &phase, RTT::os::TimeService::ticks start,
+                    RTT::os::TimeService::ticks end, bool concurrent);
+    void workerLoop();
+    void openSnapshot();
+
+    // the report of the startup, logged once
+    void onWorldUpdateEnd();
+
+    RTT::os::Mutex mutex_;
+    RTT::os::Condition cond_;
+    std::vector<std::thread > workers_;
+    std::deque<Job > jobs_;
+    std::vector<std::pair<int, bool> > results_;    // id, result
+    std::vector<int > running_;
+    int next_id_;
+    bool stop_;
+
+    struct InitialJointState {
+        gazebo::physics::JointPtr joint;
+        double position;
+        double velocity;
+    };
+
+    std::vector<InitialJointState > initial_state_;
+
+    StateSnapshot snapshot_;
+    bool snapshot_opened_;
+    bool snapshot_applied_;
+
+    RTT::os::TimeService::ticks created_;
+    std::vector<PhaseRecord > phases_;
+    gazebo::event::ConnectionPtr end_connection_;
+};
+
+#endif  // STARTUP_COORDINATOR_H__
@@ -0,0 +1,206 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "state_snapshot.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const uint32_t STATE_SNAPSHOT_MAGIC = 0x504e5356;   // "VSNP"
+const uint32_t STATE_SNAPSHOT_VERSION = 1;
+
+}   // namespace
+
+StateSnapshot::StateSnapshot()
+    : data_(NULL)
+    , size_(0)
+    , header_(NULL)
+    , snapshots_(NULL)
+    , joints_(NULL)
+    , states_(NULL)
+    , values_(NULL)
+    , strings_(NULL)
+    , selected_(NULL)
+{
+}
+
+StateSnapshot::~StateSnapshot() {
+    close();
+}
+
+bool StateSnapshot::open(const std::string &path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < sizeof(Header)) {
+        ::close(fd);
+        return false;
+    }
+    void *ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (ptr == MAP_FAILED) {
+        return false;
+    }
+
+    const Header *header = static_cast<const Header* >(ptr);
+    const size_t size = sizeof(Header) + header->snapshots_count * sizeof(SnapshotRecord)
+        + header->joints_count * sizeof(JointRecord) + header->states_count * sizeof(StateRecord)
+        + header->values_count * sizeof(double) + header->strings_size;
+    if (header->magic != STATE_SNAPSHOT_MAGIC || header->version != STATE_SNAPSHOT_VERSION || size != st.st_size) {
+        munmap(ptr, st.st_size);
+        return false;
+    }
+
+    data_ = ptr;
+    size_ = st.st_size;
+    header_ = header;
+    snapshots_ = reinterpret_cast<const SnapshotRecord* >(header_ + 1);
+    joints_ = reinterpret_cast<const JointRecord* >(snapshots_ + header_->snapshots_count);
+    states_ = reinterpret_cast<const StateRecord* >(joints_ + header_->joints_count);
+    values_ = reinterpret_cast<const double* >(states_ + header_->states_count);
+    strings_ = reinterpret_cast<const char* >(values_ + header_->values_count);
+
+    // the records must not point outside of the file
+    for (uint32_t i = 0; i < header_->snapshots_count; ++i) {
+        const SnapshotRecord &s = snapshots_[i];
+        if (uint64_t(s.name_offset) + s.name_length > header_->strings_size
+                || uint64_t(s.first_joint) + s.joints_count > header_->joints_count
+                || uint64_t(s.first_state) + s.states_count > header_->states_count) {
+            close();
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header_->joints_count; ++i) {
+        const JointRecord &j = joints_[i];
+        if (uint64_t(j.model_offset) + j.model_length > header_->strings_size
+                || uint64_t(j.joint_offset) + j.joint_length > header_->strings_size) {
+            close();
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header_->states_count; ++i) {
+        const StateRecord &s = states_[i];
+        if (uint64_t(s.component_offset) + s.component_length > header_->strings_size
+                || uint64_t(s.key_offset) + s.key_length > header_->strings_size
+                || uint64_t(s.first_value) + s.values_count > header_->values_count) {
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void StateSnapshot::close() {
+    if (data_) {
+        munmap(data_, size_);
+    }
+    data_ = NULL;
+    size_ = 0;
+    header_ = NULL;
+    snapshots_ = NULL;
+    joints_ = NULL;
+    states_ = NULL;
+    values_ = NULL;
+    strings_ = NULL;
+    selected_ = NULL;
+}
+
+std::string StateSnapshot::getString(uint32_t offset, uint32_t length) const {
+    return std::string(strings_ + offset, length);
+}
+
+std::vector<std::string > StateSnapshot::getNames() const {
+    std::vector<std::string > names;
+    if (header_) {
+        for (uint32_t i = 0; i < header_->snapshots_count; ++i) {
+            names.push_back(getString(snapshots_[i].name_offset, snapshots_[i].name_length));
+        }
+    }
+    return names;
+}
+
+bool StateSnapshot::select(const std::string &name) {
+    selected_ = NULL;
+    if (!header_) {
+        return false;
+    }
+    uint32_t lo = 0;
+    uint32_t hi = header_->snapshots_count;
+    while (lo < hi) {
+        const uint32_t mid = (lo + hi) / 2;
+        const int cmp = name.compare(0, std::string::npos, strings_ + snapshots_[mid].name_offset,
+                                        snapshots_[mid].name_length);
+        if (cmp == 0) {
+            selected_ = &snapshots_[mid];
+            return true;
+        }
+        if (cmp < 0) {
+            hi = mid;
+        }
+        else {
+            lo = mid + 1;
+        }
+    }
+    return false;
+}
+
+int StateSnapshot::getJointsCount() const {
+    return selected_ ? selected_->joints_count : 0;
+}
+
+void StateSnapshot::getJoint(int idx, Joint &joint) const {
+    const JointRecord &r = joints_[selected_->first_joint + idx];
+    joint.model = getString(r.model_offset, r.model_length);
+    joint.joint = getString(r.joint_offset, r.joint_length);
+    joint.position = r.position;
+    joint.velocity = r.velocity;
+}
+
+bool StateSnapshot::getComponentState(const std::string &component, const std::string &key,
+                                        std::vector<double > &values) const {
+    if (!selected_) {
+        return false;
+    }
+    for (uint32_t i = 0; i < selected_->states_count; ++i) {
+        const StateRecord &r = states_[selected_->first_state + i];
+        if (component.compare(0, std::string::npos, strings_ + r.component_offset, r.component_length) == 0
+                && key.compare(0, std::string::npos, strings_ + r.key_offset, r.key_length) == 0) {
+            values.assign(values_ + r.first_value, values_ + r.first_value + r.values_count);
+            return true;
+        }
+    }
+    return false;
+}
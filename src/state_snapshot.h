@@ -0,0 +1,132 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef STATE_SNAPSHOT_H__
+#define STATE_SNAPSHOT_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//
+// Binary file with named snapshots of the simulation state, created by the
+// convert_initial_state script. Every snapshot holds the positions and
+// velocities of joints and the internal state of components (vectors of
+// values identified by the component name and a key). The snapshots are
+// sorted by name and the file is memory-mapped, so a snapshot is selected
+// without parsing.
+//
+// Layout (little endian): Header, SnapshotRecord[snapshots_count],
+// JointRecord[joints_count], StateRecord[states_count],
+// double[values_count], char[strings_size].
+//
+class StateSnapshot {
+public:
+    struct Joint {
+        std::string model;
+        std::string joint;
+        double position;
+        double velocity;
+    };
+
+    StateSnapshot();
+
+    ~StateSnapshot();
+
+    // non-RT
+    bool open(const std::string &path);
+
+    void close();
+
+    // the names of all snapshots in the file
+    std::vector<std::string > getNames() const;
+
+    // selects the snapshot used by the functions below
+    bool select(const std::string &name);
+
+    int getJointsCount() const;
+
+    void getJoint(int idx, Joint &joint) const;
+
+    bool getComponentState(const std::string &component, const std::string &key, std::vector<double > &values) const;
+
+protected:
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t snapshots_count;
+        uint32_t joints_count;
+        uint32_t states_count;
+        uint32_t values_count;
+        uint32_t strings_size;
+        uint32_t reserved;
+    };
+
+    struct SnapshotRecord {
+        uint32_t name_offset;
+        uint32_t name_length;
+        uint32_t first_joint;
+        uint32_t joints_count;
+        uint32_t first_state;
+        uint32_t states_count;
+    };
+
+    struct JointRecord {
+        uint32_t model_offset;
+        uint32_t model_length;
+        uint32_t joint_offset;
+        uint32_t joint_length;
+        double position;
+        double velocity;
+    };
+
+    struct StateRecord {
+        uint32_t component_offset;
+        uint32_t component_length;
+        uint32_t key_offset;
+        uint32_t key_length;
+        uint32_t first_value;
+        uint32_t values_count;
+    };
+
+    std::string getString(uint32_t offset, uint32_t length) const;
+
+    void *data_;
+    size_t size_;
+
+    const Header *header_;
+    const SnapshotRecord *snapshots_;
+    const JointRecord *joints_;
+    const StateRecord *states_;
+    const double *values_;
+    const char *strings_;
+
+    const SnapshotRecord *selected_;
+};
+
+#endif  // STATE_SNAPSHOT_H__
@@ -0,0 +1,125 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef STEP_MONITOR_H__
+#define STEP_MONITOR_H__
+
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+
+//
+// The time spent in the update hooks of the simulated components in the
+// current physics step, collected for the SimMonitor component. The hooks
+// are measured with VELMA_SIM_HOOK_TIMER(); the timers are inactive until
+// a monitor is configured.
+//
+class StepMonitor {
+public:
+    static StepMonitor& getInstance() {
+        static StepMonitor monitor;
+        return monitor;
+    }
+
+    static int64_t now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<int64_t >(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+    }
+
+    bool isEnabled() const {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    void setEnabled(bool enabled) {
+        enabled_.store(enabled, std::memory_order_relaxed);
+    }
+
+    // RT
+    void addHookTime(int64_t begin_ns, int64_t end_ns) {
+        int64_t first = first_begin_ns_.load(std::memory_order_relaxed);
+        while ((first == 0 || begin_ns < first)
+                && !first_begin_ns_.compare_exchange_weak(first, begin_ns, std::memory_order_relaxed)) {
+        }
+        hooks_ns_.fetch_add(end_ns - begin_ns, std::memory_order_relaxed);
+    }
+
+    // RT, physics thread; returns the beginning of the first hook (0 if none) and
+    // the total time of the hooks in the step. The times are taken at the first
+    // call in the step of the given iteration, the next calls get the same values.
+    void takeStep(uint64_t iteration, int64_t &first_begin_ns, int64_t &hooks_ns) {
+        if (iteration != step_iteration_) {
+            step_iteration_ = iteration;
+            step_first_begin_ns_ = first_begin_ns_.exchange(0, std::memory_order_relaxed);
+            step_hooks_ns_ = hooks_ns_.exchange(0, std::memory_order_relaxed);
+        }
+        first_begin_ns = step_first_begin_ns_;
+        hooks_ns = step_hooks_ns_;
+    }
+
+    class HookTimer {
+    public:
+        HookTimer()
+            : begin_ns_(StepMonitor::getInstance().isEnabled() ? StepMonitor::now() : 0)
+        {
+        }
+
+        ~HookTimer() {
+            if (begin_ns_ != 0) {
+                StepMonitor::getInstance().addHookTime(begin_ns_, StepMonitor::now());
+            }
+        }
+
+    private:
+        int64_t begin_ns_;
+    };
+
+private:
+    StepMonitor()
+        : enabled_(false)
+        , first_begin_ns_(0)
+        , hooks_ns_(0)
+        , step_iteration_(0)
+        , step_first_begin_ns_(0)
+        , step_hooks_ns_(0)
+    {
+    }
+
+    std::atomic<bool > enabled_;
+    std::atomic<int64_t > first_begin_ns_;
+    std::atomic<int64_t > hooks_ns_;
+
+    // the times of the last step
+    uint64_t step_iteration_;
+    int64_t step_first_begin_ns_;
+    int64_t step_hooks_ns_;
+};
+
+#define VELMA_SIM_HOOK_TIMER() StepMonitor::HookTimer velma_sim_hook_timer_
+
+#endif  // STEP_MONITOR_H__
@@ -0,0 +1,452 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "topology_cache.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <rtt/Logger.hpp>
+#include <rtt/os/Mutex.hpp>
+
+#include <ros/ros.h>
+
+using namespace RTT;
+
+namespace {
+
+const uint32_t TOPOLOGY_CACHE_MAGIC = 0x504f5456;   // "VTOP"
+const uint32_t TOPOLOGY_CACHE_VERSION = 2;
+
+// FNV-1a
+uint64_t hashString(const std::string &str, uint64_t hash = 14695981039346656037ULL) {
+    for (size_t i = 0; i < str.size(); ++i) {
+        hash ^= static_cast<unsigned char >(str[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// The key of the cache file. Serializing the SDF of the whole model takes
+// longer than loading the cache, so the URDF the model was spawned from is
+// hashed instead, if it is set; otherwise the names of the joints and links.
+uint64_t hashModelSource(gazebo::physics::ModelPtr model) {
+    uint64_t hash = hashString(model->GetScopedName());
+    std::string urdf;
+    if (ros::isInitialized() && ros::param::get("/robot_description", urdf)) {
+        return hashString(urdf, hash);
+    }
+    const gazebo::physics::Joint_V &js = model->GetJoints();
+    for (int i = 0; i < js.size(); ++i) {
+        hash = hashString(js[i]->GetName(), hash);
+    }
+    const gazebo::physics::Link_V &ls = model->GetLinks();
+    for (int i = 0; i < ls.size(); ++i) {
+        hash = hashString(ls[i]->GetName(), hash);
+    }
+    return hash;
+}
+
+std::string getCacheDirectory() {
+    const char *dir = getenv("VELMA_SIM_TOPOLOGY_CACHE_DIR");
+    if (dir) {
+        return dir;
+    }
+    dir = getenv("ROS_HOME");
+    if (dir) {
+        return dir;
+    }
+    dir = getenv("HOME");
+    if (dir) {
+        return std::string(dir) + "/.ros";
+    }
+    return "/tmp";
+}
+
+struct NamedIndex {
+    std::string name;
+    int index;
+    int parent;
+    int child;
+
+    bool operator<(const NamedIndex &other) const {
+        return name < other.name;
+    }
+};
+
+int findLinkIndex(const gazebo::physics::Link_V &links, const gazebo::physics::LinkPtr &link) {
+    for (int i = 0; i < links.size(); ++i) {
+        if (links[i] == link) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+}   // namespace
+
+TopologyCache& TopologyCache::getInstance(gazebo::physics::ModelPtr model) {
+    typedef std::pair<boost::weak_ptr<gazebo::physics::Model >, std::shared_ptr<TopologyCache > > Entry;
+    static RTT::os::Mutex mutex;
+    static std::vector<Entry > caches;
+
+    RTT::os::MutexLock lock(mutex);
+    for (int i = caches.size() - 1; i >= 0; --i) {
+        gazebo::physics::ModelPtr m = caches[i].first.lock();
+        if (!m) {
+            caches.erase(caches.begin() + i);
+        }
+        else if (m == model) {
+            return *caches[i].second;
+        }
+    }
+    caches.push_back(Entry(model, std::shared_ptr<TopologyCache >(new TopologyCache(model))));
+    return *caches.back().second;
+}
+
+TopologyCache::TopologyCache(gazebo::physics::ModelPtr model)
+    : model_(model.get())
+    , scope_(model->GetScopedName())
+    , data_(NULL)
+    , size_(0)
+    , header_(NULL)
+    , joints_(NULL)
+    , links_(NULL)
+    , collisions_(NULL)
+    , strings_(NULL)
+{
+    Logger::In in("TopologyCache");
+
+    const uint64_t hash = hashModelSource(model);
+    char name[64];
+    snprintf(name, sizeof(name), "/velma_sim_topology_%016llx.bin", static_cast<unsigned long long >(hash));
+    const std::string path = getCacheDirectory() + name;
+
+    if (load(path, hash)) {
+        Logger::log() << Logger::Info << "loaded " << path << " for " << scope_ << Logger::endl;
+    }
+    else if (build(path, hash)) {
+        Logger::log() << Logger::Info << "saved " << path << " for " << scope_ << Logger::endl;
+    }
+    buildParentJoints();
+}
+
+void TopologyCache::buildParentJoints() {
+    parent_joints_.assign(model_->GetLinks().size(), -1);
+    if (!header_) {
+        return;
+    }
+    for (uint32_t i = 0; i < header_->joints_count; ++i) {
+        const JointRecord &j = joints_[i];
+        if (j.child_link >= 0 && j.child_link < parent_joints_.size()) {
+            parent_joints_[j.child_link] = j.index;
+        }
+    }
+}
+
+TopologyCache::~TopologyCache() {
+    unload();
+}
+
+void TopologyCache::unload() {
+    if (data_) {
+        munmap(data_, size_);
+    }
+    data_ = NULL;
+    size_ = 0;
+    header_ = NULL;
+    joints_ = NULL;
+    links_ = NULL;
+    collisions_ = NULL;
+    strings_ = NULL;
+}
+
+template <typename T >
+bool TopologyCache::isValid(const T *records, uint32_t count) const {
+    for (uint32_t i = 0; i < count; ++i) {
+        const T &r = records[i];
+        if (uint64_t(r.name_offset) + r.name_length > header_->strings_size || r.index < 0) {
+            return false;
+        }
+        if (i > 0 && std::string(strings_ + records[i-1].name_offset, records[i-1].name_length).compare(
+                0, std::string::npos, strings_ + r.name_offset, r.name_length) > 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TopologyCache::load(const std::string &path, uint64_t hash) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < sizeof(Header)) {
+        close(fd);
+        return false;
+    }
+    void *ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        return false;
+    }
+
+    const Header *header = static_cast<const Header* >(ptr);
+    const size_t size = sizeof(Header) + header->joints_count * sizeof(JointRecord)
+        + (header->links_count + header->collisions_count) * sizeof(NameRecord) + header->strings_size;
+    if (header->magic != TOPOLOGY_CACHE_MAGIC || header->version != TOPOLOGY_CACHE_VERSION
+            || header->hash != hash || size != st.st_size) {
+        munmap(ptr, st.st_size);
+        return false;
+    }
+
+    data_ = ptr;
+    size_ = st.st_size;
+    header_ = header;
+    joints_ = reinterpret_cast<const JointRecord* >(header_ + 1);
+    links_ = reinterpret_cast<const NameRecord* >(joints_ + header_->joints_count);
+    collisions_ = links_ + header_->links_count;
+    strings_ = reinterpret_cast<const char* >(collisions_ + header_->collisions_count);
+
+    // the records must not point outside of the file; a damaged file is rebuilt
+    bool valid = isValid(joints_, header_->joints_count) && isValid(links_, header_->links_count)
+        && isValid(collisions_, header_->collisions_count);
+    for (uint32_t i = 0; valid && i < header_->joints_count; ++i) {
+        const JointRecord &j = joints_[i];
+        if (j.parent_link < -1 || j.parent_link >= int64_t(header_->links_count)
+                || j.child_link < -1 || j.child_link >= int64_t(header_->links_count)) {
+            valid = false;
+        }
+    }
+    if (!valid) {
+        Logger::log() << Logger::Warning << path << " is damaged, it is rebuilt" << Logger::endl;
+        unload();
+        return false;
+    }
+    return true;
+}
+
+bool TopologyCache::build(const std::string &path, uint64_t hash) {
+    const gazebo::physics::Joint_V &js = model_->GetJoints();
+    const gazebo::physics::Link_V &ls = model_->GetLinks();
+
+    std::vector<NamedIndex > joints, links, collisions;
+    for (int i = 0; i < js.size(); ++i) {
+        NamedIndex ni;
+        ni.name = js[i]->GetScopedName();
+        ni.index = i;
+        ni.parent = findLinkIndex(ls, js[i]->GetParent());
+        ni.child = findLinkIndex(ls, js[i]->GetChild());
+        joints.push_back(ni);
+    }
+    for (int i = 0; i < ls.size(); ++i) {
+        NamedIndex ni;
+        ni.name = ls[i]->GetScopedName();
+        ni.index = i;
+        links.push_back(ni);
+        const gazebo::physics::Collision_V &cs = ls[i]->GetCollisions();
+        for (int j = 0; j < cs.size(); ++j) {
+            ni.name = cs[j]->GetName();
+            collisions.push_back(ni);
+        }
+    }
+    std::sort(joints.begin(), joints.end());
+    std::sort(links.begin(), links.end());
+    std::sort(collisions.begin(), collisions.end());
+
+    std::string strings;
+    Header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = TOPOLOGY_CACHE_MAGIC;
+    header.version = TOPOLOGY_CACHE_VERSION;
+    header.hash = hash;
+    header.joints_count = joints.size();
+    header.links_count = links.size();
+    header.collisions_count = collisions.size();
+
+    std::vector<JointRecord > joint_records(joints.size());
+    for (int i = 0; i < joints.size(); ++i) {
+        JointRecord &r = joint_records[i];
+        memset(&r, 0, sizeof(r));
+        r.name_offset = strings.size();
+        r.name_length = joints[i].name.size();
+        strings += joints[i].name;
+        r.index = joints[i].index;
+        r.parent_link = joints[i].parent;
+        r.child_link = joints[i].child;
+    }
+    std::vector<NameRecord > name_records(links.size() + collisions.size());
+    for (int i = 0; i < name_records.size(); ++i) {
+        const NamedIndex &ni = (i < links.size()) ? links[i] : collisions[i - links.size()];
+        NameRecord &r = name_records[i];
+        memset(&r, 0, sizeof(r));
+        r.name_offset = strings.size();
+        r.name_length = ni.name.size();
+        strings += ni.name;
+        r.index = ni.index;
+    }
+    header.strings_size = strings.size();
+
+    buffer_.clear();
+    buffer_.append(reinterpret_cast<const char* >(&header), sizeof(header));
+    if (!joint_records.empty()) {
+        buffer_.append(reinterpret_cast<const char* >(&joint_records[0]), joint_records.size() * sizeof(JointRecord));
+    }
+    if (!name_records.empty()) {
+        buffer_.append(reinterpret_cast<const char* >(&name_records[0]), name_records.size() * sizeof(NameRecord));
+    }
+    buffer_ += strings;
+
+    header_ = reinterpret_cast<const Header* >(buffer_.data());
+    joints_ = reinterpret_cast<const JointRecord* >(header_ + 1);
+    links_ = reinterpret_cast<const NameRecord* >(joints_ + header_->joints_count);
+    collisions_ = links_ + header_->links_count;
+    strings_ = reinterpret_cast<const char* >(collisions_ + header_->collisions_count);
+
+    // the file is replaced atomically, as many processes may build it at once
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%d", static_cast<int >(getpid()));
+    const std::string tmp_path = path + suffix;
+    FILE *f = fopen(tmp_path.c_str(), "wb");
+    if (!f) {
+        Logger::log() << Logger::Warning << "could not write " << tmp_path << Logger::endl;
+        return false;
+    }
+    const bool ok = (fwrite(buffer_.data(), 1, buffer_.size(), f) == buffer_.size());
+    if (fclose(f) != 0 || !ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        Logger::log() << Logger::Warning << "could not write " << path << Logger::endl;
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+template <typename T >
+const T* TopologyCache::find(const T *records, uint32_t count, const std::string &name) const {
+    uint32_t lo = 0;
+    uint32_t hi = count;
+    while (lo < hi) {
+        const uint32_t mid = (lo + hi) / 2;
+        const int cmp = name.compare(0, std::string::npos, strings_ + records[mid].name_offset, records[mid].name_length);
+        if (cmp == 0) {
+            return &records[mid];
+        }
+        if (cmp < 0) {
+            hi = mid;
+        }
+        else {
+            lo = mid + 1;
+        }
+    }
+    return NULL;
+}
+
+const TopologyCache::JointRecord* TopologyCache::findJoint(const std::string &name) const {
+    if (!header_) {
+        return NULL;
+    }
+    const JointRecord *r = find(joints_, header_->joints_count, name);
+    if (!r) {
+        r = find(joints_, header_->joints_count, scope_ + "::" + name);
+    }
+    return r;
+}
+
+gazebo::physics::JointPtr TopologyCache::getJoint(const std::string &name) const {
+    const JointRecord *r = findJoint(name);
+    const gazebo::physics::Joint_V &js = model_->GetJoints();
+    if (r && r->index < js.size()
+            && js[r->index]->GetScopedName().compare(0, std::string::npos, strings_ + r->name_offset, r->name_length) == 0) {
+        return js[r->index];
+    }
+    return model_->GetJoint(name);
+}
+
+gazebo::physics::LinkPtr TopologyCache::getLink(const std::string &name) const {
+    const NameRecord *r = NULL;
+    if (header_) {
+        r = find(links_, header_->links_count, name);
+        if (!r) {
+            r = find(links_, header_->links_count, scope_ + "::" + name);
+        }
+    }
+    const gazebo::physics::Link_V &ls = model_->GetLinks();
+    if (r && r->index < ls.size()
+            && ls[r->index]->GetScopedName().compare(0, std::string::npos, strings_ + r->name_offset, r->name_length) == 0) {
+        return ls[r->index];
+    }
+    return model_->GetLink(name);
+}
+
+gazebo::physics::LinkPtr TopologyCache::getLinkByCollision(const std::string &collision_name) const {
+    const gazebo::physics::Link_V &ls = model_->GetLinks();
+    const NameRecord *r = header_ ? find(collisions_, header_->collisions_count, collision_name) : NULL;
+    if (r && r->index < ls.size()) {
+        const gazebo::physics::Collision_V &cs = ls[r->index]->GetCollisions();
+        for (int i = 0; i < cs.size(); ++i) {
+            if (cs[i]->GetName() == collision_name) {
+                return ls[r->index];
+            }
+        }
+    }
+
+    // not in the cache, search the model
+    for (int i = 0; i < ls.size(); ++i) {
+        const gazebo::physics::Collision_V &cs = ls[i]->GetCollisions();
+        for (int j = 0; j < cs.size(); ++j) {
+            if (cs[j]->GetName() == collision_name) {
+                return ls[i];
+            }
+        }
+    }
+    return gazebo::physics::LinkPtr();
+}
+
+gazebo::physics::JointPtr TopologyCache::getParentJoint(const gazebo::physics::LinkPtr &link) const {
+    const NameRecord *l = header_ ? find(links_, header_->links_count, link->GetScopedName()) : NULL;
+    if (l && l->index < parent_joints_.size()) {
+        const gazebo::physics::Joint_V &js = model_->GetJoints();
+        const int32_t j = parent_joints_[l->index];
+        if (j >= 0 && j < js.size() && js[j]->GetChild() == link) {
+            return js[j];
+        }
+    }
+    gazebo::physics::Joint_V parents = link->GetParentJoints();
+    if (parents.empty()) {
+        return gazebo::physics::JointPtr();
+    }
+    return parents.front();
+}
@@ -0,0 +1,129 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TOPOLOGY_CACHE_H__
+#define TOPOLOGY_CACHE_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <gazebo/gazebo.hh>
+#include <gazebo/physics/physics.hh>
+
+//
+// Names of joints, links and collisions of a model, resolved to the indices
+// in Model::GetJoints() and Model::GetLinks(), with the parent and child
+// links of every joint. The tables are sorted by name and stored in a binary
+// file named after the hash of the URDF the model was spawned from (or of
+// the names of its joints and links); the file is written at the first run
+// and memory-mapped later. A file with records outside of its
+// bounds is rebuilt. The objects returned by the cache are checked against
+// the requested names, so a stale file only falls back to the search in the
+// model.
+//
+class TopologyCache {
+public:
+    // non-RT, the cache is shared by all components of the model
+    static TopologyCache& getInstance(gazebo::physics::ModelPtr model);
+
+    ~TopologyCache();
+
+    // the names are scoped or relative to the model
+    gazebo::physics::JointPtr getJoint(const std::string &name) const;
+    gazebo::physics::LinkPtr getLink(const std::string &name) const;
+
+    // the link with the collision of the given (unscoped) name
+    gazebo::physics::LinkPtr getLinkByCollision(const std::string &collision_name) const;
+
+    // the joint that has the link as its child
+    gazebo::physics::JointPtr getParentJoint(const gazebo::physics::LinkPtr &link) const;
+
+protected:
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t hash;
+        uint32_t joints_count;
+        uint32_t links_count;
+        uint32_t collisions_count;
+        uint32_t strings_size;
+    };
+
+    struct JointRecord {
+        uint32_t name_offset;
+        uint32_t name_length;
+        int32_t index;
+        int32_t parent_link;
+        int32_t child_link;
+        int32_t reserved;
+    };
+
+    struct NameRecord {
+        uint32_t name_offset;
+        uint32_t name_length;
+        int32_t index;      // the link index, also for collisions
+        int32_t reserved;
+    };
+
+    TopologyCache(gazebo::physics::ModelPtr model);
+
+    bool load(const std::string &path, uint64_t hash);
+    bool build(const std::string &path, uint64_t hash);
+    void unload();
+
+    // fills parent_joints_ from the joint table
+    void buildParentJoints();
+
+    // the names must be within the strings and the table sorted by name
+    template <typename T >
+    bool isValid(const T *records, uint32_t count) const;
+
+    template <typename T >
+    const T* find(const T *records, uint32_t count, const std::string &name) const;
+
+    const JointRecord* findJoint(const std::string &name) const;
+
+    // the cache is dropped when the model is removed, so it does not own the model
+    gazebo::physics::Model *model_;
+    std::string scope_;
+
+    void *data_;
+    size_t size_;
+    std::string buffer_;        // used if the file could not be mapped
+
+    const Header *header_;
+    const JointRecord *joints_;
+    const NameRecord *links_;
+    const NameRecord *collisions_;
+    const char *strings_;
+
+    // the index of the joint with the link as its child, for each link index; -1 if none
+    std::vector<int32_t > parent_joints_;
+};
+
+#endif  // TOPOLOGY_CACHE_H__
@@ -26,28 +26,31 @@
 */
 
 #include "torso_gazebo.h"
+#include "sim_physics_gazebo.h"
+#include "benchmark_motion.h"
+#include "robot_state_export.h"
 #include <rtt/Logger.hpp>
+#include "allocation_audit.h"
+#include "step_monitor.h"
 #include "velma_sim_conversion.h"
 
-#include <gazebo/sensors/sensors.hh>
-
 using namespace RTT;
 
 void TorsoGazebo::getJointPositionAndVelocity(double &q, double &dq) {
-    q = torso_joint_->Position();
-    dq = torso_joint_->GetVelocity(0);
+    q = torso_joint_->getPosition();
+    dq = torso_joint_->getVelocity();
 }
 
 void TorsoGazebo::getHeadJointPositionAndVelocity(TorsoGazebo::HeadJoints &q, TorsoGazebo::HeadJoints &dq) {
-    q(0) = head_pan_joint_->Position();
-    dq(0) = head_pan_joint_->GetVelocity(0);
+    q(0) = head_pan_joint_->getPosition();
+    dq(0) = head_pan_joint_->getVelocity();
 
-    q(1) = head_tilt_joint_->Position();
-    dq(1) = head_tilt_joint_->GetVelocity(0);
+    q(1) = head_tilt_joint_->getPosition();
+    dq(1) = head_tilt_joint_->getVelocity();
 }
 
 void TorsoGazebo::setForces(double t) {
-    torso_joint_->SetForce(0, t);
+    torso_joint_->setForce(t);
 }
 
 bool TorsoGazebo::gazeboConfigureHook(gazebo::physics::ModelPtr model) {
@@ -58,59 +61,67 @@ bool TorsoGazebo::gazeboConfigureHook(gazebo::physics::ModelPtr model) {
         return false;
     }
 
-    model_ = model;
+    return simConfigureHook(SimModelPtr(new GazeboSimModel(model)));
+}
+
+bool TorsoGazebo::simConfigureHook(SimModelPtr model) {
+    Logger::In in("TorsoGazebo::simConfigureHook");
 
-    jc_ = new gazebo::physics::JointController(model);
+    model_ = model;
 
-    torso_joint_ = model->GetJoint("torso_0_joint");
+    torso_joint_ = model_->getJoint("torso_0_joint");
 
     // head joints
-    head_pan_joint_ = model->GetJoint("head_pan_joint");
-    head_tilt_joint_ = model->GetJoint("head_tilt_joint");
+    head_pan_joint_ = model_->getJoint("head_pan_joint");
+    head_tilt_joint_ = model_->getJoint("head_tilt_joint");
 
-    head_pan_scoped_name_ = head_pan_joint_->GetScopedName();
-    head_tilt_scoped_name_ = head_tilt_joint_->GetScopedName();
+    if (!torso_joint_ || !head_pan_joint_ || !head_tilt_joint_) {
+        Logger::log() << Logger::Error << "could not find torso_0_joint, head_pan_joint or head_tilt_joint" << Logger::endl;
+        model_.reset();
+        return false;
+    }
 
-    return true;
-}
+    hp_pid_.Init(2.0, 1.0, 0.0, 0.5, -0.5, 10.0, -10.0);
+    ht_pid_.Init(2.0, 1.0, 0.0, 0.5, -0.5, 10.0, -10.0);
 
-void TorsoGazebo::setJointsPID() {
-    jc_->Reset();
+    benchmark_channel_ = BenchmarkMotion::getInstance().addJoint("torso_0_joint");
 
-    jc_->AddJoint(head_pan_joint_);
-    jc_->SetPositionPID(head_pan_scoped_name_, gazebo::common::PID(2.0, 1.0, 0.0, 0.5, -0.5, 10.0,-10.0));
-    jc_->SetPositionTarget(head_pan_scoped_name_, head_pan_joint_->Position());
+    return true;
+}
 
-    jc_->AddJoint(head_tilt_joint_);
-    jc_->SetPositionPID(head_tilt_scoped_name_, gazebo::common::PID(2.0, 1.0, 0.0, 0.5, -0.5, 10.0,-10.0));
-    jc_->SetPositionTarget(head_tilt_scoped_name_, head_tilt_joint_->Position());
+void TorsoGazebo::resetHeadProfiles() {
+    // the reference starts at the current position and holds it until homing
+    hp_profile_.reset(head_pan_joint_->getPosition(), 0.0);
+    ht_profile_.reset(head_tilt_joint_->getPosition(), 0.0);
+    hp_pid_.Reset();
+    ht_pid_.Reset();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 // Update the controller
 void TorsoGazebo::gazeboUpdateHook(gazebo::physics::ModelPtr model)
 {
-    Logger::In in("TorsoGazebo::gazeboUpdateHook");
+    simUpdateHook();
+}
 
-    if (first_step_) {
-        setJointsPID();
-        first_step_ = false;
-    }
+void TorsoGazebo::simUpdateHook()
+{
+    VELMA_SIM_RT_SCOPE("TorsoGazebo::simUpdateHook");
+    VELMA_SIM_HOOK_TIMER();
+    Logger::In in(update_log_module_);
 
-    bool kinect_active_prev = kinect_active_;
-    gazebo::sensors::SensorPtr kinect = gazebo::sensors::SensorManager::Instance()->GetSensor("openni_camera_camera");
-    kinect_active_ = false;
-    if (kinect && kinect->IsActive()) {
-        kinect_active_ = true;
+    if (!model_) {
+        return;
     }
 
-    if (kinect_active_prev != kinect_active_) {
-        if (kinect_active_) {
-            Logger::log() << Logger::Info << "kinect is enabled" << Logger::endl;
-        }
-        else {
-            Logger::log() << Logger::Info << "kinect is disabled" << Logger::endl;
-        }
+    const double sim_time = model_->getSimTime();
+    double dt = sim_time - last_sim_time_;
+    last_sim_time_ = sim_time;
+
+    if (first_step_) {
+        resetHeadProfiles();
+        dt = 0.0;
+        first_step_ = false;
     }
 
     //
@@ -161,43 +172,60 @@ void TorsoGazebo::gazeboUpdateHook(gazebo::physics::ModelPtr model)
     }
 
     double grav;
-    grav = tmp_t_MotorCurrentCommand_in_ * torso_gear * torso_motor_constant;
+    if (benchmark_channel_ >= 0) {
+        // the scripted motion of the benchmark replaces the motor current command
+        const BenchmarkMotion &motion = BenchmarkMotion::getInstance();
+        grav = motion.getStiffness(benchmark_channel_) * (motion.getSetpoint(benchmark_channel_, sim_time) - q_t)
+            - motion.getDamping(benchmark_channel_) * dq_t;
+    }
+    else {
+        grav = tmp_t_MotorCurrentCommand_in_ * torso_gear * torso_motor_constant;
+    }
 
     setForces(grav);
 
-    // joint controller for the head
-    if (hp_homing_in_progress_) {
-        if (q_h(0) > 0.015) {
-            jc_->SetPositionTarget(head_pan_scoped_name_, q_h(0)-0.008);
+    // the state of the whole robot, written to the shared memory at the end of the step
+    if (export_state_) {
+        velma_sim_gazebo::RobotStateShmData *state = RobotStateExport::getInstance().getState();
+        state->torso.q = q_t;
+        state->torso.dq = dq_t;
+        state->torso.t = grav;
+        for (int i = 0; i < 2; ++i) {
+            state->torso.head_q[i] = q_h(i);
+            state->torso.head_dq[i] = dq_h(i);
         }
-        else if (q_h(0) < -0.015) {
-            jc_->SetPositionTarget(head_pan_scoped_name_, q_h(0)+0.008);
-        }
-        else {
+        state->updated |= velma_sim_gazebo::ROBOT_STATE_SHM_TORSO;
+    }
+
+    // motion profiles and position loops for the head
+    if (hp_homing_in_progress_) {
+        hp_profile_.setTarget(0.0);
+        if (hp_profile_.isFinished() && std::fabs(q_h(0)) < 0.015) {
             hp_homing_in_progress_ = false;
             hp_homing_done_ = true;
         }
     }
     else if (hp_homing_done_) {
-        jc_->SetPositionTarget(head_pan_scoped_name_, -tmp_hp_q_in_ / head_trans);
+        hp_profile_.setTarget(-tmp_hp_q_in_ / head_trans);
     }
 
     if (ht_homing_in_progress_) {
-        if (q_h(1) > 0.015) {
-            jc_->SetPositionTarget(head_tilt_scoped_name_, q_h(1)-0.008);
-        }
-        else if (q_h(1) < -0.015) {
-            jc_->SetPositionTarget(head_tilt_scoped_name_, q_h(1)+0.008);
-        }
-        else {
+        ht_profile_.setTarget(0.0);
+        if (ht_profile_.isFinished() && std::fabs(q_h(1)) < 0.015) {
             ht_homing_in_progress_ = false;
             ht_homing_done_ = true;
         }
     }
     else if (ht_homing_done_) {
-        jc_->SetPositionTarget(head_tilt_scoped_name_, tmp_ht_q_in_ / head_trans);
+        ht_profile_.setTarget(tmp_ht_q_in_ / head_trans);
     }
 
-    jc_->Update();
+    // the step may be 0 after world reset or pause
+    if (dt > 0.0) {
+        hp_profile_.update(dt);
+        ht_profile_.update(dt);
+        head_pan_joint_->setForce(hp_pid_.Update(q_h(0) - hp_profile_.getPosition(), dt));
+        head_tilt_joint_->setForce(ht_pid_.Update(q_h(1) - ht_profile_.getPosition(), dt));
+    }
 }
 
@@ -41,6 +41,11 @@
 
 #include <controller_common/elmo_servo_state.h>
 
+#include <velma_sim_gazebo/TorsoStatus.h>
+
+#include "motion_profile.h"
+#include "sim_physics.h"
+
 class TorsoGazebo : public RTT::TaskContext
 {
 public:
@@ -86,6 +91,14 @@ public:
     int32_t ht_q_out_;
     int32_t ht_v_out_;
 
+    // all outputs in one sample
+    RTT::OutputPort<velma_sim_gazebo::TorsoStatus > port_State_out_;
+    velma_sim_gazebo::TorsoStatus State_out_;
+
+    // activity of head sensors: bit i is set if the sensor head_sensor_names[i] is active
+    RTT::OutputPort<uint32_t > port_head_sensors_active_out_;
+    uint32_t head_sensors_active_out_;
+
     bool hp_homing_done_;
     bool hp_homing_in_progress_;
 
@@ -102,9 +115,14 @@ public:
     void updateHook();
     bool startHook();
     bool configureHook();
+    void cleanupHook();
     bool gazeboConfigureHook(gazebo::physics::ModelPtr model);
     void gazeboUpdateHook(gazebo::physics::ModelPtr model);
 
+    // the hooks without Gazebo, called by the hooks above
+    bool simConfigureHook(SimModelPtr model);
+    void simUpdateHook();
+
   protected:
 
     controller_common::elmo_servo::ServoState getNextServoState(controller_common::elmo_servo::ServoState current_state, uint16_t controlWord) const;
@@ -127,19 +145,25 @@ public:
     int32_t tmp_ht_q_out_;
     int32_t tmp_ht_v_out_;
 
-    void setJointsPID();
+    void resetHeadProfiles();
 
-    gazebo::physics::ModelPtr model_;
+    SimModelPtr model_;
 
     // head
-    gazebo::physics::JointPtr torso_joint_;
-    gazebo::physics::JointPtr head_pan_joint_;
-    gazebo::physics::JointPtr head_tilt_joint_;
+    SimJointPtr torso_joint_;
+    SimJointPtr head_pan_joint_;
+    SimJointPtr head_tilt_joint_;
+
+    // position references for the head joints, as in the profile position mode of the drives
+    TrapezoidalProfile hp_profile_;
+    TrapezoidalProfile ht_profile_;
+    double head_max_vel_;
+    double head_max_acc_;
 
-    std::string head_pan_scoped_name_;
-    std::string head_tilt_scoped_name_;
+    gazebo::common::PID hp_pid_;
+    gazebo::common::PID ht_pid_;
 
-    gazebo::physics::JointController *jc_;
+    double last_sim_time_;
 
     void getJointPositionAndVelocity(double &q, double &dq);
     void getHeadJointPositionAndVelocity(HeadJoints &q, HeadJoints &dq);
@@ -152,8 +176,30 @@ public:
 
     ros::Time last_update_time_;
 
-    bool kinect_active_;
+    // non-RT, called in the Orocos thread; the sensors are searched by name
+    // in the model, and changes of their activity are logged
+    void resolveHeadSensors();
+    void updateHeadSensors();
+
+    // head sensors (kinect, stereo pair)
+    std::vector<std::string > head_sensor_names_;
+    std::vector<SimSensorPtr > head_sensors_;
+    int head_sensors_unresolved_;
+    int head_sensors_resolve_counter_;
+    int head_sensors_resolve_tries_;
+
     bool first_step_;
+
+    // the channel of the torso joint in the benchmark motion, -1 if not scripted
+    int benchmark_channel_;
+
+    // the state of the torso is written to the exported state of the robot
+    bool export_state_;
+
+    bool legacy_ports_;
+
+    // the module name of the log in simUpdateHook, built once
+    const std::string update_log_module_;
 };
 
 #endif  // TORSO_GAZEBO_H__
@@ -32,13 +32,15 @@ using namespace controller_common::elmo_servo;
 
 TorsoGazebo::TorsoGazebo(std::string const& name)
     : TaskContext(name, RTT::TaskContext::PreOperational)
-    , data_valid_(false)
     , port_t_MotorPosition_out_("t_MotorPosition_OUTPORT", false)
     , port_t_MotorVelocity_out_("t_MotorVelocity_OUTPORT", false)
     , port_hp_q_out_("head_pan_motor_position_OUTPORT", false)
     , port_hp_v_out_("head_pan_motor_velocity_OUTPORT", false)
     , port_ht_q_out_("head_tilt_motor_position_OUTPORT", false)
     , port_ht_v_out_("head_tilt_motor_velocity_OUTPORT", false)
+    , port_State_out_("State_OUTPORT", false)
+    , port_head_sensors_active_out_("head_sensors_active_OUTPORT", false)
+    , head_sensors_active_out_(0)
     , hp_homing_done_(false)
     , hp_homing_in_progress_(false)
     , ht_homing_done_(false)
@@ -46,13 +48,31 @@ TorsoGazebo::TorsoGazebo(std::string const& name)
     , t_servo_state_(ServoState::NOT_READY_TO_SWITCH_ON)
     , hp_servo_state_(ServoState::NOT_READY_TO_SWITCH_ON)
     , ht_servo_state_(ServoState::NOT_READY_TO_SWITCH_ON)
-    , kinect_active_(false)
+    , head_max_vel_(2.0)
+    , head_max_acc_(20.0)
+    , last_sim_time_(0.0)
+    , data_valid_(false)
+    , head_sensors_unresolved_(0)
+    , head_sensors_resolve_counter_(0)
+    , head_sensors_resolve_tries_(0)
     , first_step_(true)
+    , benchmark_channel_(-1)
+    , export_state_(false)
+    , legacy_ports_(true)
+    , update_log_module_("TorsoGazebo::simUpdateHook")
 {
     // Add required gazebo interfaces
     this->provides("gazebo")->addOperation("configure",&TorsoGazebo::gazeboConfigureHook,this,RTT::ClientThread);
     this->provides("gazebo")->addOperation("update",&TorsoGazebo::gazeboUpdateHook,this,RTT::ClientThread);
 
+    addProperty("legacy_ports", legacy_ports_);
+    addProperty("head_sensor_names", head_sensor_names_);
+    head_sensor_names_.push_back("openni_camera_camera");
+    head_sensor_names_.push_back("stereo_left_camera");
+    head_sensor_names_.push_back("stereo_right_camera");
+    addProperty("head_max_vel", head_max_vel_);
+    addProperty("head_max_acc", head_max_acc_);
+
     // torso ports
     this->ports()->addPort("t_MotorCurrentCommand_INPORT",      port_t_MotorCurrentCommand_in_);
     this->ports()->addPort("t_MotorControlWord_INPORT",         port_t_MotorControlWord_in_);
@@ -78,6 +98,9 @@ TorsoGazebo::TorsoGazebo(std::string const& name)
     this->ports()->addPort(port_ht_v_out_);
     this->ports()->addPort("head_tilt_motor_status_OUTPORT", port_ht_status_out_);
     ht_q_in_ = ht_v_in_ = ht_c_in_ = ht_q_out_ = ht_v_out_ = 0.0;
+
+    this->ports()->addPort(port_State_out_);
+    this->ports()->addPort(port_head_sensors_active_out_);
 }
 
 TorsoGazebo::~TorsoGazebo() {
@@ -27,6 +27,9 @@
 
 #include "torso_gazebo.h"
 #include <rtt/Logger.hpp>
+#include "allocation_audit.h"
+#include "startup_coordinator.h"
+#include "robot_state_export.h"
 
 using namespace RTT;
 
@@ -52,117 +55,217 @@ ServoState TorsoGazebo::getNextServoState(ServoState current_state, uint16_t con
     return current_state;
 }
 
-void TorsoGazebo::updateHook() {
+void TorsoGazebo::resolveHeadSensors() {
+    head_sensors_unresolved_ = 0;
+    for (int i = 0; i < head_sensor_names_.size(); ++i) {
+        if (!head_sensors_[i] && model_) {
+            head_sensors_[i] = model_->getSensor(head_sensor_names_[i]);
+            if (head_sensors_[i]) {
+                Logger::log() << Logger::Info << "found head sensor \"" << head_sensor_names_[i] << "\"" << Logger::endl;
+            }
+        }
+        if (!head_sensors_[i]) {
+            ++head_sensors_unresolved_;
+        }
+    }
+}
 
-    // Synchronize with gazeboUpdate()
-    RTT::os::MutexLock lock(gazebo_mutex_);
+void TorsoGazebo::updateHeadSensors() {
+    // the sensors may be created after the model, so the missing ones are
+    // searched for once in a while, a limited number of times
+    const int resolve_period = 1000;
+    const int resolve_tries = 10;
+    if (head_sensors_unresolved_ > 0 && head_sensors_resolve_tries_ < resolve_tries) {
+        if (++head_sensors_resolve_counter_ >= resolve_period) {
+            head_sensors_resolve_counter_ = 0;
+            ++head_sensors_resolve_tries_;
+            Logger::In in("TorsoGazebo::updateHeadSensors");
+            resolveHeadSensors();
+            if (head_sensors_unresolved_ > 0 && head_sensors_resolve_tries_ == resolve_tries) {
+                for (int i = 0; i < head_sensors_.size(); ++i) {
+                    if (!head_sensors_[i]) {
+                        Logger::log() << Logger::Warning << "head sensor \"" << head_sensor_names_[i] << "\" does not exist" << Logger::endl;
+                    }
+                }
+            }
+        }
+    }
 
-    if (!data_valid_) {
-        //Logger::In in("TorsoGazebo::updateHook");
-        //Logger::log() << Logger::Debug << "gazebo is not initialized" << Logger::endl;
-        return;
+    uint32_t active = 0;
+    for (int i = 0; i < head_sensors_.size(); ++i) {
+        if (head_sensors_[i] && head_sensors_[i]->isActive()) {
+            active |= (1u << i);
+        }
     }
-    else {
-        //Logger::log() << Logger::Debug << Logger::endl;
+
+    const uint32_t changed = active ^ head_sensors_active_out_;
+    if (changed != 0) {
+        Logger::In in("TorsoGazebo::updateHeadSensors");
+        for (int i = 0; i < head_sensors_.size(); ++i) {
+            if ((changed & (1u << i)) != 0) {
+                Logger::log() << Logger::Info << head_sensor_names_[i] << (((active & (1u << i)) != 0)?" is enabled":" is disabled") << Logger::endl;
+            }
+        }
     }
+    head_sensors_active_out_ = active;
+}
 
-    port_t_MotorPosition_out_.write(t_MotorPosition_out_);
-    port_t_MotorVelocity_out_.write(t_MotorVelocity_out_);
+void TorsoGazebo::updateHook() {
+    // the head sensors are not a part of the real-time scope; they are
+    // looked up a limited number of times and logged only on changes
+    updateHeadSensors();
+    port_head_sensors_active_out_.write(head_sensors_active_out_);
 
-    uint16_t hp_controlWord_in;
-    if (port_hp_controlWord_in_.read(hp_controlWord_in) == RTT::NewData) {
-        if ( (hp_controlWord_in&0x10) != 0 && !hp_homing_in_progress_) {
-            if (hp_homing_done_) {
-                Logger::In in("TorsoGazebo::updateHook");
-                Logger::log() << Logger::Warning << "Running homing second time for head pan motor!" << Logger::endl;
+    // the changes of the drives are logged after the real-time scope
+    bool hp_homing_repeated = false, hp_homing_started = false, hp_state_changed = false;
+    bool ht_homing_repeated = false, ht_homing_started = false, ht_state_changed = false;
+    bool t_state_changed = false;
+
+    {
+        VELMA_SIM_RT_SCOPE("TorsoGazebo::updateHook");
+
+        {
+            // Synchronize with gazeboUpdate()
+            RTT::os::MutexLock lock(gazebo_mutex_);
+
+            if (!data_valid_) {
+                //Logger::In in("TorsoGazebo::updateHook");
+                //Logger::log() << Logger::Debug << "gazebo is not initialized" << Logger::endl;
+                return;
             }
             else {
-                hp_homing_in_progress_ = true;
-                Logger::log() << Logger::Info << "Running homing head pan motor" << Logger::endl;
+                //Logger::log() << Logger::Debug << Logger::endl;
             }
-        }
-        ServoState prev_state = hp_servo_state_;
-        hp_servo_state_ = getNextServoState(hp_servo_state_, hp_controlWord_in);
-        if (prev_state != hp_servo_state_) {
-            Logger::In in("TorsoGazebo::updateHook");
-            Logger::log() << Logger::Info << "hp motor state: " << getServoStateStr(hp_servo_state_) << Logger::endl;
-        }
-    }
-    else {
-        hp_servo_state_ = ServoState::NOT_READY_TO_SWITCH_ON;
-    }
 
-    uint16_t ht_controlWord_in;
-    if (port_ht_controlWord_in_.read(ht_controlWord_in) == RTT::NewData) {
-        if ( (ht_controlWord_in&0x10) != 0 && !ht_homing_in_progress_) {
-            if (ht_homing_done_) {
-                Logger::In in("TorsoGazebo::updateHook");
-                Logger::log() << Logger::Warning << "Running homing second time for head tilt motor!" << Logger::endl;
+            State_out_.t_MotorPosition = t_MotorPosition_out_;
+            State_out_.t_MotorVelocity = t_MotorVelocity_out_;
+
+            uint16_t hp_controlWord_in;
+            if (port_hp_controlWord_in_.read(hp_controlWord_in) == RTT::NewData) {
+                if ( (hp_controlWord_in&0x10) != 0 && !hp_homing_in_progress_) {
+                    if (hp_homing_done_) {
+                        hp_homing_repeated = true;
+                    }
+                    else {
+                        hp_homing_in_progress_ = true;
+                        hp_homing_started = true;
+                    }
+                }
+                ServoState prev_state = hp_servo_state_;
+                hp_servo_state_ = getNextServoState(hp_servo_state_, hp_controlWord_in);
+                hp_state_changed = (prev_state != hp_servo_state_);
+            }
+            else {
+                hp_servo_state_ = ServoState::NOT_READY_TO_SWITCH_ON;
+            }
+
+            uint16_t ht_controlWord_in;
+            if (port_ht_controlWord_in_.read(ht_controlWord_in) == RTT::NewData) {
+                if ( (ht_controlWord_in&0x10) != 0 && !ht_homing_in_progress_) {
+                    if (ht_homing_done_) {
+                        ht_homing_repeated = true;
+                    }
+                    else {
+                        ht_homing_in_progress_ = true;
+                        ht_homing_started = true;
+                    }
+                }
+                ServoState prev_state = ht_servo_state_;
+                ht_servo_state_ = getNextServoState(ht_servo_state_, ht_controlWord_in);
+                ht_state_changed = (prev_state != ht_servo_state_);
             }
             else {
-                ht_homing_in_progress_ = true;
-                Logger::log() << Logger::Info << "Running homing head tilt motor" << Logger::endl;
+                ht_servo_state_ = ServoState::NOT_READY_TO_SWITCH_ON;
+            }
+
+            uint16_t t_controlWord_in;
+            if (port_t_MotorControlWord_in_.read(t_controlWord_in) == RTT::NewData) {
+                ServoState prev_state = t_servo_state_;
+                t_servo_state_ = getNextServoState(t_servo_state_, t_controlWord_in);
+                t_state_changed = (prev_state != t_servo_state_);
+            }
+            else {
+                t_servo_state_ = ServoState::NOT_READY_TO_SWITCH_ON;
+            }
+
+            State_out_.t_MotorStatus = getStatusWord(t_servo_state_);
+            State_out_.hp_status = getStatusWord(hp_servo_state_);
+            State_out_.ht_status = getStatusWord(ht_servo_state_);
+
+            if (hp_homing_done_) {
+                State_out_.hp_status |= 0x1400;
+            }
+            if (ht_homing_done_) {
+                State_out_.ht_status |= 0x1400;
             }
+
+            port_t_MotorCurrentCommand_in_.read(t_MotorCurrentCommand_in_);
+
+            ros::Time now = rtt_rosclock::host_now();
+            double cmd_div = std::max(1.0, (now - last_update_time_).toSec()/0.001);
+            last_update_time_ = now;
+            t_MotorCurrentCommand_in_ = t_MotorCurrentCommand_in_ / cmd_div;
+
+            //
+            // head
+            //
+            port_hp_q_in_.read(hp_q_in_);
+            port_hp_v_in_.read(hp_v_in_);
+            port_hp_c_in_.read(hp_c_in_);
+            port_ht_q_in_.read(ht_q_in_);
+            port_ht_v_in_.read(ht_v_in_);
+            port_ht_c_in_.read(ht_c_in_);
+
+            State_out_.hp_q = hp_q_out_;
+            State_out_.hp_v = hp_v_out_;
+            State_out_.ht_q = ht_q_out_;
+            State_out_.ht_v = ht_v_out_;
         }
-        ServoState prev_state = ht_servo_state_;
-        ht_servo_state_ = getNextServoState(ht_servo_state_, ht_controlWord_in);
-        if (prev_state != ht_servo_state_) {
-            Logger::In in("TorsoGazebo::updateHook");
-            Logger::log() << Logger::Info << "ht motor state: " << getServoStateStr(ht_servo_state_) << Logger::endl;
+
+        // the ports are written outside of the critical section, so
+        // the Gazebo thread is not blocked by the data flow
+        if (port_State_out_.connected()) {
+            port_State_out_.write(State_out_);
         }
-    }
-    else {
-        ht_servo_state_ = ServoState::NOT_READY_TO_SWITCH_ON;
-    }
 
-    uint16_t t_controlWord_in;
-    if (port_t_MotorControlWord_in_.read(t_controlWord_in) == RTT::NewData) {
-        ServoState prev_state = t_servo_state_;
-        t_servo_state_ = getNextServoState(t_servo_state_, t_controlWord_in);
-        if (prev_state != t_servo_state_) {
-            Logger::In in("TorsoGazebo::updateHook");
-            Logger::log() << Logger::Info << "t motor state: " << getServoStateStr(t_servo_state_) << Logger::endl;
+        if (legacy_ports_) {
+            port_t_MotorPosition_out_.write(State_out_.t_MotorPosition);
+            port_t_MotorVelocity_out_.write(State_out_.t_MotorVelocity);
+            port_t_MotorStatus_out_.write(State_out_.t_MotorStatus);
+            port_hp_status_out_.write(State_out_.hp_status);
+            port_ht_status_out_.write(State_out_.ht_status);
+            port_hp_q_out_.write(State_out_.hp_q);
+            port_hp_v_out_.write(State_out_.hp_v);
+            port_ht_q_out_.write(State_out_.ht_q);
+            port_ht_v_out_.write(State_out_.ht_v);
         }
     }
-    else {
-        t_servo_state_ = ServoState::NOT_READY_TO_SWITCH_ON;
-    }
 
-    uint16_t t_status_out = getStatusWord(t_servo_state_);
-    uint16_t hp_status_out = getStatusWord(hp_servo_state_);
-    uint16_t ht_status_out = getStatusWord(ht_servo_state_);
-
-    if (hp_homing_done_) {
-        hp_status_out |= 0x1400;
-    }
-    if (ht_homing_done_) {
-        ht_status_out |= 0x1400;
+    if (hp_homing_repeated || hp_homing_started || hp_state_changed ||
+            ht_homing_repeated || ht_homing_started || ht_state_changed || t_state_changed) {
+        Logger::In in("TorsoGazebo::updateHook");
+        if (hp_homing_repeated) {
+            Logger::log() << Logger::Warning << "Running homing second time for head pan motor!" << Logger::endl;
+        }
+        if (hp_homing_started) {
+            Logger::log() << Logger::Info << "Running homing head pan motor" << Logger::endl;
+        }
+        if (hp_state_changed) {
+            Logger::log() << Logger::Info << "hp motor state: " << getServoStateStr(hp_servo_state_) << Logger::endl;
+        }
+        if (ht_homing_repeated) {
+            Logger::log() << Logger::Warning << "Running homing second time for head tilt motor!" << Logger::endl;
+        }
+        if (ht_homing_started) {
+            Logger::log() << Logger::Info << "Running homing head tilt motor" << Logger::endl;
+        }
+        if (ht_state_changed) {
+            Logger::log() << Logger::Info << "ht motor state: " << getServoStateStr(ht_servo_state_) << Logger::endl;
+        }
+        if (t_state_changed) {
+            Logger::log() << Logger::Info << "t motor state: " << getServoStateStr(t_servo_state_) << Logger::endl;
+        }
     }
-
-    port_t_MotorStatus_out_.write(t_status_out);
-    port_hp_status_out_.write(hp_status_out);
-    port_ht_status_out_.write(ht_status_out);
-
-    port_t_MotorCurrentCommand_in_.read(t_MotorCurrentCommand_in_);
-
-    ros::Time now = rtt_rosclock::host_now();
-    double cmd_div = std::max(1.0, (now - last_update_time_).toSec()/0.001);
-    last_update_time_ = now;
-    t_MotorCurrentCommand_in_ = t_MotorCurrentCommand_in_ / cmd_div;
-
-    //
-    // head
-    //
-    port_hp_q_in_.read(hp_q_in_);
-    port_hp_v_in_.read(hp_v_in_);
-    port_hp_c_in_.read(hp_c_in_);
-    port_hp_q_out_.write(hp_q_out_);
-    port_hp_v_out_.write(hp_v_out_);
-    port_ht_q_in_.read(ht_q_in_);
-    port_ht_v_in_.read(ht_v_in_);
-    port_ht_c_in_.read(ht_c_in_);
-    port_ht_q_out_.write(ht_q_out_);
-    port_ht_v_out_.write(ht_v_out_);
 }
 
 bool TorsoGazebo::startHook() {
@@ -170,6 +273,39 @@ bool TorsoGazebo::startHook() {
 }
 
 bool TorsoGazebo::configureHook() {
+    Logger::In in("TorsoGazebo::configureHook");
+    StartupCoordinator::ScopedPhase phase(getName(), "configure");
+
+    if (head_sensor_names_.size() > 32) {
+        Logger::log() << Logger::Error << "too many head sensors: " << head_sensor_names_.size() << ", max is 32" << Logger::endl;
+        return false;
+    }
+
+    if (head_max_vel_ <= 0.0 || head_max_acc_ <= 0.0) {
+        Logger::log() << Logger::Error << "head_max_vel and head_max_acc must be positive" << Logger::endl;
+        return false;
+    }
+
+    {
+        RTT::os::MutexLock lock(gazebo_mutex_);
+        hp_profile_.setLimits(head_max_vel_, head_max_acc_);
+        ht_profile_.setLimits(head_max_vel_, head_max_acc_);
+    }
+
+    head_sensors_.clear();
+    head_sensors_.resize(head_sensor_names_.size());
+    head_sensors_resolve_counter_ = 0;
+    head_sensors_resolve_tries_ = 0;
+    head_sensors_active_out_ = 0;
+    resolveHeadSensors();
+
+    export_state_ = RobotStateExport::getInstance().acquire(getName());
+
     return true;
 }
 
+void TorsoGazebo::cleanupHook() {
+    export_state_ = false;
+    RobotStateExport::getInstance().release(getName());
+}
+
@@ -0,0 +1,145 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+//
+// A standalone check of MomentumObserver, without ROS and Gazebo. A planar
+// arm with two joints in the vertical plane tracks a sinusoidal trajectory
+// with a PD controller at 1 kHz, and a step external torque is applied at
+// t = 1 s. The residual must stay near zero before the step, reach 63% of
+// the step after the time constant 1/K, and track the step afterwards.
+//
+
+#include <cmath>
+#include <cstdio>
+
+#include "momentum_observer.h"
+
+namespace {
+
+const double m1 = 4.0, m2 = 3.0;
+const double l1 = 0.4, lc1 = 0.2, lc2 = 0.2;
+const double I1 = 0.05, I2 = 0.04;
+const double grav = 9.81;
+
+void massMatrix(const Eigen::Vector2d &q, Eigen::MatrixXd &M) {
+    const double c2 = std::cos(q(1));
+    M.resize(2, 2);
+    M(0,0) = m1*lc1*lc1 + m2*(l1*l1 + lc2*lc2 + 2.0*l1*lc2*c2) + I1 + I2;
+    M(0,1) = M(1,0) = m2*(lc2*lc2 + l1*lc2*c2) + I2;
+    M(1,1) = m2*lc2*lc2 + I2;
+}
+
+// b = C dq + g
+void biasTorques(const Eigen::Vector2d &q, const Eigen::Vector2d &dq, Eigen::VectorXd &b) {
+    const double h = -m2*l1*lc2*std::sin(q(1));
+    b.resize(2);
+    b(0) = h*(2.0*dq(0)*dq(1) + dq(1)*dq(1)) + (m1*lc1 + m2*l1)*grav*std::cos(q(0)) + m2*lc2*grav*std::cos(q(0) + q(1));
+    b(1) = -h*dq(0)*dq(0) + m2*lc2*grav*std::cos(q(0) + q(1));
+}
+
+}   // namespace
+
+int main(int argc, char **argv) {
+    const double dt = 0.001;
+    const double gain = 50.0;
+    const double t_step = 1.0;
+    const double t_end = 3.0;
+    const double tolerance = 0.01;
+    const Eigen::Vector2d tau_ext(2.0, -1.0);
+
+    MomentumObserver observer;
+    observer.configure(2, gain);
+
+    Eigen::Vector2d q(0.3, 0.5), dq(0.0, 0.0);
+    Eigen::MatrixXd M;
+    Eigen::VectorXd b, g, tau(2), dq_x(2);
+
+    double max_err_before = 0.0;
+    double max_err_after = 0.0;
+    double rise = 0.0;
+    bool rise_checked = false;
+
+    tau.setZero();
+    for (int k = 0; ; ++k) {
+        const double t = k * dt;
+
+        // the state after the previous step, the torque applied in it
+        massMatrix(q, M);
+        dq_x = dq;
+        biasTorques(q, dq, b);
+        observer.update(M, dq_x, tau, b, (k == 0) ? 0.0 : dt);
+
+        const Eigen::VectorXd &r = observer.getResidual();
+        const Eigen::Vector2d expected = (t > t_step + 0.5*dt) ? tau_ext : Eigen::Vector2d::Zero();
+        if (t > t_step - 0.5*dt && !rise_checked && t >= t_step + 1.0/gain - 0.5*dt) {
+            rise = r(0) / tau_ext(0);
+            rise_checked = true;
+        }
+        if (t > 0.2 && t < t_step) {
+            max_err_before = std::max(max_err_before, (r - expected).cwiseAbs().maxCoeff());
+        }
+        if (t > t_step + 0.25) {
+            max_err_after = std::max(max_err_after, (r - expected).cwiseAbs().maxCoeff());
+        }
+
+        if (t >= t_end) {
+            break;
+        }
+
+        // PD tracking of a sinusoidal trajectory, with gravity compensation
+        const Eigen::Vector2d q_d(0.3 + 0.5*std::sin(2.0*t), 0.5 + 0.7*std::sin(3.0*t));
+        biasTorques(q, Eigen::Vector2d::Zero(), g);
+        tau = 200.0*(q_d - q) - 20.0*dq + g;
+
+        // semi-implicit Euler step of M ddq = tau + tau_ext - b, as in ODE
+        biasTorques(q, dq, b);
+        Eigen::Vector2d tau_total = tau + ((t >= t_step - 0.5*dt) ? tau_ext : Eigen::Vector2d::Zero());
+        const Eigen::Vector2d ddq = M.ldlt().solve(tau_total - b);
+        dq += ddq * dt;
+        q += dq * dt;
+    }
+
+    std::printf("max |r - tau_ext| before the step: %g Nm\n", max_err_before);
+    std::printf("residual after 1/K: %g of the step\n", rise);
+    std::printf("max |r - tau_ext| from 0.25 s after the step: %g Nm\n", max_err_after);
+
+    bool ok = true;
+    if (max_err_before > tolerance) {
+        std::printf("FAILED: the residual is not zero without external torques\n");
+        ok = false;
+    }
+    if (std::fabs(rise - (1.0 - std::exp(-1.0))) > 0.05) {
+        std::printf("FAILED: the time constant of the residual is not 1/K\n");
+        ok = false;
+    }
+    if (max_err_after > tolerance) {
+        std::printf("FAILED: the residual does not track the external torque within %g Nm\n", tolerance);
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}
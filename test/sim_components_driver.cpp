@@ -0,0 +1,272 @@
+/*
+ Copyright (c) 2014, Robot Control and Pattern Recognition Group, Warsaw University of Technology
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+     * Redistributions of source code must retain the above copyright
+       notice, this list of conditions and the following disclaimer.
+     * Redistributions in binary form must reproduce the above copyright
+       notice, this list of conditions and the following disclaimer in the
+       documentation and/or other materials provided with the distribution.
+     * Neither the name of the Warsaw University of Technology nor the
+       names of its contributors may be used to endorse or promote products
+       derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYright HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+//
+// Runs the update hooks of TorsoGazebo, FtSensorGazebo, LWRGazebo and
+// OptoforceGazebo against FakeSimModel, without Gazebo and the deployer. The
+// script of the model moves the torso joint along a sinusoid, applies a step
+// force to the F/T sensor joint at t = 0.1 s, enables one of the head sensors
+// and applies a step torque to one joint of the arm at t = 1 s; the outputs of
+// the components are compared with the scripted state. The arm holds its
+// initial position and the Optoforce joints are moved back to zero by the
+// components. The throughput of the hooks is reported in steps per second.
+// With the audit library preloaded the hooks of all components are audited as
+// in the simulator, e.g.
+//
+//   LD_PRELOAD=libvelma_sim_allocation_audit.so VELMA_SIM_ALLOCATION_AUDIT_ABORT=1 sim_components_driver
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+#include "sim_physics_fake.h"
+#include "torso_gazebo.h"
+#include "ft_sensor_gazebo.h"
+#include "lwr_gazebo.h"
+#include "optoforce_gazebo.h"
+
+namespace {
+
+const double torso_amplitude = 0.2;
+const double ft_force = 10.0;
+const double ft_step_time = 0.1;
+
+// the arm is held at the initial position by the stiffness of 10 Nm/rad
+// of the monitor mode; the fake joints are damped, so it settles
+const int arm_joints = 7;
+const int arm_disturbed_joint = 3;
+const double arm_torque = 5.0;
+const double arm_step_time = 1.0;
+const double arm_stiffness = 10.0;
+const double arm_damping = 5.0;
+
+const double optoforce_q0 = 0.1;
+const double optoforce_damping = 10.0;
+
+std::string armJoint(int i) {
+    return "right_arm_" + std::to_string(i) + "_joint";
+}
+
+std::string optoforceJoint(int i) {
+    const char *fingers[3] = {"One", "Two", "Three"};
+    return std::string("right_HandFinger") + fingers[i] + "KnuckleThreeOptoforceJoint";
+}
+
+double armInitialPosition(int i) {
+    return 0.1 * (i + 1);
+}
+
+typedef std::chrono::steady_clock Clock;
+
+double seconds(Clock::duration d) {
+    return std::chrono::duration<double >(d).count();
+}
+
+void script(FakeSimModel &model) {
+    const double t = model.getSimTime();
+    std::shared_ptr<FakeSimJoint > torso = model.getFakeJoint("torso_0_joint");
+    torso->setPosition(torso_amplitude * std::sin(t));
+    torso->setVelocity(torso_amplitude * std::cos(t));
+
+    SimVector3 force = {0.0, 0.0, 0.0};
+    SimVector3 torque = {0.0, 0.0, 0.0};
+    if (t >= ft_step_time) {
+        // the wrench applied to the child link, the sensor measures the opposite one
+        force.z = -ft_force;
+    }
+    model.getFakeJoint("ft_joint")->setLinkWrench(force, torque);
+
+    // the external torque is added to the torque set by the component in the next step
+    if (t >= arm_step_time) {
+        model.getFakeJoint("velma::" + armJoint(arm_disturbed_joint))->setForce(arm_torque);
+    }
+}
+
+}   // namespace
+
+int main(int argc, char **argv) {
+    const double dt = 0.001;
+    const double t_end = 3.0;
+
+    std::shared_ptr<FakeSimModel > model(new FakeSimModel("velma"));
+    model->addJoint("torso_0_joint");
+    model->addJoint("head_pan_joint");
+    model->addJoint("head_tilt_joint");
+    model->addJoint("ft_joint");
+    for (int i = 0; i < arm_joints; ++i) {
+        model->addJoint("velma::" + armJoint(i), 1.0, arm_damping);
+    }
+    for (int i = 0; i < 3; ++i) {
+        model->addJoint(optoforceJoint(i), 1.0, optoforce_damping)->setPosition(optoforce_q0);
+    }
+    model->addSensor("stereo_left_camera")->setActive(true);
+    model->addSensor("stereo_right_camera");
+    model->setScript(script);
+    script(*model);
+
+    TorsoGazebo torso("TorsoSim");
+    FtSensorGazebo ft("FtSim");
+    ft.properties()->getPropertyType<std::string >("joint_name")->set("ft_joint");
+    ft.properties()->getPropertyType<std::vector<double > >("transform_xyz")->set(std::vector<double >(3, 0.0));
+    ft.properties()->getPropertyType<std::vector<double > >("transform_rpy")->set(std::vector<double >(3, 0.0));
+
+    if (!torso.simConfigureHook(model) || !torso.configureHook() || !torso.startHook()) {
+        std::printf("FAILED: could not configure TorsoGazebo\n");
+        return 1;
+    }
+    if (!ft.simConfigureHook(model) || !ft.configureHook() || !ft.startHook()) {
+        std::printf("FAILED: could not configure FtSensorGazebo\n");
+        return 1;
+    }
+
+    LWRGazebo lwr("LwrSim");
+    std::vector<std::string > init_names;
+    std::vector<double > init_positions;
+    for (int i = 0; i < arm_joints; ++i) {
+        init_names.push_back(armJoint(i));
+        init_positions.push_back(armInitialPosition(i));
+    }
+    lwr.properties()->getPropertyType<std::string >("name")->set("right");
+    lwr.properties()->getPropertyType<std::string >("model_scope")->set("velma");
+    lwr.properties()->getPropertyType<std::vector<std::string > >("init_joint_names")->set(init_names);
+    lwr.properties()->getPropertyType<std::vector<double > >("init_joint_positions")->set(init_positions);
+    if (!lwr.simConfigureHook(model) || !lwr.configureHook() || !lwr.startHook()) {
+        std::printf("FAILED: could not configure LWRGazebo\n");
+        return 1;
+    }
+
+    OptoforceGazebo optoforce("OptoforceSim");
+    optoforce.properties()->getPropertyType<std::string >("device_name")->set("gazebo_rightHand");
+    optoforce.properties()->getPropertyType<std::vector<std::string > >("frame_id_vec")->set(
+            std::vector<std::string >(3, "optoforce"));
+    if (!optoforce.simConfigureHook(model) || !optoforce.configureHook() || !optoforce.startHook()) {
+        std::printf("FAILED: could not configure OptoforceGazebo\n");
+        return 1;
+    }
+
+    // the encoder of the torso motor, as in TorsoGazebo::simUpdateHook
+    const double torso_trans_mult = 131072.0 * 158.0 / (M_PI * 2.0);
+    const double torso_motor_offset = 270119630.0;
+
+    // the time of the hooks of every component (simulation and Orocos), and of the whole step
+    enum {TORSO, FT, LWR, OPTOFORCE, COMPONENTS};
+    const char *component_names[COMPONENTS] = {"TorsoGazebo", "FtSensorGazebo", "LWRGazebo", "OptoforceGazebo"};
+    Clock::duration hooks_time[COMPONENTS] = {};
+    Clock::duration step_time = Clock::duration::zero();
+
+    double max_torso_err = 0.0;
+    int steps = 0;
+    for (double t = 0.0; t < t_end; t += dt, ++steps) {
+        const double q = model->getFakeJoint("torso_0_joint")->getPosition();
+
+        const Clock::time_point t0 = Clock::now();
+        torso.simUpdateHook();
+        torso.updateHook();
+        const Clock::time_point t1 = Clock::now();
+        ft.simUpdateHook();
+        ft.updateHook();
+        const Clock::time_point t2 = Clock::now();
+        lwr.simUpdateHook();
+        lwr.updateHook();
+        const Clock::time_point t3 = Clock::now();
+        optoforce.simUpdateHook();
+        optoforce.updateHook();
+        const Clock::time_point t4 = Clock::now();
+        model->step(dt);
+        const Clock::time_point t5 = Clock::now();
+
+        hooks_time[TORSO] += t1 - t0;
+        hooks_time[FT] += t2 - t1;
+        hooks_time[LWR] += t3 - t2;
+        hooks_time[OPTOFORCE] += t4 - t3;
+        step_time += t5 - t0;
+
+        const double expected = q * torso_trans_mult + torso_motor_offset;
+        max_torso_err = std::max(max_torso_err, std::fabs(torso.t_MotorPosition_out_ - expected));
+    }
+
+    // the gages are scaled by 1000000 by default
+    const double fz = ft.FzGage2_out_ * 0.000001;
+
+    double max_arm_err = 0.0;
+    for (int i = 0; i < arm_joints; ++i) {
+        double expected = armInitialPosition(i);
+        if (i == arm_disturbed_joint) {
+            expected += arm_torque / arm_stiffness;
+        }
+        max_arm_err = std::max(max_arm_err, std::fabs(model->getFakeJoint("velma::" + armJoint(i))->getPosition() - expected));
+    }
+    const double arm_ext = lwr.ExternalJointTorque_out_[arm_disturbed_joint];
+
+    double max_optoforce_q = 0.0;
+    for (int i = 0; i < 3; ++i) {
+        max_optoforce_q = std::max(max_optoforce_q, std::fabs(model->getFakeJoint(optoforceJoint(i))->getPosition()));
+    }
+
+    std::printf("steps: %d\n", steps);
+    std::printf("max torso encoder error: %g counts\n", max_torso_err);
+    std::printf("F/T force z: %g N, sample counter: %u\n", fz, ft.SampleCounter_out_);
+    std::printf("head sensors active: 0x%x\n", torso.head_sensors_active_out_);
+    std::printf("max arm position error: %g rad, external torque: %g Nm\n", max_arm_err, arm_ext);
+    std::printf("max Optoforce joint position: %g rad\n", max_optoforce_q);
+
+    std::printf("throughput: %.0f steps/s\n", steps / seconds(step_time));
+    for (int c = 0; c < COMPONENTS; ++c) {
+        std::printf("    %-16s %.0f steps/s\n", component_names[c], steps / seconds(hooks_time[c]));
+    }
+
+    bool ok = true;
+    if (max_torso_err > 1.0) {
+        std::printf("FAILED: the torso encoder does not follow the joint\n");
+        ok = false;
+    }
+    if (std::fabs(fz - ft_force) > 0.01 * ft_force || ft.SampleCounter_out_ == 0) {
+        std::printf("FAILED: the F/T gages do not follow the applied force\n");
+        ok = false;
+    }
+    // the default head sensors are openni_camera_camera, stereo_left_camera and stereo_right_camera
+    if (torso.head_sensors_active_out_ != 0x2) {
+        std::printf("FAILED: the activity of the head sensors is wrong\n");
+        ok = false;
+    }
+    if (max_arm_err > 0.01) {
+        std::printf("FAILED: the arm does not hold the initial position\n");
+        ok = false;
+    }
+    if (std::fabs(arm_ext - arm_torque) > 0.05 * arm_torque) {
+        std::printf("FAILED: the external torque of the arm is not estimated\n");
+        ok = false;
+    }
+    if (max_optoforce_q > 0.001) {
+        std::printf("FAILED: the Optoforce joints are not held at zero\n");
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}